@@ -0,0 +1,560 @@
+/// Headless benchmarks for world generation, meshing and world queries.
+///
+/// The benchmarks run without a window or a GL context, so they can run on
+/// machines without a GPU. Build them with CMAKE_BUILD_TYPE=Release for
+/// representative numbers. Like the game, they load the block texture atlas
+/// from ../assets, so run them from the build directory:
+///
+///    ./mineshaft-bench --seed=69 --region=4 --samples=10 --json=bench.json
+///
+/// Every benchmark is run a few times untimed to warm up the caches, and then
+/// timed over a number of samples. The median, mean, standard deviation and
+/// range of the sample times are reported, together with the throughput at
+/// the median time.
+///
+/// Builds with MC_ENABLE_HOT_METRICS count every block lookup, which slows
+/// down the getBlock, raycast and meshing benchmarks. Whether the counters
+/// were compiled in is printed and recorded in the JSON output.
+
+#include "mineshaft/Application.h"
+#include "mineshaft/Support/Metrics.h"
+#include "mineshaft/Support/Noise/SimplexNoise.h"
+#include "mineshaft/World/Chunk.h"
+#include "mineshaft/World/LightEngine.h"
+#include "mineshaft/World/World.h"
+#include "mineshaft/World/WorldGenerator.h"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mc;
+
+static llvm::cl::opt<int> Seed(
+   "seed", llvm::cl::desc("The world generation seed"), llvm::cl::init(69));
+
+static llvm::cl::opt<unsigned> RegionRadius(
+   "region", llvm::cl::desc("The radius in chunks of the generated region"),
+   llvm::cl::init(4));
+
+static llvm::cl::opt<unsigned> NumSamples(
+   "samples", llvm::cl::desc("The number of timed runs per benchmark"),
+   llvm::cl::init(10));
+
+static llvm::cl::opt<unsigned> NumWarmupRuns(
+   "warmup", llvm::cl::desc("The number of untimed runs per benchmark"),
+   llvm::cl::init(1));
+
+static llvm::cl::opt<std::string> Filter(
+   "filter",
+   llvm::cl::desc("Only run the benchmarks whose name contains this string"));
+
+static llvm::cl::opt<std::string> JSONFile(
+   "json", llvm::cl::desc("Also write the results to this file as JSON"),
+   llvm::cl::value_desc("filename"));
+
+/// The number of blocks in a chunk.
+static constexpr uint64_t BlocksPerChunk =
+   uint64_t(MC_CHUNK_WIDTH) * MC_CHUNK_HEIGHT * MC_CHUNK_DEPTH;
+
+/// Keeps the compiler from optimizing away the benchmarked work.
+static volatile float Sink;
+
+namespace {
+
+/// An amount of work done by every run of a benchmark.
+struct Workload {
+   /// The unit of the work, e.g. "chunks".
+   const char *unit;
+
+   /// The amount of work per run.
+   uint64_t perRun;
+};
+
+/// The timed runs of a benchmark.
+struct BenchmarkResult {
+   /// The name of the benchmark.
+   std::string name;
+
+   /// The work done by every run.
+   llvm::SmallVector<Workload, 2> workloads;
+
+   /// The duration of every timed run in seconds, sorted.
+   std::vector<double> times;
+
+   /// \return The median run time.
+   double getMedian() const
+   {
+      size_t n = times.size();
+      if (n % 2) {
+         return times[n / 2];
+      }
+
+      return (times[n / 2 - 1] + times[n / 2]) / 2.0;
+   }
+
+   /// \return The mean run time.
+   double getMean() const
+   {
+      double sum = 0.0;
+      for (double time : times) {
+         sum += time;
+      }
+
+      return sum / times.size();
+   }
+
+   /// \return The sample standard deviation of the run times.
+   double getStdDev() const
+   {
+      if (times.size() < 2) {
+         return 0.0;
+      }
+
+      double mean = getMean();
+      double sum = 0.0;
+      for (double time : times) {
+         sum += (time - mean) * (time - mean);
+      }
+
+      return std::sqrt(sum / (times.size() - 1));
+   }
+};
+
+/// Generates a region of the world once and runs the benchmarks on it.
+class BenchmarkRunner {
+   using Clock = std::chrono::steady_clock;
+
+   /// The benchmarked world.
+   World world;
+
+   /// The world generation options.
+   WorldGenOptions options;
+
+   /// The generator of the world.
+   DefaultTerrainGenerator *generator;
+
+   /// The chunks that are surrounded by generated chunks.
+   std::vector<Chunk*> innerChunks;
+
+   /// The results of the benchmarks that ran.
+   std::vector<BenchmarkResult> results;
+
+   /// Time \p run over the configured number of samples. \p setup, if
+   /// given, is called before every run and is not timed.
+   void measure(llvm::StringRef name, llvm::ArrayRef<Workload> workloads,
+                llvm::function_ref<void()> run,
+                llvm::function_ref<void()> setup = nullptr);
+
+   void benchmarkNoise();
+   void benchmarkTerrainColumns();
+   void benchmarkGenerateTerrain();
+   void benchmarkMeshing();
+   void benchmarkGetBlock();
+   void benchmarkRaycast();
+
+   /// \return A position within the generated region.
+   WorldPosition getRandomPosition(std::mt19937 &rng, int minY, int maxY);
+
+public:
+   explicit BenchmarkRunner(Application &app);
+
+   /// Generate the region the benchmarks run on.
+   void generateRegion();
+
+   /// Run all benchmarks that match the filter.
+   void runAll();
+
+   /// Print the results as a table.
+   void printResults(llvm::raw_ostream &OS) const;
+
+   /// Write the results as JSON.
+   void writeJSON(llvm::raw_ostream &OS) const;
+};
+
+} // anonymous namespace
+
+BenchmarkRunner::BenchmarkRunner(Application &app)
+   : world(app)
+{
+   options.seed = Seed;
+   generator = new(app) DefaultTerrainGenerator(&world, options);
+   world.setWorldGenerator(generator);
+}
+
+void BenchmarkRunner::generateRegion()
+{
+   int radius = (int)RegionRadius;
+   auto start = Clock::now();
+
+   for (int x = -radius; x <= radius; ++x) {
+      for (int z = -radius; z <= radius; ++z) {
+         Chunk *chunk = world.generateChunkNow(ChunkPosition(x, z));
+
+         if (std::abs(x) < radius && std::abs(z) < radius) {
+            innerChunks.push_back(chunk);
+         }
+      }
+   }
+
+   // Spread the light of the new chunks, so that meshing sees the same light
+   // levels as in the game.
+   auto *lightEngine = world.getLightEngine();
+   lightEngine->update();
+   lightEngine->waitForUpdates();
+   lightEngine->update();
+
+   double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+   unsigned numChunks = (2 * radius + 1) * (2 * radius + 1);
+
+   llvm::outs() << "Generated " << numChunks << " chunks in "
+                << llvm::format("%0.1f", elapsed * 1e3) << " ms\n\n";
+}
+
+void BenchmarkRunner::measure(llvm::StringRef name,
+                              llvm::ArrayRef<Workload> workloads,
+                              llvm::function_ref<void()> run,
+                              llvm::function_ref<void()> setup) {
+   if (!name.contains(Filter)) {
+      return;
+   }
+
+   for (unsigned i = 0; i < NumWarmupRuns; ++i) {
+      if (setup) {
+         setup();
+      }
+
+      run();
+   }
+
+   BenchmarkResult result;
+   result.name = name.str();
+   result.workloads.append(workloads.begin(), workloads.end());
+
+   for (unsigned i = 0; i < NumSamples; ++i) {
+      if (setup) {
+         setup();
+      }
+
+      auto start = Clock::now();
+      run();
+      auto end = Clock::now();
+
+      result.times.push_back(std::chrono::duration<double>(end - start).count());
+   }
+
+   std::sort(result.times.begin(), result.times.end());
+   results.push_back(std::move(result));
+}
+
+WorldPosition BenchmarkRunner::getRandomPosition(std::mt19937 &rng,
+                                                 int minY, int maxY) {
+   int radius = (int)RegionRadius;
+   std::uniform_int_distribution<int> horizontal(
+      -radius * MC_CHUNK_WIDTH, (radius + 1) * MC_CHUNK_WIDTH - 1);
+   std::uniform_int_distribution<int> vertical(minY, maxY - 1);
+
+   int x = horizontal(rng);
+   int y = vertical(rng);
+   int z = horizontal(rng);
+
+   return WorldPosition(x, y, z);
+}
+
+void BenchmarkRunner::benchmarkNoise()
+{
+   static constexpr int Size = 256;
+
+   FastNoise noise(options.seed);
+   noise.SetFractalType(FastNoise::FBM);
+
+   measure("noise.simplexFractal", { { "samples", Size * Size } }, [&]() {
+      float sum = 0.0f;
+      for (int x = 0; x < Size; ++x) {
+         for (int z = 0; z < Size; ++z) {
+            sum += noise.GetSimplexFractal((float)x, (float)z);
+         }
+      }
+
+      Sink = sum;
+   });
+}
+
+void BenchmarkRunner::benchmarkTerrainColumns()
+{
+   static constexpr int Size = 128;
+
+   FastNoise noise(options.seed);
+   measure("noise.terrainColumn", { { "columns", Size * Size } }, [&]() {
+      int sum = 0;
+      TerrainColumn column;
+
+      for (int x = 0; x < Size; ++x) {
+         for (int z = 0; z < Size; ++z) {
+            generator->sampleColumn(noise, x, z, column);
+            sum += column.height;
+         }
+      }
+
+      Sink = (float)sum;
+   });
+}
+
+void BenchmarkRunner::benchmarkGenerateTerrain()
+{
+   static constexpr int Size = 4;
+
+   // Generate chunks outside of the region, so that they are not confused
+   // with the chunks of the world.
+   int offset = (int)RegionRadius + 2;
+
+   std::vector<std::unique_ptr<Chunk>> chunks;
+   std::vector<World::DelayedBlockUpdate> outsideBlocks;
+
+   auto setup = [&]() {
+      chunks.clear();
+      for (int x = 0; x < Size; ++x) {
+         for (int z = 0; z < Size; ++z) {
+            chunks.push_back(
+               std::make_unique<Chunk>(&world, offset + x, offset + z));
+         }
+      }
+
+      outsideBlocks.clear();
+   };
+
+   measure("world.generateTerrain",
+       { { "chunks", Size * Size }, { "blocks", Size * Size * BlocksPerChunk } },
+       [&]() {
+          for (auto &chunk : chunks) {
+             generator->generateTerrain(*chunk, outsideBlocks);
+          }
+       },
+       setup);
+
+   chunks.clear();
+}
+
+void BenchmarkRunner::benchmarkMeshing()
+{
+   auto numChunks = (uint64_t)innerChunks.size();
+
+   measure("chunk.updateVisibility",
+       { { "chunks", numChunks }, { "blocks", numChunks * BlocksPerChunk } },
+       [&]() {
+          for (auto *chunk : innerChunks) {
+             chunk->updateVisibility();
+          }
+       },
+       [&]() {
+          for (auto *chunk : innerChunks) {
+             chunk->setModified();
+          }
+       });
+}
+
+void BenchmarkRunner::benchmarkGetBlock()
+{
+   static constexpr unsigned NumLookups = 1u << 20;
+
+   std::mt19937 rng((unsigned)options.seed);
+   std::vector<WorldPosition> positions;
+   positions.reserve(NumLookups);
+
+   for (unsigned i = 0; i < NumLookups; ++i) {
+      positions.push_back(getRandomPosition(rng, -32, 96));
+   }
+
+   measure("world.getBlock", { { "blocks", NumLookups } }, [&]() {
+      unsigned numSolid = 0;
+      for (auto &pos : positions) {
+         auto *block = world.getBlock(pos);
+         numSolid += block && block->isSolid();
+      }
+
+      Sink = (float)numSolid;
+   });
+}
+
+void BenchmarkRunner::benchmarkRaycast()
+{
+   static constexpr unsigned NumRays = 1u << 14;
+   static constexpr float MaxDistance = 64.0f;
+
+   struct Ray {
+      ScenePosition origin;
+      glm::vec3 direction;
+   };
+
+   std::mt19937 rng((unsigned)options.seed + 1);
+   std::normal_distribution<float> normal;
+
+   std::vector<Ray> rays;
+   rays.reserve(NumRays);
+
+   for (unsigned i = 0; i < NumRays; ++i) {
+      auto origin = getScenePosition(getRandomPosition(rng, 0, 64));
+      glm::vec3 direction(normal(rng), normal(rng), normal(rng));
+
+      rays.push_back(Ray{ origin, direction });
+   }
+
+   measure("world.raycast", { { "rays", NumRays } }, [&]() {
+      float sum = 0.0f;
+      for (auto &ray : rays) {
+         if (auto hit = world.raycast(ray.origin, ray.direction, MaxDistance)) {
+            sum += hit->distance;
+         }
+      }
+
+      Sink = sum;
+   });
+}
+
+void BenchmarkRunner::runAll()
+{
+   benchmarkNoise();
+   benchmarkTerrainColumns();
+   benchmarkGenerateTerrain();
+   benchmarkMeshing();
+   benchmarkGetBlock();
+   benchmarkRaycast();
+}
+
+/// Print \p perSecond with a metric prefix.
+static void printRate(llvm::raw_ostream &OS, double perSecond,
+                      llvm::StringRef unit) {
+   static constexpr const char *prefixes[] = { "", "k", "M", "G" };
+
+   unsigned prefix = 0;
+   while (perSecond >= 1000.0 && prefix < llvm::array_lengthof(prefixes) - 1) {
+      perSecond /= 1000.0;
+      ++prefix;
+   }
+
+   OS << llvm::format("%7.2f", perSecond) << " " << prefixes[prefix] << unit
+      << "/s";
+}
+
+void BenchmarkRunner::printResults(llvm::raw_ostream &OS) const
+{
+   OS << llvm::left_justify("benchmark", 24)
+      << llvm::right_justify("median", 11) << llvm::right_justify("mean", 11)
+      << llvm::right_justify("stddev", 9) << llvm::right_justify("min", 11)
+      << llvm::right_justify("max", 11) << "  throughput\n";
+
+   for (auto &result : results) {
+      double median = result.getMedian();
+      double mean = result.getMean();
+
+      OS << llvm::format("%-24s %7.3f ms %7.3f ms %7.1f%% %7.3f ms %7.3f ms ",
+                         result.name.c_str(), median * 1e3, mean * 1e3,
+                         100.0 * result.getStdDev() / mean,
+                         result.times.front() * 1e3, result.times.back() * 1e3);
+
+      llvm::ListSeparator separator(", ");
+      for (auto &workload : result.workloads) {
+         OS << separator;
+         printRate(OS, workload.perRun / median, workload.unit);
+      }
+
+      OS << "\n";
+   }
+}
+
+void BenchmarkRunner::writeJSON(llvm::raw_ostream &OS) const
+{
+   llvm::json::OStream J(OS, 2);
+   J.object([&]() {
+      J.attribute("seed", options.seed);
+      J.attribute("region", (int64_t)RegionRadius);
+      J.attribute("samples", (int64_t)NumSamples);
+      J.attribute("hotMetrics", (bool)MC_ENABLE_HOT_METRICS);
+
+      J.attributeArray("benchmarks", [&]() {
+         for (auto &result : results) {
+            double median = result.getMedian();
+
+            J.object([&]() {
+               J.attribute("name", result.name);
+               J.attribute("median", median);
+               J.attribute("mean", result.getMean());
+               J.attribute("stddev", result.getStdDev());
+               J.attribute("min", result.times.front());
+               J.attribute("max", result.times.back());
+
+               J.attributeObject("throughput", [&]() {
+                  for (auto &workload : result.workloads) {
+                     J.attribute(workload.unit, workload.perRun / median);
+                  }
+               });
+            });
+         }
+      });
+   });
+
+   OS << "\n";
+}
+
+int main(int argc, char **argv)
+{
+   llvm::cl::ParseCommandLineOptions(
+      argc, argv, "Mineshaft world generation and meshing benchmarks\n");
+
+   if (NumSamples == 0) {
+      llvm::errs() << "error: --samples must be at least 1\n";
+      return 1;
+   }
+
+   Application app;
+   if (app.initializeHeadless()) {
+      return 1;
+   }
+
+#ifndef NDEBUG
+   llvm::outs() << "warning: assertions are enabled, build with NDEBUG for "
+                   "representative numbers\n";
+#endif
+#if MC_ENABLE_HOT_METRICS
+   llvm::outs() << "warning: hot path metrics are enabled, every block lookup "
+                   "is counted\n";
+#endif
+
+   llvm::outs() << "seed " << Seed << ", region radius " << RegionRadius
+                << ", " << NumSamples << " samples, "
+                << app.getJobSystem().getNumThreads() << " worker threads\n";
+
+   BenchmarkRunner runner(app);
+   runner.generateRegion();
+   runner.runAll();
+   runner.printResults(llvm::outs());
+
+   if (JSONFile.empty()) {
+      return 0;
+   }
+
+   std::error_code EC;
+   llvm::raw_fd_ostream OS(JSONFile, EC, llvm::sys::fs::OF_Text);
+   if (EC) {
+      llvm::errs() << "error: failed to write " << JSONFile << ": "
+                   << EC.message() << "\n";
+
+      return 1;
+   }
+
+   runner.writeJSON(OS);
+   return 0;
+}
@@ -7,14 +7,18 @@
 #include "mineshaft/Texture/BasicTexture.h"
 #include "mineshaft/Texture/TextureAtlas.h"
 #include "mineshaft/Shader/Shader.h"
+#include "mineshaft/Support/AssetLoader.h"
+#include "mineshaft/Support/GPUProfiler.h"
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/Support/PoolAllocator.h"
 #include "mineshaft/Support/TextRenderer.h"
-#include "mineshaft/Support/Worker.h"
 
 #include <SFML/Graphics.hpp>
 #include <llvm/ADT/FoldingSet.h>
 #include <llvm/ADT/StringMap.h>
 #include <llvm/Support/Allocator.h>
 
+#include <mutex>
 #include <unordered_map>
 
 class GLFWwindow;
@@ -28,6 +32,10 @@ struct GameOptions {
    /// The maximum render distance (in chunks per direction).
    unsigned renderDistance = 2;
 
+   /// The distance up to which far terrain is rendered beyond the loaded
+   /// chunks (in chunks per direction).
+   unsigned farRenderDistance = 32;
+
    /// The maximum interaction distance.
    unsigned interactionDistance = 10;
 };
@@ -53,6 +61,22 @@ class Application {
    /// Map of loaded models
    llvm::StringMap<Model*> loadedModels;
 
+   /// Pool for the segments of chunks. Declared before the job system and the
+   /// save, so that it outlives everything that allocates from it.
+   PoolAllocator chunkSegmentPool;
+
+   /// Pool for the segments of worlds.
+   PoolAllocator worldSegmentPool;
+
+   /// Runs background work, e.g. world generation and asset loading.
+   JobSystem jobs;
+
+   /// Loads textures and models in the background.
+   AssetLoader assets;
+
+   /// Measures the GPU time of the render passes.
+   GPUProfiler gpuProfiler;
+
    /// The loaded save file.
    std::unique_ptr<GameSave> loadedSave;
 
@@ -68,13 +92,21 @@ public:
       SINGLE_COLOR_SHADER,
       NORMAL_SHADER,
       WATER_SHADER,
+      FAR_TERRAIN_SHADER,
+      BLOCKY_LIGHT_SHADER,
+      SMOOTH_LIGHT_SHADER,
 
       __NUM_SHADERS
    };
 
-   /// Allocator used in this context.
+   /// Allocator used in this context for objects that live as long as the
+   /// application, e.g. textures, shaders and models. World data comes from
+   /// the pools instead.
    mutable llvm::BumpPtrAllocator Allocator;
 
+   /// Protects the allocator.
+   mutable std::mutex allocatorMutex;
+
    /// The game options.
    GameOptions gameOptions;
 
@@ -84,9 +116,6 @@ public:
    /// The event dispatcher.
    EventDispatcher events;
 
-   /// Thread used for world generation.
-   Worker worldGenWorker;
-
    /// The currently active world.
    World *activeWorld = nullptr;
 
@@ -107,6 +136,9 @@ public:
    /// The current game state.
    GameState gameState = GameState::MainMenu;
 
+   /// True if the context was initialized without a window.
+   bool headless = false;
+
 private:
    /// Loaded shaders.
    Shader *Shaders[__NUM_SHADERS] = { nullptr };
@@ -124,6 +156,9 @@ public:
 
    bool renderDebugInfo = false;
 
+   /// If true, the metrics are shown next to the debug overlay.
+   bool renderMetrics = false;
+
    /// If true, the game will be exited after this frame.
    bool shouldQuit = false;
 
@@ -145,6 +180,9 @@ private:
    /// Run the pause screen.
    int handlePause();
 
+   /// Update the memory and queue gauges and the rates of the metrics.
+   void updateMetrics();
+
 public:
    /// Creates a context without initializing it.
    Application();
@@ -154,6 +192,7 @@ public:
 
    void *Allocate(size_t size, size_t alignment = 8) const
    {
+      std::lock_guard<std::mutex> guard(allocatorMutex);
       return Allocator.Allocate(size, alignment);
    }
 
@@ -169,6 +208,15 @@ public:
    /// Initialize the OpenGL context.
    bool initialize();
 
+   /// Initialize the context without a window or an OpenGL context, e.g. for
+   /// benchmarks. Terrain can be generated and meshed, but nothing can be
+   /// rendered or uploaded.
+   /// \return true on failure.
+   bool initializeHeadless();
+
+   /// \return true iff the context has no OpenGL context.
+   bool isHeadless() const { return headless; }
+
    /// Run the main application loop.
    int runGameLoop();
 
@@ -188,17 +236,15 @@ public:
    /// \return The current player entity.
    Player *getPlayer() const;
 
-   /// Load a model from a file, or return a previously loaded model of the
-   /// same name.
-   Model *getOrLoadModel(llvm::StringRef fileName);
-
    /// \return true iff a model with the given name is loaded.
    bool isModelLoaded(llvm::StringRef modelName);
 
    /// Intern a manually created model.
    Model *internModel(llvm::StringRef modelName, Model &&model);
 
-   /// Load a texture.
+   /// Load a texture, or return a previously loaded texture of the same
+   /// name. A newly requested texture uses a placeholder until it finished
+   /// loading.
    BasicTexture *loadTexture(BasicTexture::Kind K, llvm::StringRef File);
 
    /// Load a texture.
@@ -215,6 +261,18 @@ public:
    /// \return The camera object.
    Camera &getCamera() { return camera; }
 
+   /// \return The job system.
+   JobSystem &getJobSystem() { return jobs; }
+
+   /// \return The GPU profiler.
+   GPUProfiler &getGPUProfiler() { return gpuProfiler; }
+
+   /// \return The pool for chunk segments.
+   PoolAllocator &getChunkSegmentPool() { return chunkSegmentPool; }
+
+   /// \return The pool for world segments.
+   PoolAllocator &getWorldSegmentPool() { return worldSegmentPool; }
+
    /// \return The shader of the specified type.
    const Shader &getShader(ShaderKind K = BASIC_SHADER);
 };
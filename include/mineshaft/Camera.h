@@ -1,7 +1,9 @@
 #ifndef MINESHAFT_CAMERA_H
 #define MINESHAFT_CAMERA_H
 
+#include "mineshaft/Model/InstancedRenderer.h"
 #include "mineshaft/Model/Model.h"
+#include "mineshaft/Model/RenderQueue.h"
 
 #include <glm/glm.hpp>
 
@@ -15,6 +17,7 @@ class Block;
 class Chunk;
 class Event;
 class EventDispatcher;
+class FarTerrain;
 class Model;
 class World;
 
@@ -132,6 +135,21 @@ private:
    /// The current camera mode.
    CameraMode cameraMode = FirstPerson;
 
+   /// Batches the entity models for instanced drawing.
+   InstancedRenderer entityRenderer;
+
+   /// The uniform buffer holding the per-frame shader values.
+   FrameUniformBuffer frameUniforms;
+
+   /// Sorts the chunk mesh draws by their GL state.
+   RenderQueue renderQueue;
+
+   /// The texture of the pointed-at block's borders, loaded on first use.
+   BasicTexture *borderTexture = nullptr;
+
+   /// The mesh of the pointed-at block's borders, created on first use.
+   Mesh borderMesh;
+
 #ifndef NDEBUG
    bool renderFrustumPressed = false;
    ViewFrustum frustumToRender;
@@ -146,6 +164,10 @@ public:
    /// Initialize the camera event handlers.
    void initialize(GLFWwindow *window);
 
+   /// Delete the GL objects of the camera's renderers. Must be called before
+   /// the GL context is destroyed.
+   void clear();
+
    /// \return the position of the camera.
    const glm::vec3 &getPosition() const;
 
@@ -224,8 +246,10 @@ public:
    /// Check if a sphere is contained in the view frustum.
    ViewCullingTestResult sphereInFrustum(const BoundingSphere &sphere);
 
-   /// Check if a box is contained in the view frustum.
-   ViewCullingTestResult boxInFrustum(const BoundingBox &box);
+   /// Check if a box is contained in the view frustum. If \p ignoreFarPlane
+   /// is true, boxes beyond the far clipping distance are not culled.
+   ViewCullingTestResult boxInFrustum(const BoundingBox &box,
+                                      bool ignoreFarPlane = false);
 
    /// Draw the current view fractum.
    void renderFrustum(const ViewFrustum &viewFrustum);
@@ -251,10 +275,19 @@ public:
    /// Update viewing angle based on mouse inpit.
    void computeMatricesFromInputs();
 
+   /// Upload the values shared by all shaders for the current frame.
+   void updateFrameData();
+
    /// Render the given array of blocks.
    void renderBlocks(llvm::ArrayRef<const Block*> blocks, bool changed = true);
    void renderChunks(llvm::ArrayRef<const Chunk*> chunks);
 
+   /// Render the low detail terrain beyond the render distance.
+   void renderFarTerrain(FarTerrain &farTerrain);
+
+   /// Render the models of the active entities in a world.
+   void renderEntities(World &world);
+
    /// Find the block the player currently points at.
    const Block *getPointedAtBlock(World &world);
 
@@ -263,6 +296,9 @@ public:
 
    /// Render the debug overlay.
    void renderDebugOverlay();
+
+   /// Render the metrics overlay.
+   void renderMetricsOverlay();
 };
 
 } // namespace mc
@@ -20,9 +20,18 @@
 #define MC_CHUNK_HEIGHT         256
 #define MC_BLOCKS_PER_CHUNK_SEGMENT (MC_CHUNK_WIDTH * MC_CHUNK_SEGMENT_HEIGHT * MC_CHUNK_DEPTH)
 
+#define MC_MAX_LIGHT_LEVEL 15
+
+#define MC_SIMULATION_TICKS_PER_SECOND 60
+#define MC_ENTITY_GRID_CELL_SIZE       4
+
 #define MC_LOADED_CHUNKS_HORIZONTAL 10
 #define MC_LOADED_CHUNKS_VERTICAL   10
 
+#define MC_FAR_TERRAIN_REGION_SIZE  4
+#define MC_FAR_TERRAIN_SAMPLE_STEP  4
+#define FAR_TERRAIN_CLIPPING_DISTANCE 2000.0f
+
 namespace mc {
 
 /// A point in the rendered scene.
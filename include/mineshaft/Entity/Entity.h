@@ -2,8 +2,11 @@
 #define MINESHAFT_ENTITY_H
 
 #include "mineshaft/Config.h"
+#include "mineshaft/Entity/EntityStore.h"
 #include "mineshaft/Model/Model.h"
 
+#include <mutex>
+
 namespace mc {
 
 class Model;
@@ -38,6 +41,12 @@ protected:
    /// The bounding box of this entity.
    BoundingBox boundingBox;
 
+   /// The ID of this entity in the entity store of its world.
+   EntityID id = 0;
+
+   friend class Simulation;
+   friend class World;
+
 public:
    /// isa / cast implementation.
    static bool classof(Entity*) { return true; }
@@ -45,6 +54,9 @@ public:
    /// \return The entity kind.
    EntityKind getKind() const { return entityKind; }
 
+   /// \return The ID of this entity in the entity store of its world.
+   EntityID getID() const { return id; }
+
    /// \return The model matrix of this entity.
    glm::mat4 getModelMatrix() const;
 
@@ -92,15 +104,38 @@ protected:
    /// The current vertical angle.
    float verticalAngle;
 
-   /// The current vertical velocity.
-   float verticalVelocity = 0.0f;
-
    /// Whether or not this entity collides with other objects.
    bool collides = true;
 
+   /// Protects the input that is handed over to the simulation thread.
+   std::mutex inputMutex;
+
+   /// The movement that was requested since the last tick.
+   glm::vec3 pendingMovement = glm::vec3(0.0f);
+
+   /// The vertical velocity of a requested jump, 0 if there is none.
+   float pendingJumpVelocity = 0.0f;
+
+   /// True iff the entity should be moved to pendingPosition.
+   bool hasPendingPosition = false;
+
+   /// The position requested by setPosition().
+   ScenePosition pendingPosition;
+
+   /// Queue a movement, which is resolved in the next tick.
+   void requestMovement(const glm::vec3 &delta);
+
    /// Update the directional vectors.
    void updateVectors(Application &Ctx);
 
+   /// Apply the input since the last tick to the simulated components of
+   /// this entity, and add the requested movement to \p movement. Called on
+   /// the simulation thread.
+   void applyInput(ScenePosition &simulatedPosition, glm::vec3 &velocity,
+                   uint8_t &flags, glm::vec3 &movement);
+
+   friend class Simulation;
+
 public:
    enum class MovementKind {
       Walking,
@@ -108,19 +143,20 @@ public:
    };
 
 protected:
-   /// The kind of movement that is currently active.
+   /// The kind of movement that is currently active. Protected by inputMutex.
    MovementKind movementKind = MovementKind::Walking;
 
 public:
-   /// Update player position and direction.
-   void setPosition(const glm::vec3 &position) { this->position = position; }
+   /// Update player position and direction. The new position takes effect
+   /// with the next tick.
+   void setPosition(const glm::vec3 &position);
    void setDirection(const glm::vec3 &dir) { this->direction = dir; }
 
    /// \return The current movement kind.
    MovementKind getMovementKind() const { return movementKind; }
 
    /// Set the movement kind.
-   void setMovementKind(MovementKind k) { movementKind = k; }
+   void setMovementKind(MovementKind k);
 
    /// \return The current right vector of the player.
    const glm::vec3 &getRightVector() const { return right; }
@@ -128,8 +164,11 @@ public:
    /// \return The current up vector of the player.
    const glm::vec3 &getUpVector() const { return up; }
 
-   /// \return true iff the given position would collide with another object.
-   bool wouldCollide(Application &Ctx, const glm::vec3 &newPos) const;
+   /// isa / cast implementation.
+   static bool classof(Entity *e)
+   {
+      return e->getKind() == Entity::Player;
+   }
 
    /// Move forward along the direction vector.
    bool strafeForward(Application &Ctx, float speed);
@@ -0,0 +1,103 @@
+#ifndef MINESHAFT_ENTITYGRID_H
+#define MINESHAFT_ENTITYGRID_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Model/Model.h"
+#include "mineshaft/utils.h"
+
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace mc {
+
+/// Stable identifier of an entity within its store.
+using EntityID = uint32_t;
+
+/// The result of a ray cast against the entities in a grid.
+struct EntityRaycastResult {
+   /// The entity that was hit.
+   EntityID id = 0;
+
+   /// The distance from the ray origin to the hit, in scene units.
+   float distance = 0.0f;
+};
+
+/// A uniform grid of cells that maps every cell to the entities whose
+/// bounding box overlaps it. Only the occupied cells are stored. Moving an
+/// entity only touches the grid when it crosses a cell border.
+class EntityGrid {
+public:
+   /// The edge length of a cell, in scene units.
+   static constexpr float CellSize = MC_ENTITY_GRID_CELL_SIZE * MC_BLOCK_SCALE;
+
+private:
+   /// The grid state of an entity.
+   struct Entry {
+      /// The bounding box of the entity, in scene coordinates.
+      BoundingBox box;
+
+      /// The first and last cell overlapped by the box, inclusive.
+      WorldPosition minCell;
+      WorldPosition maxCell;
+
+      /// True iff the entity is in the grid.
+      bool inserted = false;
+   };
+
+   /// The entries, indexed by entity ID.
+   std::vector<Entry> entries;
+
+   /// The entities overlapping each occupied cell.
+   std::unordered_map<WorldPosition, std::vector<EntityID>> cells;
+
+   /// \return The cell containing a scene position.
+   static WorldPosition getCell(const glm::vec3 &pos);
+
+   /// Add an entity to the cells in a range.
+   void addToCells(EntityID id, const WorldPosition &min,
+                   const WorldPosition &max);
+
+   /// Remove an entity from the cells in a range.
+   void removeFromCells(EntityID id, const WorldPosition &min,
+                        const WorldPosition &max);
+
+public:
+   /// Insert or move an entity. Only the cells the entity entered or left
+   /// are updated.
+   void update(EntityID id, const BoundingBox &box);
+
+   /// Remove an entity from the grid.
+   void remove(EntityID id);
+
+   /// \return The bounding box an entity was last updated with.
+   const BoundingBox &getBoundingBox(EntityID id) const
+   {
+      return entries[id].box;
+   }
+
+   /// Find the entities whose bounding box intersects \p box. Every entity
+   /// is reported once.
+   void queryBox(const BoundingBox &box,
+                 llvm::SmallVectorImpl<EntityID> &result) const;
+
+   /// Find the entities whose bounding box is at most \p radius away from
+   /// \p center. Every entity is reported once.
+   void queryRange(const glm::vec3 &center, float radius,
+                   llvm::SmallVectorImpl<EntityID> &result) const;
+
+   /// Find the closest entity on a ray by walking the cells along it.
+   /// \param direction The normalized direction of the ray.
+   /// \param maxDistance The maximum length of the ray, in scene units.
+   /// \param ignore An entity that is never hit, e.g. the one casting the ray.
+   llvm::Optional<EntityRaycastResult> raycast(const glm::vec3 &origin,
+                                               const glm::vec3 &direction,
+                                               float maxDistance,
+                                               llvm::Optional<EntityID> ignore = llvm::None) const;
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_ENTITYGRID_H
@@ -0,0 +1,181 @@
+#ifndef MINESHAFT_ENTITYSTORE_H
+#define MINESHAFT_ENTITYSTORE_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Entity/EntityGrid.h"
+#include "mineshaft/Model/Model.h"
+#include "mineshaft/utils.h"
+
+#include <llvm/ADT/ArrayRef.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace mc {
+
+class Entity;
+
+/// A rectangle of chunks, including the minimum and excluding the maximum.
+struct ChunkArea {
+   int minX = 0;
+   int maxX = 0;
+   int minZ = 0;
+   int maxZ = 0;
+
+   /// \return true iff the area contains a chunk.
+   bool contains(const ChunkPosition &pos) const
+   {
+      return pos.x >= minX && pos.x < maxX && pos.z >= minZ && pos.z < maxZ;
+   }
+};
+
+/// Stores the simulated state of entities as parallel component arrays.
+/// Active entities, i.e. those in the active chunk area, always occupy the
+/// first slots, so that systems iterate a contiguous range of every array.
+/// Entities are additionally bucketed by chunk, so that (de)activating a
+/// chunk only touches the entities inside of it, and kept in a spatial grid
+/// for queries between entities.
+class EntityStore {
+public:
+   /// Per-entity flags.
+   enum Flags : uint8_t {
+      /// The entity collides with blocks.
+      Collides = 0x1,
+
+      /// The entity is pulled down by gravity.
+      HasGravity = 0x2,
+   };
+
+private:
+   /// The entity objects, indexed by slot.
+   std::vector<Entity*> owners;
+
+   /// The simulated positions, indexed by slot.
+   std::vector<ScenePosition> positions;
+
+   /// The velocities, indexed by slot.
+   std::vector<glm::vec3> velocities;
+
+   /// The bounding boxes relative to the position, indexed by slot.
+   std::vector<BoundingBox> boundingBoxes;
+
+   /// The chunk each entity is bucketed in, indexed by slot.
+   std::vector<ChunkPosition> chunks;
+
+   /// The flags of each entity, indexed by slot.
+   std::vector<uint8_t> flags;
+
+   /// The ID of the entity in each slot.
+   std::vector<EntityID> ids;
+
+   /// The slot of each entity, indexed by ID.
+   std::vector<unsigned> slots;
+
+   /// The number of active entities, which occupy the first slots.
+   unsigned numActive = 0;
+
+   /// The entities in each chunk. Empty buckets are removed.
+   std::unordered_map<ChunkPosition, std::vector<EntityID>> chunkBuckets;
+
+   /// The area of chunks whose entities are active.
+   ChunkArea activeArea;
+
+   /// The bounding boxes of all entities, by cell.
+   EntityGrid grid;
+
+   /// Exchange the components of two slots.
+   void swapSlots(unsigned a, unsigned b);
+
+   /// Move an entity into the active slots.
+   void activate(EntityID id);
+
+   /// Move an entity out of the active slots.
+   void deactivate(EntityID id);
+
+public:
+   /// Add an entity to the store. It is active iff it is in the active area.
+   /// \return The ID of the new entity.
+   EntityID addEntity(Entity *owner, const ScenePosition &position,
+                      const BoundingBox &boundingBox, uint8_t flags);
+
+   /// Change the area of active chunks, activating and deactivating only the
+   /// entities in chunks that entered or left the area.
+   void setActiveArea(const ChunkArea &area);
+
+   /// Move the bounding box of an entity in the grid to its position.
+   void updateGrid(EntityID id);
+
+   /// Move an entity into the bucket of the chunk its position is now in,
+   /// and update whether or not it is active. Slots may be reordered.
+   void updateChunk(EntityID id);
+
+   /// \return The slot of an entity.
+   unsigned getSlot(EntityID id) const { return slots[id]; }
+
+   /// \return true iff an entity is active.
+   bool isActive(EntityID id) const { return slots[id] < numActive; }
+
+   /// \return The number of active entities.
+   unsigned getNumActive() const { return numActive; }
+
+   /// \return The number of entities.
+   unsigned size() const { return (unsigned)ids.size(); }
+
+   /// \return The entity objects of the active entities.
+   llvm::ArrayRef<Entity*> getActiveOwners() const
+   {
+      return llvm::ArrayRef<Entity*>(owners.data(), numActive);
+   }
+
+   /// \return The positions of the active entities.
+   llvm::MutableArrayRef<ScenePosition> getActivePositions()
+   {
+      return llvm::MutableArrayRef<ScenePosition>(positions.data(), numActive);
+   }
+
+   /// \return The velocities of the active entities.
+   llvm::MutableArrayRef<glm::vec3> getActiveVelocities()
+   {
+      return llvm::MutableArrayRef<glm::vec3>(velocities.data(), numActive);
+   }
+
+   /// \return The bounding boxes of the active entities.
+   llvm::ArrayRef<BoundingBox> getActiveBoundingBoxes() const
+   {
+      return llvm::ArrayRef<BoundingBox>(boundingBoxes.data(), numActive);
+   }
+
+   /// \return The flags of the active entities.
+   llvm::MutableArrayRef<uint8_t> getActiveFlags()
+   {
+      return llvm::MutableArrayRef<uint8_t>(flags.data(), numActive);
+   }
+
+   /// \return The IDs of the active entities.
+   llvm::ArrayRef<EntityID> getActiveIDs() const
+   {
+      return llvm::ArrayRef<EntityID>(ids.data(), numActive);
+   }
+
+   /// \return The spatial grid of all entities.
+   const EntityGrid &getGrid() const { return grid; }
+
+   /// \return The entity object of an entity.
+   Entity *getOwner(EntityID id) const { return owners[slots[id]]; }
+
+   /// \return The flags of an entity.
+   uint8_t getFlags(EntityID id) const { return flags[slots[id]]; }
+
+   /// \return The position of an entity.
+   ScenePosition &getPosition(EntityID id) { return positions[slots[id]]; }
+
+   /// \return The velocity of an entity.
+   glm::vec3 &getVelocity(EntityID id) { return velocities[slots[id]]; }
+
+   /// \return The chunk an entity is bucketed in.
+   const ChunkPosition &getChunk(EntityID id) const { return chunks[slots[id]]; }
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_ENTITYSTORE_H
@@ -9,13 +9,6 @@ class Player;
 class WorldGenerator;
 
 struct GameSave {
-private:
-private:
-   GameSave(World &&world,
-            WorldGenerator *worldGenerator,
-            Player *player);
-
-public:
    GameSave(Application &app, WorldGenOptions options);
 
    /// The overworld.
@@ -0,0 +1,72 @@
+#ifndef MINESHAFT_INSTANCEDRENDERER_H
+#define MINESHAFT_INSTANCEDRENDERER_H
+
+#include "mineshaft/Model/Model.h"
+
+#include <llvm/ADT/DenseMap.h>
+
+#include <vector>
+
+namespace mc {
+
+/// Collects the model matrices of everything that uses the same model, and
+/// draws each mesh of the model once for all of them. The matrices are
+/// streamed into a ring of buffer regions, so that a frame never writes to a
+/// region the GPU may still be reading from.
+class InstancedRenderer {
+   /// The number of frames the GPU may lag behind.
+   static constexpr unsigned NumRegions = 3;
+
+   /// The buffer containing the instance matrices of all regions.
+   GLuint instanceBuffer = 0;
+
+   /// The number of matrices each region has room for.
+   unsigned regionCapacity = 0;
+
+   /// The region that is written to next.
+   unsigned currentRegion = 0;
+
+   /// The instance matrices of every model, in the order the models were
+   /// first added.
+   llvm::DenseMap<const Model*, unsigned> batchIndices;
+   std::vector<std::pair<const Model*, std::vector<glm::mat4>>> batches;
+
+   /// The total number of instances added since the last flush.
+   unsigned numInstances = 0;
+
+   /// Make sure the regions have room for the added instances.
+   void reserveInstances();
+
+   /// Point the instance matrix attributes of the bound VAO to an offset
+   /// into the instance buffer.
+   static void setInstanceAttributes(size_t offset);
+
+   /// Disable the instance matrix attributes of the bound VAO again.
+   static void resetInstanceAttributes();
+
+public:
+   /// C'tor. Buffers are only created on the first flush.
+   InstancedRenderer() = default;
+
+   /// D'tor.
+   ~InstancedRenderer();
+
+   InstancedRenderer(const InstancedRenderer&) = delete;
+   InstancedRenderer &operator=(const InstancedRenderer&) = delete;
+
+   /// Delete the instance buffer. Must be called before the GL context is
+   /// destroyed.
+   void clear();
+
+   /// Add an instance of a model.
+   void addInstance(const Model *model, const glm::mat4 &modelMatrix);
+
+   /// Draw all added instances, one draw call per mesh, and clear them.
+   /// \p shader must read the model matrix from attribute locations 3-6 and
+   /// the view-projection matrix from the frame data.
+   void flush(const Shader &shader);
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_INSTANCEDRENDERER_H
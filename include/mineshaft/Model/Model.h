@@ -5,6 +5,7 @@
 #include "mineshaft/Shader/Shader.h"
 #include "mineshaft/utils.h"
 
+#include <glm/gtc/type_precision.hpp>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/Optional.h>
 #include <llvm/Support/raw_ostream.h>
@@ -16,6 +17,7 @@ class aiMesh;
 namespace mc {
 
 class Block;
+class JobSystem;
 class TextureAtlas;
 
 struct BoundingBox {
@@ -95,6 +97,10 @@ struct Vertex {
    glm::vec2 Texture;
    glm::vec3 Normal;
 
+   /// The sky light, block light and ambient occlusion at this vertex,
+   /// normalized to bytes between 0 and 255.
+   glm::u8vec4 Light = glm::u8vec4(255, 0, 255, 255);
+
    Vertex(glm::vec3 Position,
           glm::vec2 Texture,
           glm::vec3 Normal)
@@ -104,7 +110,7 @@ struct Vertex {
    Vertex() = default;
 };
 
-struct ChunkMesh;
+struct ChunkSectionMesh;
 
 struct Mesh {
    std::vector<Vertex> Vertices;
@@ -120,10 +126,20 @@ struct Mesh {
    /// The EBO for this mesh.
    GLuint EBO = 0;
 
+   /// The number of vertices the VBO has room for.
+   unsigned VertexCapacity = 0;
+
+   /// The number of indices the EBO has room for.
+   unsigned IndexCapacity = 0;
+
 protected:
    /// Initialize the mesh.
    void initializeMesh();
 
+   /// Upload the vertices and indices to the existing buffers, growing them
+   /// if necessary. Initializes the mesh if it wasn't already.
+   void updateMesh();
+
 public:
    /// Memberwise C'tor.
    Mesh(std::vector<Vertex> &&Vertices,
@@ -142,7 +158,8 @@ public:
    /// Default C'tor.
    Mesh() = default;
 
-   friend ChunkMesh;
+   friend ChunkSectionMesh;
+   friend class TextRenderer;
 
    /// Create a triangle mesh.
    static Mesh createTriangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
@@ -175,6 +192,13 @@ public:
                glm::mat4 viewProjectionMatrix,
                glm::mat4 modelMatrix = glm::mat4(1.0f)) const;
 
+   /// Render this mesh in world space, using a shader that reads the
+   /// view-projection matrix from the frame data.
+   void render(const Shader &shader) const;
+
+   /// Draw the bound mesh.
+   void draw() const;
+
    /// Bind this meshes textures and VAO.
    void bind(const Shader &shader) const;
 
@@ -183,21 +207,47 @@ public:
    void dump() const;
 };
 
-struct ChunkMesh {
-   /// The mesh containg the water in the chunk.
+struct ChunkSectionMesh {
+   /// The mesh containg the water in the section.
    mutable Mesh terrainMesh;
 
    /// The mesh containg translucent blocks.
    mutable Mesh translucentMesh;
 
-   /// The mesh containg the water in the chunk.
+   /// The mesh containg the water in the section.
    mutable Mesh waterMesh;
 
+   /// True if the meshes were modified since they were last uploaded.
+   mutable bool needsUpload = false;
+
    /// Default C'tor, initializes an empty mesh.
-   ChunkMesh() = default;
+   ChunkSectionMesh() = default;
+
+   /// The corners of every face, in the order their vertices are added by
+   /// addFace(). A coordinate of 1 is on the maximum side of the block.
+   static const int FaceCorners[6][4][3];
 
-   /// Add a cube face to this chunk mesh.
-   void addFace(Application &C, const Block &block, unsigned faceMask);
+   /// Add the faces of a block to this section mesh. \p vertexLight contains
+   /// the light and ambient occlusion at each corner of each face.
+   void addFace(Application &C, const Block &block, unsigned faceMask,
+                const glm::u8vec4 (&vertexLight)[6][4]);
+
+   /// Remove all faces, but keep the GPU buffers around for reuse.
+   void clear();
+
+   /// Upload the section mesh if it was modified.
+   void finalize() const;
+};
+
+struct ChunkMesh {
+   /// The number of sections in a chunk mesh.
+   static constexpr unsigned NumSections = MC_CHUNK_HEIGHT / MC_CHUNK_SEGMENT_HEIGHT;
+
+   /// The meshes of the individual chunk sections, from bottom to top.
+   ChunkSectionMesh sections[NumSections];
+
+   /// Default C'tor, initializes an empty mesh.
+   ChunkMesh() = default;
 
    /// Finalize the chunk mesh.
    void finalize() const;
@@ -205,6 +255,27 @@ struct ChunkMesh {
 
 class Application;
 
+/// The CPU side data of a model, which can be created and (de)serialized
+/// without a GL context.
+struct ModelData {
+   /// A texture file referenced by a mesh.
+   struct TextureRef {
+      BasicTexture::Kind Kind;
+      float Shininess;
+      std::string File;
+   };
+
+   /// The data of a single mesh.
+   struct MeshData {
+      std::vector<Vertex> Vertices;
+      std::vector<unsigned> Indices;
+      std::vector<TextureRef> Textures;
+   };
+
+   /// The meshes of the model.
+   std::vector<MeshData> Meshes;
+};
+
 class Model {
    /// Number of meshes in this model.
    unsigned NumMeshes : 24;
@@ -223,6 +294,9 @@ class Model {
    };
 
 public:
+   /// Construct an empty model, e.g. for a model that is still loading.
+   Model();
+
    /// Construct from an array of meshes.
    explicit Model(llvm::MutableArrayRef<Mesh> Meshes);
 
@@ -240,6 +314,17 @@ public:
    static llvm::Optional<Model> loadFromFile(Application &Ctx,
                                              llvm::StringRef FileName);
 
+   /// Import a model file into mesh data. Wavefront .obj files are read by
+   /// the OBJ parser, everything else by assimp. Does not touch any GL state,
+   /// so it can be called from any thread. Large .obj files are parsed in
+   /// parallel on \p Jobs, if given.
+   /// \return false if the file can't be imported.
+   static bool importFile(llvm::StringRef FileName, ModelData &Data,
+                          JobSystem *Jobs = nullptr);
+
+   /// Create a model from its mesh data. Must be called on the main thread.
+   static llvm::Optional<Model> fromData(Application &Ctx, ModelData &&Data);
+
    /// Render the model using a shader.
    void render(const Shader &shader,
                glm::mat4 modelMatrix,
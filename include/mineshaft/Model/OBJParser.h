@@ -0,0 +1,23 @@
+#ifndef MINESHAFT_OBJPARSER_H
+#define MINESHAFT_OBJPARSER_H
+
+#include <llvm/ADT/StringRef.h>
+
+namespace mc {
+
+class JobSystem;
+struct ModelData;
+
+/// Parse a Wavefront .obj file and its material libraries into mesh data,
+/// one mesh per material. The file is memory mapped and parsed without
+/// allocating per token; large files are split into line-aligned chunks that
+/// are parsed as jobs on \p Jobs, if given, and merged afterwards. Does not
+/// touch any GL state, so it can be called from any thread, including from
+/// a job.
+/// \return false if the file can't be read or is malformed.
+bool parseOBJFile(llvm::StringRef FileName, ModelData &Data,
+                  JobSystem *Jobs = nullptr);
+
+} // namespace mc
+
+#endif //MINESHAFT_OBJPARSER_H
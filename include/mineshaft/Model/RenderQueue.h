@@ -0,0 +1,57 @@
+#ifndef MINESHAFT_RENDERQUEUE_H
+#define MINESHAFT_RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace mc {
+
+class Shader;
+struct Mesh;
+
+/// Collects mesh draws and executes them sorted by pass, shader, texture and
+/// vertex array, so that consecutive draws share as many bindings as
+/// possible. Queued meshes are drawn with Mesh::render(const Shader&), i.e.
+/// their shaders read the view-projection matrix from the frame data.
+class RenderQueue {
+public:
+   /// The passes of a frame, in the order they are executed.
+   enum Pass : uint8_t {
+      /// Opaque geometry, which may be drawn in any order.
+      Opaque = 0,
+
+      /// Blended geometry, which is drawn in the order it was submitted.
+      Blended,
+   };
+
+private:
+   /// A queued draw.
+   struct Command {
+      /// The sort key of the draw.
+      uint64_t key;
+
+      /// The mesh to draw.
+      const Mesh *mesh;
+
+      /// The shader to draw the mesh with.
+      const Shader *shader;
+   };
+
+   /// The queued draws.
+   std::vector<Command> commands;
+
+public:
+   /// Queue the draw of a mesh.
+   void submit(Pass pass, const Mesh &mesh, const Shader &shader);
+
+   /// Execute and clear the queued draws.
+   void execute();
+
+   /// Execute and clear the queued draws of a single pass, e.g. to measure
+   /// the passes separately.
+   void execute(Pass pass);
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_RENDERQUEUE_H
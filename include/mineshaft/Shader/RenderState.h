@@ -0,0 +1,46 @@
+#ifndef MINESHAFT_RENDERSTATE_H
+#define MINESHAFT_RENDERSTATE_H
+
+#include <GL/glew.h>
+
+namespace mc {
+
+/// Tracks the GL bindings that change most often between draws, and skips
+/// the calls that wouldn't change anything. All program, vertex array and
+/// texture binds have to go through this class, otherwise the tracked state
+/// gets out of sync with the context. Must only be used on the thread that
+/// owns the GL context.
+class RenderState {
+public:
+   /// The number of texture units whose bindings are tracked. Binds to other
+   /// units are always forwarded.
+   static constexpr unsigned NumTrackedUnits = 16;
+
+   /// Bind a shader program.
+   static void useProgram(GLuint program);
+
+   /// Bind a vertex array object.
+   static void bindVertexArray(GLuint vertexArray);
+
+   /// Select the active texture unit.
+   static void activeTexture(GLenum unit);
+
+   /// Bind a texture to the active texture unit.
+   static void bindTexture(GLenum target, GLuint texture);
+
+   /// Forget a program that is about to be deleted.
+   static void forgetProgram(GLuint program);
+
+   /// Forget a vertex array that is about to be deleted.
+   static void forgetVertexArray(GLuint vertexArray);
+
+   /// Forget a texture that is about to be deleted.
+   static void forgetTexture(GLuint texture);
+
+   /// Forget all tracked state, e.g. after foreign code changed the context.
+   static void invalidate();
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_RENDERSTATE_H
@@ -3,18 +3,106 @@
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
 
 namespace mc {
 
 class Application;
 
+/// The name of a uniform, identified by its hash. Names that are string
+/// literals are hashed at compile time.
+class UniformName {
+   /// The FNV-1a hash of the name.
+   uint32_t Hash;
+
+   /// \return The FNV-1a hash of a string.
+   static constexpr uint32_t hashString(const char *Str, size_t Len)
+   {
+      uint32_t Hash = 2166136261u;
+      for (size_t i = 0; i < Len; ++i) {
+         Hash = (Hash ^ (uint8_t)Str[i]) * 16777619u;
+      }
+
+      return Hash;
+   }
+
+   /// Construct from a hash.
+   constexpr explicit UniformName(uint32_t Hash, bool)
+      : Hash(Hash)
+   { }
+
+public:
+   /// Construct from a string literal.
+   template<size_t N>
+   constexpr UniformName(const char (&Name)[N])
+      : Hash(hashString(Name, N - 1))
+   { }
+
+   /// Construct from a name that is only known at runtime.
+   static UniformName get(llvm::StringRef Name)
+   {
+      return UniformName(hashString(Name.data(), Name.size()), true);
+   }
+
+   /// \return The hash of the name.
+   constexpr uint32_t getHash() const { return Hash; }
+};
+
+/// Values that stay the same for all draws within a frame. Shaders access
+/// them through the std140 uniform block 'FrameData'.
+struct FrameData {
+   glm::mat4 viewProjectionMatrix;
+   glm::vec4 cameraPosition;
+   float globalTime = 0.0f;
+   float daylight = 1.0f;
+   float padding[2] = { 0.0f, 0.0f };
+};
+
+/// The uniform buffer holding the FrameData of the current frame. It is
+/// bound to a fixed binding point that every shader's FrameData block is
+/// connected to, so it only needs to be updated once per frame.
+class FrameUniformBuffer {
+   /// The uniform buffer.
+   GLuint BufferID = 0;
+
+public:
+   /// The binding point of the FrameData block.
+   static constexpr GLuint BindingPoint = 0;
+
+   /// C'tor. The buffer is created on the first update.
+   FrameUniformBuffer() = default;
+
+   /// D'tor.
+   ~FrameUniformBuffer();
+
+   FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+   FrameUniformBuffer &operator=(const FrameUniformBuffer&) = delete;
+
+   /// Delete the uniform buffer. Must be called before the GL context is
+   /// destroyed.
+   void clear();
+
+   /// Upload the data of the current frame.
+   void update(const FrameData &Data);
+};
+
 class Shader {
    /// Program ID of this shader.
    unsigned ProgramID = 0;
 
-   /// Private C'tor.
+   /// The locations of the active uniforms, by name hash. Shaders only have
+   /// a handful of uniforms, so a linear search beats any map.
+   llvm::SmallVector<std::pair<uint32_t, GLint>, 8> UniformLocations;
+
+   /// Private C'tor. Reflects the active uniforms of a linked program.
    explicit Shader(unsigned ProgramID);
 
+   /// Query the active uniforms and connect the FrameData block.
+   void reflectUniforms();
+
    friend class Application;
 
 public:
@@ -31,26 +119,29 @@ public:
    /// Use this shader.
    void useShader() const;
 
-   /// \return a uniform location.
-   GLint getUniformLocation(const char *Name) const;
+   /// \return The program ID of this shader.
+   unsigned getProgramID() const { return ProgramID; }
+
+   /// \return a uniform location, or -1 if the uniform is not active.
+   GLint getUniformLocation(UniformName Name) const;
 
    /// Setters for uniform int values.
-   void setUniform(const char *Name, GLint Val) const;
+   void setUniform(UniformName Name, GLint Val) const;
 
    /// Setters for uniform uint values.
-   void setUniform(const char *Name, GLuint Val) const;
+   void setUniform(UniformName Name, GLuint Val) const;
 
    /// Setters for uniform float values.
-   void setUniform(const char *Name, float Val) const;
+   void setUniform(UniformName Name, float Val) const;
 
    /// Setters for uniform vec3 values.
-   void setUniform(const char *Name, glm::vec3 Val) const;
+   void setUniform(UniformName Name, glm::vec3 Val) const;
 
    /// Setters for uniform vec4 values.
-   void setUniform(const char *Name, glm::vec4 Val) const;
+   void setUniform(UniformName Name, glm::vec4 Val) const;
 
    /// Setters for uniform mat4 values.
-   void setUniform(const char *Name, glm::mat4 Val) const;
+   void setUniform(UniformName Name, glm::mat4 Val) const;
 
    /// Setters for uniform int values.
    void setUniform(GLint Location, GLint Val) const;
@@ -0,0 +1,77 @@
+#ifndef MINESHAFT_ASSETCACHE_H
+#define MINESHAFT_ASSETCACHE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sf {
+class Image;
+} // namespace sf
+
+namespace mc {
+
+struct ModelData;
+
+/// GPU-ready texture data with its full mip chain.
+struct TextureData {
+   /// The size of the largest mip level.
+   uint32_t width = 0;
+   uint32_t height = 0;
+
+   /// The mip levels from the largest to the smallest, as tightly packed
+   /// RGBA8 pixels.
+   llvm::SmallVector<llvm::ArrayRef<uint8_t>, 12> levels;
+
+   /// Owns the pixels of decoded textures.
+   std::vector<uint8_t> pixels;
+
+   /// Owns the pixels of textures mapped from the cache.
+   std::unique_ptr<llvm::MemoryBuffer> mapping;
+
+   /// Build the mip chain of an image by box filtering.
+   void buildFromImage(const sf::Image &image);
+
+   /// \return The total size of all mip levels in bytes.
+   size_t getTotalSize() const;
+};
+
+/// A versioned binary cache of processed assets. Every source file gets one
+/// cache file, which stores the size and modification time of the source so
+/// that stale entries are ignored. Cache files are memory mapped, so loading
+/// a cached asset costs little more than mapping the file.
+///
+/// All functions are thread-safe as long as no two threads access the same
+/// asset.
+class AssetCache {
+public:
+   /// Bump this whenever the layout of a cache file or of a Vertex changes.
+   static constexpr uint32_t Version = 1;
+
+   /// \return The path of the cache file for a source file.
+   static std::string getCachePath(llvm::StringRef sourcePath);
+
+   /// Load a cached texture.
+   /// \return false if there is no up-to-date cache entry.
+   static bool loadTexture(llvm::StringRef sourcePath, TextureData &data);
+
+   /// Store a texture in the cache.
+   static void storeTexture(llvm::StringRef sourcePath,
+                            const TextureData &data);
+
+   /// Load a cached model.
+   /// \return false if there is no up-to-date cache entry.
+   static bool loadModel(llvm::StringRef sourcePath, ModelData &data);
+
+   /// Store a model in the cache.
+   static void storeModel(llvm::StringRef sourcePath, const ModelData &data);
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_ASSETCACHE_H
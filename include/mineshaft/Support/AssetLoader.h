@@ -0,0 +1,102 @@
+#ifndef MINESHAFT_ASSETLOADER_H
+#define MINESHAFT_ASSETLOADER_H
+
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/Texture/BasicTexture.h"
+
+#include <llvm/ADT/StringRef.h>
+
+#include <mutex>
+#include <vector>
+
+namespace mc {
+
+class Application;
+class Model;
+
+/// Decodes textures and imports models on the job system, going through the
+/// AssetCache if possible. Requests return immediately with a handle that
+/// renders as a placeholder until the asset is ready. Finished assets are
+/// uploaded to the GPU by update(), a few per frame, so that loading never
+/// stalls a frame.
+class AssetLoader {
+   /// A texture that is being loaded.
+   struct TextureRequest;
+
+   /// A model that is being loaded.
+   struct ModelRequest;
+
+   /// The maximum number of textures uploaded per frame.
+   static constexpr unsigned MaxTextureUploadsPerFrame = 4;
+
+   /// The maximum number of models created per frame.
+   static constexpr unsigned MaxModelsPerFrame = 1;
+
+   /// The application context.
+   Application &app;
+
+   /// Counts the requests that are still being decoded.
+   JobCounter pendingRequests;
+
+   /// The texture used by textures that are not loaded (yet).
+   GLuint placeholderTexture = 0;
+
+   /// The pixel buffer used to stream texture data to the GPU.
+   GLuint uploadBuffer = 0;
+
+   /// Protects the finished requests.
+   std::mutex finishedMutex;
+
+   /// Textures that were decoded and wait for their upload.
+   std::vector<TextureRequest*> finishedTextures;
+
+   /// Models that were imported and wait for their meshes to be created.
+   std::vector<ModelRequest*> finishedModels;
+
+   /// Decode a texture. Runs on a worker thread.
+   static void decodeTexture(TextureRequest *request);
+
+   /// Import a model. Runs on a worker thread.
+   static void importModel(ModelRequest *request);
+
+   /// Upload a decoded texture through the pixel buffer.
+   void uploadTexture(TextureRequest &request);
+
+   /// Create the meshes of an imported model.
+   void finishModel(ModelRequest &request);
+
+public:
+   /// C'tor.
+   explicit AssetLoader(Application &app);
+
+   /// D'tor. Waits for running requests.
+   ~AssetLoader();
+
+   AssetLoader(const AssetLoader&) = delete;
+   AssetLoader &operator=(const AssetLoader&) = delete;
+
+   /// \return The ID of the placeholder texture.
+   GLuint getPlaceholderTexture();
+
+   /// Start loading a texture file into \p texture, which must have been
+   /// created with the placeholder texture.
+   void loadTexture(BasicTexture *texture, llvm::StringRef path);
+
+   /// Start loading a model file into \p model, which should be empty.
+   void loadModel(Model *model, llvm::StringRef path);
+
+   /// Upload the assets that finished loading. Must be called once per frame
+   /// on the main thread.
+   void update();
+
+   /// Delete the upload buffer and the placeholder texture. Must be called
+   /// before the GL context is destroyed.
+   void clear();
+
+   /// \return The number of requests that are still being decoded.
+   unsigned getNumPendingRequests() const { return pendingRequests.getCount(); }
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_ASSETLOADER_H
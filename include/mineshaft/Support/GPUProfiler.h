@@ -0,0 +1,152 @@
+#ifndef MINESHAFT_GPUPROFILER_H
+#define MINESHAFT_GPUPROFILER_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace mc {
+
+/// The render passes whose GPU time is measured.
+enum class GPUPass : uint8_t {
+   /// The far terrain behind the loaded chunks.
+   FarTerrain = 0,
+
+   /// The opaque faces of the loaded chunks.
+   OpaqueTerrain,
+
+   /// The translucent faces and the water of the loaded chunks. They are
+   /// blended in one pass, since they have to be drawn in order.
+   Translucent,
+
+   /// The entity models.
+   Entities,
+
+   /// The border around the focused block.
+   Borders,
+
+   /// The crosshair, the coordinate axes and the text.
+   UI,
+
+   /// The number of passes.
+   NumPasses,
+};
+
+/// Measures the GPU time of the render passes with GL_TIME_ELAPSED queries.
+/// The queries of a frame are read back a few frames later, when their
+/// results are available, so measuring never stalls the pipeline. Only one
+/// pass can be measured at a time, nested passes are not measured.
+class GPUProfiler {
+public:
+   /// The number of frames until the queries of a frame are read back.
+   static constexpr unsigned Latency = 4;
+
+   /// The number of passes.
+   static constexpr unsigned NumPasses = (unsigned)GPUPass::NumPasses;
+
+private:
+   /// The queries issued in a single frame.
+   struct FrameQueries {
+      /// The query objects, reused across frames.
+      std::vector<GLuint> queries;
+
+      /// The pass of each used query.
+      std::vector<GPUPass> passes;
+
+      /// The CPU time at which each pass began, for the profiler.
+      std::vector<uint64_t> cpuBegin;
+
+      /// The number of queries used in the frame.
+      unsigned numUsed = 0;
+   };
+
+   /// The queries of the frames in flight.
+   FrameQueries frames[Latency];
+
+   /// The index of the current frame in the frames array.
+   unsigned currentFrame = 0;
+
+   /// The latest GPU time of each pass in nanoseconds.
+   uint64_t passTimes[NumPasses] = {};
+
+   /// The number of frames whose results were not available in time.
+   uint64_t numMissedFrames = 0;
+
+   /// True while a pass is being measured.
+   bool measuring = false;
+
+   /// True if the GL context supports timer queries.
+   bool supported = false;
+
+   /// True once support was checked.
+   bool initialized = false;
+
+   /// Read back the results of a frame, if they are available.
+   void readResults(FrameQueries &frame);
+
+public:
+   GPUProfiler() = default;
+   GPUProfiler(const GPUProfiler&) = delete;
+   GPUProfiler &operator=(const GPUProfiler&) = delete;
+
+   /// Read back the frame that was issued Latency frames ago and start
+   /// recording a new one. Must be called once per frame with a current GL
+   /// context.
+   void beginFrame();
+
+   /// Start measuring \p pass.
+   /// \return false if the pass is not measured, e.g. because another pass
+   /// is measured already.
+   bool beginPass(GPUPass pass);
+
+   /// Stop measuring the current pass.
+   void endPass();
+
+   /// Delete the query objects. Must be called before the GL context is
+   /// destroyed.
+   void clear();
+
+   /// \return The latest GPU time of \p pass in nanoseconds.
+   uint64_t getPassTime(GPUPass pass) const
+   {
+      return passTimes[(unsigned)pass];
+   }
+
+   /// \return The latest GPU time of all passes in nanoseconds.
+   uint64_t getTotalTime() const;
+
+   /// \return The number of frames whose results were not available in time.
+   uint64_t getNumMissedFrames() const { return numMissedFrames; }
+
+   /// \return true if timer queries are supported.
+   bool isSupported() const { return supported; }
+
+   /// \return The name of \p pass.
+   static const char *getPassName(GPUPass pass);
+};
+
+/// Measures a pass from its construction to the end of the scope.
+class GPUScope {
+   /// The profiler, or nullptr if the pass is not measured.
+   GPUProfiler *profiler;
+
+public:
+   GPUScope(GPUProfiler &profiler, GPUPass pass)
+      : profiler(profiler.beginPass(pass) ? &profiler : nullptr)
+   {}
+
+   ~GPUScope()
+   {
+      if (profiler) {
+         profiler->endPass();
+      }
+   }
+
+   GPUScope(const GPUScope&) = delete;
+   GPUScope &operator=(const GPUScope&) = delete;
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_GPUPROFILER_H
@@ -0,0 +1,208 @@
+#ifndef MINESHAFT_JOBSYSTEM_H
+#define MINESHAFT_JOBSYSTEM_H
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mc {
+
+class JobSystem;
+
+/// The priority of a job. Workers always run the most urgent job they can
+/// find, from their own queue or stolen from another worker.
+enum class JobPriority : uint8_t {
+   /// Work the player is waiting for, e.g. chunks right next to them.
+   High = 0,
+
+   /// The default priority.
+   Normal,
+
+   /// Work that can wait, e.g. distant terrain.
+   Low,
+};
+
+/// Counts unfinished jobs. Jobs can signal a counter when they finish, and
+/// other jobs can be made to wait for a counter to reach zero.
+class JobCounter {
+   friend class JobSystem;
+
+   struct Job;
+
+   /// The number of unfinished jobs.
+   std::atomic<unsigned> count{ 0 };
+
+   /// Protects the waiting jobs and the transition to zero.
+   mutable std::mutex mutex;
+
+   /// The jobs that are scheduled once the count reaches zero.
+   std::vector<Job*> waiters;
+
+public:
+   JobCounter() = default;
+   JobCounter(const JobCounter&) = delete;
+   JobCounter &operator=(const JobCounter&) = delete;
+
+   /// \return true iff all jobs signaling this counter finished.
+   bool isDone() const;
+
+   /// \return The number of unfinished jobs.
+   unsigned getCount() const { return count.load(std::memory_order_relaxed); }
+};
+
+/// Options for submitting a job.
+struct JobOptions {
+   /// The priority of the job.
+   JobPriority priority;
+
+   /// Incremented on submission and decremented once the job finished.
+   JobCounter *counter;
+
+   /// The job only starts once this counter reaches zero.
+   JobCounter *dependency;
+
+   /// If this flag is set before the job starts, the job is skipped. Its
+   /// counter is still signaled.
+   const std::atomic<bool> *cancelled;
+
+   JobOptions(JobPriority priority = JobPriority::Normal,
+              JobCounter *counter = nullptr,
+              JobCounter *dependency = nullptr,
+              const std::atomic<bool> *cancelled = nullptr)
+      : priority(priority), counter(counter), dependency(dependency),
+        cancelled(cancelled)
+   {}
+};
+
+/// A pool of worker threads, one per core, that share work through
+/// lock-free work-stealing deques. Jobs submitted from a worker go to its own
+/// deque, jobs submitted from other threads to a shared injection queue.
+/// Idle workers steal from the others, most urgent priority first.
+class JobSystem {
+public:
+   using JobFn = void(*)(void*);
+
+private:
+   using Job = JobCounter::Job;
+
+   /// The number of job priorities.
+   static constexpr unsigned NumPriorities = 3;
+
+   /// A bounded single-producer, multi-consumer deque. The owning worker
+   /// pushes and pops at the bottom, thieves steal from the top.
+   class WorkStealingDeque {
+      static constexpr int64_t Capacity = 1024;
+
+      std::atomic<int64_t> top{ 0 };
+      std::atomic<int64_t> bottom{ 0 };
+      std::atomic<Job*> buffer[Capacity];
+
+   public:
+      /// Push a job. Must only be called by the owner.
+      /// \return false if the deque is full.
+      bool push(Job *job);
+
+      /// Pop the most recently pushed job. Must only be called by the owner.
+      Job *pop();
+
+      /// Steal the least recently pushed job. Can be called by any thread.
+      Job *steal();
+   };
+
+   /// The state of a worker thread.
+   struct Worker {
+      /// The deques of this worker, one per priority.
+      WorkStealingDeque queues[NumPriorities];
+
+      /// The thread of this worker.
+      std::thread thread;
+   };
+
+   /// The worker threads.
+   std::vector<std::unique_ptr<Worker>> workers;
+
+   /// Protects the injection queues.
+   std::mutex injectionMutex;
+
+   /// Jobs submitted from outside of the workers, one queue per priority.
+   std::deque<Job*> injectionQueues[NumPriorities];
+
+   /// The number of jobs in the injection queues.
+   std::atomic<unsigned> numInjected{ 0 };
+
+   /// The number of jobs that are queued and not yet picked up.
+   std::atomic<unsigned> numQueued{ 0 };
+
+   /// The number of workers waiting for work.
+   std::atomic<unsigned> numSleeping{ 0 };
+
+   /// Protects going to sleep.
+   std::mutex sleepMutex;
+
+   /// Wakes sleeping workers.
+   std::condition_variable sleepCondition;
+
+   /// Set when the workers should exit once all work is done.
+   std::atomic<bool> stopping{ false };
+
+   /// Set once the worker threads exited. Protected by the injection mutex.
+   bool workersStopped = false;
+
+   /// \return The index of the calling worker of this system, or -1.
+   int getCurrentWorker() const;
+
+   /// Queue a job that has no pending dependency.
+   void schedule(Job *job);
+
+   /// Find the most urgent job the calling thread can run.
+   Job *findJob(int self);
+
+   /// Run a job and signal its counter.
+   void execute(Job *job);
+
+   /// The main loop of a worker thread.
+   void workerLoop(unsigned index);
+
+   /// Submit a type-erased job.
+   void submitImpl(JobFn fn, void *arg, const JobOptions &options);
+
+public:
+   /// C'tor. Starts \p numThreads worker threads, or one per core except
+   /// for the calling one if zero.
+   explicit JobSystem(unsigned numThreads = 0);
+
+   /// D'tor. Finishes all submitted jobs.
+   ~JobSystem();
+
+   JobSystem(const JobSystem&) = delete;
+   JobSystem &operator=(const JobSystem&) = delete;
+
+   /// Submit a job that calls \p Fn with \p arg.
+   template<auto Fn, class T>
+   void submit(T *arg, const JobOptions &options = JobOptions())
+   {
+      submitImpl([](void *ptr) { Fn(static_cast<T*>(ptr)); }, arg, options);
+   }
+
+   /// Run jobs on the calling thread until \p counter reaches zero.
+   void wait(JobCounter &counter);
+
+   /// Finish all submitted jobs and stop the worker threads. Jobs submitted
+   /// afterwards run immediately on the submitting thread.
+   void stop();
+
+   /// \return The number of worker threads.
+   unsigned getNumThreads() const { return (unsigned)workers.size(); }
+
+   /// \return The number of jobs that are queued and not yet picked up.
+   unsigned getNumQueued() const { return numQueued.load(std::memory_order_relaxed); }
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_JOBSYSTEM_H
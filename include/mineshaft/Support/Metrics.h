@@ -0,0 +1,141 @@
+#ifndef MINESHAFT_METRICS_H
+#define MINESHAFT_METRICS_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <cstdint>
+
+/// Set to 1 to also count the events of the hottest paths, e.g. every block
+/// lookup. These counters cost an atomic increment per event, so they are
+/// compiled out by default.
+#ifndef MC_ENABLE_HOT_METRICS
+#define MC_ENABLE_HOT_METRICS 0
+#endif
+
+namespace mc {
+
+/// A count that only goes up, e.g. of generated chunks. Increments from
+/// different threads go to different cache lines, so that counting in hot
+/// paths does not make the threads contend.
+class MetricCounter {
+   /// The number of separately counted shards.
+   static constexpr unsigned NumShards = 8;
+
+   /// A part of the count on its own cache line.
+   struct alignas(64) Shard {
+      std::atomic<uint64_t> value{ 0 };
+   };
+
+   /// The shards of the count.
+   Shard shards[NumShards];
+
+   /// \return The shard of the calling thread.
+   static unsigned getShardIndex();
+
+public:
+   /// Increment the count by \p n.
+   void add(uint64_t n = 1)
+   {
+      shards[getShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+   }
+
+   /// \return The current count.
+   uint64_t getValue() const;
+};
+
+/// A value that goes up and down, e.g. the length of a queue.
+class MetricGauge {
+   /// The current value.
+   std::atomic<int64_t> value{ 0 };
+
+public:
+   /// Set the value.
+   void set(int64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+
+   /// Add \p delta to the value.
+   void add(int64_t delta) { value.fetch_add(delta, std::memory_order_relaxed); }
+
+   /// \return The current value.
+   int64_t getValue() const { return value.load(std::memory_order_relaxed); }
+};
+
+/// The distribution of a value, e.g. a duration, in buckets whose bounds are
+/// powers of two.
+class MetricHistogram {
+public:
+   /// The number of buckets. Bucket i counts the values below 2^i that don't
+   /// fit into a lower bucket, the last one all larger values.
+   static constexpr unsigned NumBuckets = 32;
+
+private:
+   /// The number of values in each bucket.
+   std::atomic<uint64_t> buckets[NumBuckets] = {};
+
+   /// The number of recorded values.
+   std::atomic<uint64_t> count{ 0 };
+
+   /// The sum of the recorded values.
+   std::atomic<uint64_t> sum{ 0 };
+
+   /// The largest recorded value.
+   std::atomic<uint64_t> max{ 0 };
+
+public:
+   /// Record a value.
+   void record(uint64_t value);
+
+   /// \return The number of recorded values.
+   uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+
+   /// \return The mean of the recorded values.
+   double getMean() const;
+
+   /// \return The largest recorded value.
+   uint64_t getMax() const { return max.load(std::memory_order_relaxed); }
+
+   /// \return An upper bound of the \p percentile-th percentile of the
+   /// recorded values, with \p percentile in [0, 100].
+   uint64_t getPercentile(double percentile) const;
+};
+
+/// The registry of the engine's metrics. Metrics are created on first use
+/// and live until the program exits, so references to them can be kept in
+/// static variables:
+///
+///    static MetricCounter &numGenerated = Metrics::getCounter("chunks.generated");
+///    numGenerated.add();
+///
+/// The rates of the counters are computed by update(), which the main thread
+/// calls once per frame.
+class Metrics {
+public:
+   /// \return The counter named \p name.
+   static MetricCounter &getCounter(llvm::StringRef name);
+
+   /// \return The gauge named \p name.
+   static MetricGauge &getGauge(llvm::StringRef name);
+
+   /// \return The histogram named \p name.
+   static MetricHistogram &getHistogram(llvm::StringRef name);
+
+   /// Compute the per-frame and per-second rates of the counters, and dump
+   /// the metrics if the dump interval elapsed.
+   static void update();
+
+   /// Append the metrics to \p fileName every \p interval seconds, or stop
+   /// dumping if \p interval is zero.
+   static void setDumpInterval(float interval,
+                               llvm::StringRef fileName = "mineshaft-metrics.log");
+
+   /// \return The interval at which the metrics are dumped, or zero.
+   static float getDumpInterval();
+
+   /// Print all metrics, one per line, sorted by name.
+   static void print(llvm::raw_ostream &OS);
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_METRICS_H
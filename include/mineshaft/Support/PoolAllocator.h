@@ -0,0 +1,173 @@
+#ifndef MINESHAFT_POOLALLOCATOR_H
+#define MINESHAFT_POOLALLOCATOR_H
+
+#include <llvm/ADT/StringRef.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace mc {
+
+/// Allocation statistics of a pool.
+struct PoolStats {
+   /// The size of a single object in bytes.
+   size_t objectSize = 0;
+
+   /// The number of bytes reserved from the system.
+   size_t reservedBytes = 0;
+
+   /// The number of objects that are currently allocated.
+   size_t liveObjects = 0;
+
+   /// The highest number of objects that were allocated at the same time.
+   size_t peakLiveObjects = 0;
+
+   /// The number of allocations so far.
+   uint64_t totalAllocations = 0;
+};
+
+/// A thread safe allocator for objects of a fixed size. Memory is reserved in
+/// slabs and recycled through free lists. Every thread keeps a small cache of
+/// free objects that it allocates from and frees to without locking; batches
+/// of objects move between the caches and a shared free list when a cache
+/// runs empty or full. Slabs are only returned to the system when the pool is
+/// destroyed, so the memory of a pool is bounded by its peak usage.
+///
+/// Pools are meant to live as long as the threads that use them, e.g. as
+/// members of the Application.
+class PoolAllocator {
+   /// A free object, linked into a free list.
+   struct FreeObject {
+      FreeObject *next;
+   };
+
+   /// The free objects a thread keeps for a pool.
+   struct ThreadCache {
+      /// The ID of the pool the objects belong to, or zero if unused.
+      unsigned poolID = 0;
+
+      /// The first free object.
+      FreeObject *head = nullptr;
+
+      /// The number of free objects.
+      unsigned count = 0;
+   };
+
+   /// The number of pools a thread can cache objects for.
+   static constexpr unsigned MaxThreadCaches = 8;
+
+   /// The calling thread's caches, indexed by pool ID. Objects left in the
+   /// cache of an exiting thread are only reclaimed with their pool.
+   static thread_local ThreadCache threadCaches[MaxThreadCaches];
+
+   /// The preferred size of a slab in bytes.
+   static constexpr size_t SlabSize = 1024 * 1024;
+
+   /// The name of this pool, for diagnostics.
+   const char *name;
+
+   /// The unique ID of this pool.
+   unsigned id;
+
+   /// The size of an object, rounded up to the alignment.
+   size_t objectSize;
+
+   /// The alignment of an object.
+   size_t alignment;
+
+   /// The number of objects in a slab.
+   unsigned objectsPerSlab;
+
+   /// The number of objects moved between a thread cache and the shared
+   /// free list at once.
+   unsigned batchSize;
+
+   /// Protects the shared free list and the slabs.
+   std::mutex mutex;
+
+   /// The shared free list.
+   FreeObject *freeList = nullptr;
+
+   /// The slabs reserved so far.
+   std::vector<void*> slabs;
+
+   /// The number of objects that are currently allocated.
+   std::atomic<size_t> liveObjects{ 0 };
+
+   /// The highest number of objects that were allocated at the same time.
+   std::atomic<size_t> peakLiveObjects{ 0 };
+
+   /// The number of allocations so far.
+   std::atomic<uint64_t> totalAllocations{ 0 };
+
+   /// \return The calling thread's cache for this pool, or nullptr if the
+   /// thread has no cache slot available.
+   ThreadCache *getThreadCache();
+
+   /// Move up to a batch of objects from the shared free list into \p cache,
+   /// reserving a new slab if necessary.
+   void refill(ThreadCache &cache);
+
+   /// Move a batch of objects from \p cache to the shared free list.
+   void flush(ThreadCache &cache);
+
+   /// Reserve a new slab and add its objects to the shared free list. Must
+   /// be called with the mutex held.
+   void reserveSlab();
+
+public:
+   /// C'tor. Does not reserve any memory yet.
+   PoolAllocator(size_t objectSize, size_t alignment, const char *name);
+
+   /// D'tor. Releases all slabs, objects that are still alive must not be
+   /// used afterwards.
+   ~PoolAllocator();
+
+   PoolAllocator(const PoolAllocator&) = delete;
+   PoolAllocator &operator=(const PoolAllocator&) = delete;
+
+   /// Allocate memory for a single object.
+   void *Allocate();
+
+   /// Return memory for a single object to the pool. Can be called from
+   /// any thread, not just the one that allocated the object.
+   void Deallocate(void *ptr);
+
+   /// Allocate and construct an object.
+   template<class T, class ...Args>
+   T *create(Args &&...args)
+   {
+      assert(sizeof(T) <= objectSize && alignof(T) <= alignment
+             && "object does not fit into this pool");
+
+      return new(Allocate()) T(std::forward<Args>(args)...);
+   }
+
+   /// Destroy an object and return its memory to the pool.
+   template<class T>
+   void destroy(T *ptr)
+   {
+      if (!ptr) {
+         return;
+      }
+
+      ptr->~T();
+      Deallocate(ptr);
+   }
+
+   /// \return The name of this pool.
+   llvm::StringRef getName() const { return name; }
+
+   /// \return The allocation statistics of this pool.
+   PoolStats getStats();
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_POOLALLOCATOR_H
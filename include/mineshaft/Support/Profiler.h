@@ -0,0 +1,157 @@
+#ifndef MINESHAFT_PROFILER_H
+#define MINESHAFT_PROFILER_H
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace mc {
+
+/// A zone that was recorded by the profiler.
+struct ProfileEvent {
+   /// The name of the zone, must be a string literal.
+   const char *name;
+
+   /// The start of the zone in nanoseconds since the profiler started.
+   uint64_t begin;
+
+   /// The end of the zone in nanoseconds since the profiler started.
+   uint64_t end;
+
+   /// The number of zones this one is nested in.
+   uint32_t depth;
+};
+
+/// The accumulated time of a zone within a frame.
+struct ProfileZoneSummary {
+   /// The name of the zone.
+   const char *name;
+
+   /// The nesting depth of the zone, zero for worker jobs.
+   uint32_t depth;
+
+   /// The total time spent in the zone, in nanoseconds.
+   uint64_t time;
+
+   /// The number of times the zone was entered.
+   unsigned count;
+};
+
+/// The time spent in the zones of the last finished frame.
+struct ProfileFrameSummary {
+   /// The duration of the frame in nanoseconds.
+   uint64_t frameTime = 0;
+
+   /// The zones of the main thread, in the order they were entered, with
+   /// nested zones following their parent.
+   llvm::SmallVector<ProfileZoneSummary, 16> mainThreadZones;
+
+   /// The outermost zones of all other threads, e.g. worker jobs, that
+   /// ended within the frame.
+   llvm::SmallVector<ProfileZoneSummary, 8> backgroundZones;
+};
+
+/// A low-overhead profiler for named, nested zones. Every thread records the
+/// zones it finishes into its own ring buffer without locking, so the last
+/// few thousand zones of every thread are available for the debug overlay
+/// and for exporting to the Chrome trace format.
+class Profiler {
+public:
+   /// The number of events kept per thread.
+   static constexpr unsigned BufferSize = 1u << 14;
+
+   /// \return The current time in nanoseconds since the profiler started.
+   static uint64_t now();
+
+   /// \return true iff zones are currently recorded.
+   static bool isEnabled()
+   {
+      return enabled.load(std::memory_order_relaxed);
+   }
+
+   /// Start or stop recording zones.
+   static void setEnabled(bool enable) { enabled.store(enable); }
+
+   /// Name the calling thread in the exported traces. \p name must be a
+   /// string literal.
+   static void setThreadName(const char *name);
+
+   /// Mark the calling thread as the main thread and start a new frame.
+   static void beginFrame();
+
+   /// Record a finished zone on the calling thread.
+   static void record(const char *name, uint64_t begin, uint32_t depth);
+
+   /// Enter a zone on the calling thread.
+   /// \return The number of zones the new one is nested in.
+   static uint32_t enterZone();
+
+   /// Leave the innermost zone of the calling thread.
+   static void leaveZone();
+
+   /// Record a zone that ran on the GPU on a separate track. Must only be
+   /// called from the thread that owns the GL context.
+   static void recordGPUZone(const char *name, uint64_t begin, uint64_t end);
+
+   /// Summarize the zones of the last finished frame.
+   static void summarizeLastFrame(ProfileFrameSummary &summary);
+
+   /// Write all recorded zones in the Chrome trace event format, which can
+   /// be opened in chrome://tracing or Perfetto.
+   static void exportChromeTrace(llvm::raw_ostream &OS);
+
+   /// Export the recorded zones to \p fileName.
+   /// \return false if the file could not be written.
+   static bool exportChromeTrace(llvm::StringRef fileName);
+
+private:
+   /// Whether zones are recorded.
+   static std::atomic<bool> enabled;
+};
+
+/// Records a zone from its construction to the end of the scope.
+class ProfileScope {
+   /// The name of the zone.
+   const char *name;
+
+   /// The start of the zone, or ~0 if the profiler was disabled.
+   uint64_t begin;
+
+   /// The nesting depth of the zone.
+   uint32_t depth;
+
+public:
+   explicit ProfileScope(const char *name)
+      : name(name), begin(~uint64_t(0)), depth(0)
+   {
+      if (Profiler::isEnabled()) {
+         depth = Profiler::enterZone();
+         begin = Profiler::now();
+      }
+   }
+
+   ~ProfileScope()
+   {
+      if (begin != ~uint64_t(0)) {
+         Profiler::record(name, begin, depth);
+         Profiler::leaveZone();
+      }
+   }
+
+   ProfileScope(const ProfileScope&) = delete;
+   ProfileScope &operator=(const ProfileScope&) = delete;
+};
+
+} // namespace mc
+
+#define MC_PROFILE_CONCAT_IMPL(A, B) A##B
+#define MC_PROFILE_CONCAT(A, B) MC_PROFILE_CONCAT_IMPL(A, B)
+
+/// Profile the rest of the enclosing scope as a zone named \p NAME.
+#define MC_PROFILE_SCOPE(NAME) \
+   ::mc::ProfileScope MC_PROFILE_CONCAT(profileScope, __LINE__)(NAME)
+
+#endif //MINESHAFT_PROFILER_H
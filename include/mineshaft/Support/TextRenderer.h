@@ -4,6 +4,8 @@
 #include "mineshaft/Model/Model.h"
 #include "mineshaft/Texture/BasicTexture.h"
 
+#include <llvm/ADT/StringMap.h>
+
 #include <unordered_map>
 
 namespace mc {
@@ -40,13 +42,35 @@ private:
       unsigned xoffset;
       unsigned yoffset;
       unsigned xadvance;
+   };
+
+   /// A laid out string.
+   struct TextLayout {
+      /// The glyph quads in unscaled text space, four vertices per glyph.
+      std::vector<Vertex> vertices;
 
-      Mesh mesh;
+      /// The frame this layout was last used in.
+      unsigned lastUsedFrame = 0;
    };
 
+   /// The maximum number of laid out strings kept across frames.
+   static constexpr unsigned MaxCachedLayouts = 64;
+
    /// Stored character data.
    std::unordered_map<unsigned, CharacterData> characterData;
 
+   /// Laid out strings, keyed by their contents.
+   llvm::StringMap<TextLayout> layoutCache;
+
+   /// The glyph quads queued in the current frame, drawn at once by flush().
+   Mesh batch;
+
+   /// The number of flushed frames.
+   unsigned frameCount = 0;
+
+   /// \return The cached layout of \p text, laying it out if necessary.
+   TextLayout &getLayout(llvm::StringRef text);
+
    explicit TextRenderer(Application &Ctx);
 
    /// Private constructor.
@@ -63,16 +87,17 @@ public:
    TextRenderer(TextRenderer &&other) noexcept = default;
    TextRenderer &operator=(TextRenderer &&other) noexcept = delete;
 
-   /// Display a single character.
-   void renderCharacter(CharacterData &data, const glm::vec2 &pos,
-                        float scale = 4.0f);
-
-   /// Display text at the specified screen coordinate.
+   /// Queue text at the specified screen coordinate. The text is drawn by
+   /// the next call to flush().
    void renderText(llvm::StringRef text, const glm::vec2 &pos,
                    float scale = 4.0f);
 
    /// Display text at the specified screen coordinate.
    void renderText(llvm::StringRef text, const BoundingBox &textBox);
+
+   /// Draw all queued text in a single draw call. Must be called once per
+   /// frame.
+   void flush();
 };
 
 } // namespace mc
@@ -30,6 +30,9 @@ private:
    std::string File;
    unsigned glTextureKind;
 
+   /// True if the texture is still being loaded and uses the placeholder.
+   bool pending = false;
+
 public:
    BasicTexture();
    ~BasicTexture();
@@ -41,6 +44,7 @@ public:
    BasicTexture &operator=(const BasicTexture&) = delete;
 
    friend class Application;
+   friend class AssetLoader;
 
    void Profile(llvm::FoldingSetNodeID &ID);
    static void Profile(llvm::FoldingSetNodeID &ID, Kind K,
@@ -51,6 +55,7 @@ public:
    GLuint getTextureID() const { return textureID; }
    Kind getKind() const { return TextureKind; }
    unsigned getGLTextureKind() const { return glTextureKind; }
+   bool isPending() const { return pending; }
 
    operator bool() const { return textureID != 0; }
 };
@@ -33,10 +33,14 @@ class TextureAtlas {
    float textureHeight = 0.0f;
 
 public:
+   /// Load an atlas of textures that are \p textureWidth x \p textureHeight
+   /// pixels large. The image is only uploaded to the GPU if \p upload is
+   /// true.
    static llvm::Optional<TextureAtlas> fromFile(BasicTexture::Kind textureKind,
                                                 llvm::StringRef FileName,
                                                 float textureWidth,
-                                                float textureHeight);
+                                                float textureHeight,
+                                                bool upload = true);
 
    friend class Application;
 
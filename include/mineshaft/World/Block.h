@@ -70,6 +70,12 @@ public:
    /// \return true iff this block is solid.
    bool isSolid() const { return isSolid(blockID); }
 
+   /// \return The light level emitted by blocks of this kind.
+   static uint8_t getLightLevel(BlockID ID);
+
+   /// \return The light level emitted by this block.
+   uint8_t getLightLevel() const { return getLightLevel(blockID); }
+
    /// \return true iff this block uses different textures for each face.
    static bool usesCubeMap(BlockID ID);
 
@@ -5,6 +5,10 @@
 #include "mineshaft/Model/Model.h"
 #include "mineshaft/World/Block.h"
 
+#include <llvm/ADT/STLExtras.h>
+
+#include <atomic>
+
 namespace mc {
 
 enum class Biome : uint8_t;
@@ -15,14 +19,67 @@ class ChunkSegment {
    /// The blocks in this chunk segment.
    unsigned char blockStorage[MC_BLOCKS_PER_CHUNK_SEGMENT * sizeof(Block)];
 
+   /// The light levels of the blocks in this segment. The upper four bits
+   /// contain the sky light, the lower four bits the block light. Written
+   /// by the light engine's job while the main thread reads them.
+   std::atomic<uint8_t> lightStorage[MC_BLOCKS_PER_CHUNK_SEGMENT];
+
+   /// Bitmask of the blocks that entities collide with, indexed like the
+   /// blocks.
+   uint64_t collisionMask[MC_BLOCKS_PER_CHUNK_SEGMENT / 64];
+
    /// True if this segment contains only air.
    bool airOnly = true;
 
+   /// Update the collision bit of the block at the given index.
+   void setCollides(unsigned idx, bool collides)
+   {
+      uint64_t bit = uint64_t(1) << (idx % 64);
+      if (collides) {
+         collisionMask[idx / 64] |= bit;
+      }
+      else {
+         collisionMask[idx / 64] &= ~bit;
+      }
+   }
+
 public:
    ChunkSegment();
 
    friend class Chunk;
 
+   /// The packed light level of a block that is fully exposed to the sky.
+   static constexpr uint8_t FullSkyLight = MC_MAX_LIGHT_LEVEL << 4;
+
+   /// \return The index of a chunk-local coordinate within this segment.
+   static unsigned getIndex(const BlockPositionChunk &pos)
+   {
+      int y = (pos.y + (MC_CHUNK_HEIGHT / 2)) % MC_CHUNK_SEGMENT_HEIGHT;
+      return pos.x + MC_CHUNK_WIDTH * (y + MC_CHUNK_SEGMENT_HEIGHT * pos.z);
+   }
+
+   /// \return The packed light level at the given index.
+   uint8_t getLight(unsigned idx) const
+   {
+      return lightStorage[idx].load(std::memory_order_relaxed);
+   }
+
+   /// Set the packed light level at the given index.
+   void setLight(unsigned idx, uint8_t light)
+   {
+      lightStorage[idx].store(light, std::memory_order_relaxed);
+   }
+
+   /// \return The collision bits of a row of blocks along the x axis, where
+   /// bit i is set iff entities collide with the block at x = i.
+   uint16_t getCollisionRow(unsigned y, unsigned z) const
+   {
+      static_assert(MC_CHUNK_WIDTH == 16, "rows must fit into 16 bits");
+
+      unsigned idx = MC_CHUNK_WIDTH * (y + MC_CHUNK_SEGMENT_HEIGHT * z);
+      return (uint16_t)(collisionMask[idx / 64] >> (idx % 64));
+   }
+
    /// \return The blocks contained in this chunk segment.
    llvm::ArrayRef<Block> getBlocks() const
    {
@@ -43,6 +100,35 @@ public:
 };
 
 class Chunk {
+public:
+   /// The progress of a chunk's terrain generation. Only the thread that
+   /// moved a chunk into the Generating state may write its blocks until it
+   /// is Ready.
+   enum class GenerationState : uint8_t {
+      /// The terrain was not requested yet.
+      NotGenerated,
+
+      /// The chunk waits in the world's load queue.
+      Queued,
+
+      /// A job was submitted to generate the chunk, but did not start yet.
+      Scheduled,
+
+      /// The terrain is being generated.
+      Generating,
+
+      /// The terrain is generated and waits to be integrated on the main
+      /// thread.
+      Generated,
+
+      /// The chunk is loaded and visible to all threads.
+      Ready,
+   };
+
+private:
+   /// Bitmask containing all sections of a chunk.
+   static constexpr uint16_t AllSections = 0xFFFF;
+
    /// Reference to the world instance.
    World *world;
 
@@ -58,8 +144,14 @@ class Chunk {
    /// This chunks biome.
    Biome biome = (Biome)0;
 
-   /// True if the visibility of block faces in this chunk has been calculated.
-   bool visibilityCalculated = false;
+   /// The progress of this chunk's terrain generation.
+   std::atomic<GenerationState> generationState{ GenerationState::NotGenerated };
+
+   /// Bitmask of sections whose visible faces need to be recalculated.
+   uint16_t dirtySections = AllSections;
+
+   /// Bitmask of sections that contain a layer which hides everything below.
+   uint16_t occludingSections = 0;
 
    /// The bounding box of this chunk.
    BoundingBox boundingBox;
@@ -71,6 +163,16 @@ class Chunk {
 
    void modifiedBlock(const BlockPositionChunk &pos);
 
+   /// Mark the faces of a section as outdated.
+   void modifiedSection(unsigned section) { dirtySections |= (1u << section); }
+
+   friend class LightEngine;
+
+   /// Add the visible faces of a section to \p mesh, stopping at the first
+   /// layer that hides everything below it.
+   /// \return true iff such a layer was found.
+   bool buildSection(unsigned section, ChunkSectionMesh &mesh);
+
 public:
    Chunk();
    Chunk(World *world, int x, int z);
@@ -86,7 +188,15 @@ public:
    /// Initialize the chunk with the given coordinates.
    void initialize(World *world, int x, int z);
 
-   /// \return The block at the specified chunk-local coordinate.
+   /// Return the segments to the pool, free the mesh and mark the chunk as
+   /// not generated. Must be called on the main thread while holding the
+   /// world mutex, after the chunk was removed from the light engine.
+   void unload();
+
+   /// \return The block at the specified position, or nullptr if it is
+   /// outside of this chunk. Sections that were never allocated return a
+   /// shared air block. Never allocates, so it can be called from any
+   /// thread.
    const Block *getBlockAt(const WorldPosition &pos) const;
 
    /// \return A block, if its corresponding chunk is loaded.
@@ -99,15 +209,58 @@ public:
    /// Update the visibility of blocks in this chunk.
    void updateVisibility();
 
+   /// \return The packed light level at a position in this chunk. Positions
+   /// in sections that were never allocated are fully exposed to the sky.
+   uint8_t getLightAt(const WorldPosition &pos) const;
+
+   /// Mark the faces of the sections in \p mask as outdated.
+   void modifiedSections(uint16_t mask) { dirtySections |= mask; }
+
+   /// Call \p fn for every chunk whose mesh depends on the block at \p pos,
+   /// with the mask of its sections that do. Section meshes sample the
+   /// blocks and light of their whole border, including the edges and
+   /// corners, so this includes the diagonal chunks and the sections above
+   /// and below.
+   static void forEachAffectedSection(
+      const WorldPosition &pos,
+      llvm::function_ref<void(const ChunkPosition&, uint16_t)> fn);
+
    /// \return This chunk's biome.
    Biome getBiome() const { return biome; }
 
    /// Set this chunk's biome.
    void setBiome(Biome b) { biome = b; }
 
+   /// \return The progress of this chunk's terrain generation.
+   GenerationState getGenerationState() const
+   {
+      return generationState.load(std::memory_order_acquire);
+   }
+
+   /// Set the progress of this chunk's terrain generation.
+   void setGenerationState(GenerationState state)
+   {
+      generationState.store(state, std::memory_order_release);
+   }
+
+   /// Atomically move from state \p expected to \p desired.
+   /// \return false if the chunk was not in state \p expected.
+   bool updateGenerationState(GenerationState expected,
+                              GenerationState desired) {
+      return generationState.compare_exchange_strong(
+         expected, desired, std::memory_order_acq_rel);
+   }
+
+   /// \return true iff this chunk is fully loaded. Other threads may only
+   /// read the blocks of ready chunks.
+   bool isReady() const
+   {
+      return getGenerationState() == GenerationState::Ready;
+   }
+
    /// \return true iff this chunk was modified.
-   bool wasModified() const { return !visibilityCalculated; }
-   void setModified() { visibilityCalculated = false; }
+   bool wasModified() const { return dirtySections != 0; }
+   void setModified() { dirtySections = AllSections; }
 
    template<class segment_type, class block_type>
    struct block_iterator_t {
@@ -249,6 +402,9 @@ public:
    /// \return The chunk position.
    ChunkPosition getChunkPosition() const;
 
+   /// \return The world this chunk belongs to.
+   World &getWorld() const { return *world; }
+
    /// \return The chunk mesh of this chunk.
    const ChunkMesh &getChunkMesh() const { return chunkMesh; }
 
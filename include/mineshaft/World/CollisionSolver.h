@@ -0,0 +1,67 @@
+#ifndef MINESHAFT_COLLISIONSOLVER_H
+#define MINESHAFT_COLLISIONSOLVER_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Model/Model.h"
+
+namespace mc {
+
+class Chunk;
+class ChunkSegment;
+class World;
+
+/// Moves axis aligned boxes through the block grid, sliding along the blocks
+/// they run into. Blocks are read as bitmasks from the chunk segments, a row
+/// of up to 16 blocks at a time.
+class CollisionSolver {
+public:
+   /// Bits returned by moveBox() for the axes along which a box was stopped.
+   enum BlockedAxis : unsigned {
+      BlockedX = 0x1,
+      BlockedY = 0x2,
+      BlockedZ = 0x4,
+   };
+
+private:
+   /// Reference to the world instance.
+   World &world;
+
+   /// The position of the last chunk that was looked up.
+   ChunkPosition cachedChunkPos;
+
+   /// The last chunk that was looked up, nullptr if it isn't loaded.
+   Chunk *cachedChunk = nullptr;
+
+   /// True iff the cached chunk is valid.
+   bool hasCachedChunk = false;
+
+   /// The section index of the cached segment, -1 if there is none.
+   int cachedSection = -1;
+
+   /// The last segment that was looked up, nullptr if it isn't allocated.
+   ChunkSegment *cachedSegment = nullptr;
+
+   /// \return The collision bits of a row of blocks in a chunk along the x
+   /// axis. Blocks in chunks that are not loaded never collide.
+   uint16_t getCollisionRow(int chunkX, int y, int z);
+
+   /// \return true iff entities collide with any block in the given range.
+   /// Both bounds are inclusive.
+   bool anyCollision(const int (&min)[3], const int (&max)[3]);
+
+   /// \return How far a box can move along an axis before hitting a block.
+   float sweep(const BoundingBox &box, int axis, float distance);
+
+public:
+   /// C'tor.
+   explicit CollisionSolver(World &world);
+
+   /// Move a box by \p delta one axis at a time, stopping each axis at the
+   /// first block in the way. \p delta is updated to the actual movement.
+   /// \return The axes along which the box was stopped.
+   unsigned moveBox(BoundingBox &box, glm::vec3 &delta);
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_COLLISIONSOLVER_H
@@ -0,0 +1,153 @@
+#ifndef MINESHAFT_FARTERRAIN_H
+#define MINESHAFT_FARTERRAIN_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Model/Model.h"
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/Support/Noise/SimplexNoise.h"
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+namespace mc {
+
+class FarTerrain;
+class World;
+
+/// A vertex of the far terrain height field.
+struct FarTerrainVertex {
+   glm::vec3 Position;
+   glm::vec3 Normal;
+   glm::vec3 Color;
+};
+
+/// A square region of MC_FAR_TERRAIN_REGION_SIZE * MC_FAR_TERRAIN_REGION_SIZE
+/// chunks that is rendered as a height field instead of blocks.
+struct FarTerrainRegion {
+   enum class State : uint8_t {
+      /// The height field is being generated by a job.
+      Pending,
+
+      /// The height field is generated, but not yet uploaded.
+      Generated,
+
+      /// The height field can be rendered.
+      Ready,
+   };
+
+   /// Number of vertices per region side.
+   static constexpr int SamplesPerSide =
+      (MC_FAR_TERRAIN_REGION_SIZE * MC_CHUNK_WIDTH) / MC_FAR_TERRAIN_SAMPLE_STEP + 1;
+
+   /// Number of indices per chunk in the region.
+   static constexpr int IndicesPerChunk =
+      (MC_CHUNK_WIDTH / MC_FAR_TERRAIN_SAMPLE_STEP)
+      * (MC_CHUNK_DEPTH / MC_FAR_TERRAIN_SAMPLE_STEP) * 6;
+
+   FarTerrainRegion(FarTerrain &terrain, int x, int z);
+   ~FarTerrainRegion();
+
+   FarTerrainRegion(const FarTerrainRegion&) = delete;
+   FarTerrainRegion &operator=(const FarTerrainRegion&) = delete;
+
+   /// The far terrain this region belongs to.
+   FarTerrain &terrain;
+
+   /// X position of this region, in regions.
+   int x;
+
+   /// Z position of this region, in regions.
+   int z;
+
+   /// The current state of this region.
+   std::atomic<State> state;
+
+   /// Signaled once the generation job finished or was skipped.
+   JobCounter job;
+
+   /// Set if the region left the far render distance before its generation
+   /// job started.
+   std::atomic<bool> cancelled{ false };
+
+   /// The height field vertices.
+   std::vector<FarTerrainVertex> Vertices;
+
+   /// The height field indices, grouped by chunk.
+   std::vector<unsigned> Indices;
+
+   /// The bounding box of this region.
+   BoundingBox boundingBox;
+
+   /// The VAO of this region.
+   GLuint VAO = 0;
+
+   /// The VBO of this region.
+   GLuint VBO = 0;
+
+   /// The EBO of this region.
+   GLuint EBO = 0;
+
+   /// Sample the height field. Called on a worker thread.
+   void generate();
+
+   /// Upload the height field. Must be called on the main thread.
+   void upload();
+
+   /// \return The position of the i-th chunk in this region.
+   ChunkPosition getChunkPosition(unsigned i) const;
+};
+
+class FarTerrain {
+   /// Reference to the world instance.
+   World &world;
+
+   /// Noise generator used for sampling the height field. FastNoise is not
+   /// thread safe, so generation jobs sample with a copy of it.
+   FastNoise noiseGenerator;
+
+   /// The cached regions, indexed by region position.
+   std::unordered_map<ChunkPosition, FarTerrainRegion*> regions;
+
+   /// Dropped regions whose generation job may still be running.
+   std::vector<FarTerrainRegion*> retiredRegions;
+
+   /// The region that the far terrain is centered around.
+   ChunkPosition centerRegion;
+
+   friend struct FarTerrainRegion;
+
+public:
+   /// C'tor. Does not generate any regions.
+   explicit FarTerrain(World &world);
+   ~FarTerrain();
+
+   FarTerrain(const FarTerrain&) = delete;
+   FarTerrain &operator=(const FarTerrain&) = delete;
+
+   /// \return The region that contains a chunk.
+   static ChunkPosition getRegionPosition(const ChunkPosition &chunkPos);
+
+   /// Request all regions around a new center chunk, and drop the regions
+   /// that left the far render distance.
+   void updateCenter(const ChunkPosition &chunkPos);
+
+   /// Upload all regions that finished generating.
+   void finalizeRegions();
+
+   /// \return true iff the chunk is rendered as blocks.
+   bool isChunkLoaded(const ChunkPosition &chunkPos) const;
+
+   /// \return The cached regions.
+   const std::unordered_map<ChunkPosition, FarTerrainRegion*> &getRegions() const
+   {
+      return regions;
+   }
+
+   /// \return The world instance.
+   World &getWorld() const { return world; }
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_FARTERRAIN_H
@@ -0,0 +1,175 @@
+#ifndef MINESHAFT_LIGHTENGINE_H
+#define MINESHAFT_LIGHTENGINE_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/utils.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace mc {
+
+class Block;
+class Chunk;
+class ChunkSegment;
+class World;
+
+/// Propagates sky and block light through the voxel grid. Light changes are
+/// queued on the main thread and flood-filled by a job on the job system,
+/// visiting only the blocks whose light level actually changes.
+class LightEngine {
+public:
+   /// The light channels stored for every block.
+   enum Channel : uint8_t {
+      SkyLight = 0,
+      BlockLight,
+
+      NumChannels,
+   };
+
+private:
+   /// A block whose light needs to be propagated.
+   struct LightNode {
+      WorldPosition pos;
+      uint8_t level;
+
+      LightNode(const WorldPosition &pos, uint8_t level = 0)
+         : pos(pos), level(level)
+      { }
+   };
+
+   /// A queued change that was requested from the main thread.
+   struct PendingUpdate {
+      enum Kind : uint8_t {
+         /// The opacity or emitted light of a block changed.
+         BlockChanged,
+
+         /// The light of a block should be spread to its neighbours.
+         Spread,
+      };
+
+      WorldPosition pos;
+      Kind kind;
+
+      PendingUpdate(const WorldPosition &pos, Kind kind)
+         : pos(pos), kind(kind)
+      { }
+   };
+
+   /// Reference to the world instance.
+   World &world;
+
+   /// Chunks whose initial light has been computed. Only these are visited
+   /// by the light propagation.
+   std::unordered_map<ChunkPosition, Chunk*> chunks;
+
+   /// Protects the chunk map while light is being propagated.
+   std::mutex chunkMutex;
+
+   /// Updates that have not been processed yet.
+   std::vector<PendingUpdate> pendingUpdates;
+
+   /// Sections whose light changed since the last call to update().
+   std::unordered_map<Chunk*, uint16_t> modifiedSections;
+
+   /// Protects the pending updates and modified sections.
+   std::mutex queueMutex;
+
+   /// True if a propagation job is queued. At most one job runs at a time.
+   std::atomic<bool> taskScheduled;
+
+   /// Signaled once the propagation job finished.
+   JobCounter pendingTask;
+
+   /// Light removal queues, per channel. Only used by the job.
+   std::deque<LightNode> removeQueues[NumChannels];
+
+   /// Light addition queues, per channel. Only used by the job.
+   std::deque<LightNode> addQueues[NumChannels];
+
+   /// Sections modified by the running propagation. Only used by the job.
+   std::unordered_map<Chunk*, uint16_t> localModifiedSections;
+
+   /// The chunk of the last lookup. Only used by the job.
+   Chunk *lastChunk = nullptr;
+
+   /// \return The loaded chunk containing a position, if its light was
+   /// initialized.
+   Chunk *lookupChunk(const WorldPosition &pos);
+
+   /// \return The segment containing \p pos and the index of the position
+   /// within it, or nullptr if the segment doesn't exist.
+   ChunkSegment *lookupSegment(Chunk *chunk, const WorldPosition &pos,
+                               unsigned &idx);
+
+   /// \return The light level of a channel at a position.
+   uint8_t getLevel(const WorldPosition &pos, Channel channel);
+
+   /// Set the light level of a channel at a position.
+   void setLevel(const WorldPosition &pos, Channel channel, uint8_t level);
+
+   /// \return The block at a position, or nullptr if it is not stored.
+   const Block *getBlock(const WorldPosition &pos);
+
+   /// \return true iff light can pass through the block at a position.
+   bool isTransparent(const WorldPosition &pos);
+
+   /// Remember that the faces around a position need to be updated.
+   void markModified(Chunk *chunk, const WorldPosition &pos);
+
+   /// Process queued light removals.
+   void propagateRemoval(Channel channel);
+
+   /// Process queued light additions.
+   void propagateAddition(Channel channel);
+
+   /// Process all pending updates.
+   void processUpdates();
+
+   /// Job entry point.
+   static void processUpdatesTask(LightEngine *engine);
+
+public:
+   /// C'tor.
+   explicit LightEngine(World &world);
+
+   /// Wait for the running propagation job, if any.
+   void waitForUpdates();
+
+   /// \return The number of updates waiting for the next propagation job.
+   size_t getNumPendingUpdates();
+
+   LightEngine(const LightEngine&) = delete;
+   LightEngine &operator=(const LightEngine&) = delete;
+
+   /// Compute the sky light of a freshly generated chunk and queue its
+   /// spreading into and out of its neighbours.
+   void initializeChunk(Chunk &chunk);
+
+   /// Light a section that was just allocated in an initialized chunk. New
+   /// sections start out fully lit, so the sky light is only kept below full
+   /// sky light, and the section is queued for propagation. Must be called
+   /// on the main thread while holding the world mutex.
+   void sectionAllocated(Chunk &chunk, unsigned section);
+
+   /// Stop propagating light into a chunk that is about to be unloaded.
+   /// Waits for the running propagation job, so it must not be called while
+   /// holding the world mutex. Must be called on the main thread.
+   void removeChunk(Chunk &chunk);
+
+   /// Queue a light update for a block whose opacity or emitted light
+   /// changed.
+   void blockChanged(const WorldPosition &pos);
+
+   /// Mark the chunk sections whose light changed as modified, and schedule
+   /// the propagation of pending updates. Must be called on the main thread.
+   void update();
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_LIGHTENGINE_H
@@ -0,0 +1,133 @@
+#ifndef MINESHAFT_SIMULATION_H
+#define MINESHAFT_SIMULATION_H
+
+#include "mineshaft/Config.h"
+#include "mineshaft/Entity/EntityStore.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mc {
+
+class Entity;
+class World;
+
+/// Advances the entities of a world in fixed time steps on a dedicated
+/// thread. After every tick the entity positions are published as a snapshot,
+/// and the renderer interpolates between the last two snapshots, so that
+/// neither side ever waits for the other.
+class Simulation {
+public:
+   using Clock = std::chrono::steady_clock;
+
+   /// The duration of a single tick, in seconds.
+   static constexpr float TickDuration = 1.0f / MC_SIMULATION_TICKS_PER_SECOND;
+
+private:
+   /// The state of an entity at the end of a tick.
+   struct EntitySnapshot {
+      Entity *entity;
+      EntityID id;
+      ScenePosition position;
+
+      EntitySnapshot(Entity *entity, EntityID id, const ScenePosition &position)
+         : entity(entity), id(id), position(position)
+      { }
+   };
+
+   /// Marks entities that are not in the previous snapshot.
+   static constexpr unsigned NoIndex = ~0u;
+
+   /// Reference to the world instance.
+   World &world;
+
+   /// Held by the simulation thread while it reads the world, and by the main
+   /// thread while it changes blocks of ready chunks or the active entities.
+   std::mutex worldMutex;
+
+   /// Protects the published snapshots.
+   std::mutex snapshotMutex;
+
+   /// The snapshot of the tick before the current one.
+   std::vector<EntitySnapshot> previousSnapshot;
+
+   /// The snapshot of the last finished tick.
+   std::vector<EntitySnapshot> currentSnapshot;
+
+   /// The time at which the current snapshot was published.
+   Clock::time_point currentSnapshotTime;
+
+   /// The index of each entity in the previous snapshot, indexed by ID, or
+   /// NoIndex. Only used by the main thread.
+   std::vector<unsigned> previousIndices;
+
+   /// The publishing time of the snapshot that previousIndices was built
+   /// for. Only used by the main thread.
+   Clock::time_point indexedSnapshotTime;
+
+   /// The snapshot that is being filled by the running tick. Only used by the
+   /// simulation thread.
+   std::vector<EntitySnapshot> nextSnapshot;
+
+   /// The entities whose position was set by the last call to interpolate().
+   /// Only used by the main thread.
+   std::vector<Entity*> interpolatedEntities;
+
+   /// Entities that moved to another chunk during the running tick. Only
+   /// used by the simulation thread.
+   std::vector<EntityID> movedEntities;
+
+   /// The number of finished ticks.
+   std::atomic<uint64_t> tickCount;
+
+   /// True while the simulation thread should keep running.
+   std::atomic<bool> running;
+
+   /// The simulation thread.
+   std::thread thread;
+
+   /// Advance all active entities by one tick and publish their state.
+   void tick();
+
+   /// Entry point of the simulation thread.
+   void run();
+
+public:
+   /// C'tor. Does not start the simulation thread.
+   explicit Simulation(World &world);
+
+   Simulation(const Simulation&) = delete;
+   Simulation &operator=(const Simulation&) = delete;
+
+   /// Start running ticks on the simulation thread.
+   void start();
+
+   /// Stop the simulation thread and wait for the running tick to finish.
+   void stop();
+
+   /// Update the rendered position of all simulated entities by interpolating
+   /// between the last two ticks. Must be called on the main thread.
+   void interpolate();
+
+   /// \return The entities whose position was set by the last call to
+   /// interpolate(), i.e. the active entities of the last finished tick.
+   /// Unlike the entity store, this can be read without the world mutex.
+   /// Must be called on the main thread.
+   llvm::ArrayRef<Entity*> getInterpolatedEntities() const
+   {
+      return interpolatedEntities;
+   }
+
+   /// \return The mutex protecting the world against the simulation thread.
+   std::mutex &getWorldMutex() { return worldMutex; }
+
+   /// \return The number of ticks that finished so far.
+   uint64_t getTickCount() const { return tickCount.load(); }
+};
+
+} // namespace mc
+
+#endif //MINESHAFT_SIMULATION_H
@@ -1,14 +1,22 @@
 #ifndef MINESHAFT_WORLD_H
 #define MINESHAFT_WORLD_H
 
+#include "mineshaft/Entity/EntityStore.h"
+#include "mineshaft/Support/JobSystem.h"
 #include "mineshaft/World/Chunk.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 namespace mc {
 
 class Entity;
+class FarTerrain;
+class LightEngine;
+class Simulation;
 class WorldGenerator;
 
 /// Stores options for world and terrain generation.
@@ -60,13 +68,94 @@ struct WorldSegment {
    Chunk chunks[MC_WORLD_SEGMENT_WIDTH][MC_WORLD_SEGMENT_DEPTH];
 };
 
+/// The result of a ray cast through the world.
+struct RaycastResult {
+   /// The block that was hit.
+   const Block *block = nullptr;
+
+   /// The position of the block that was hit.
+   WorldPosition pos;
+
+   /// The face of the block that the ray entered through, or F_None if the
+   /// ray started inside of the block.
+   Block::FaceMask face = Block::F_None;
+
+   /// The distance from the ray origin to the hit, in scene units.
+   float distance = 0.0f;
+};
+
+/// The voxel world. Rules for accessing it from multiple threads:
+///
+/// - Segments are looked up without locking. Loading a segment fills an
+///   empty slot of the current segment table, and growing the world
+///   publishes a new table. Replaced tables stay alive until the world is
+///   destroyed, so a reader never sees freed memory.
+/// - A chunk's terrain is written by the one thread that moved it into the
+///   Generating state. Once it is integrated on the main thread, the chunk
+///   becomes Ready, which publishes its blocks to all threads. getBlock(),
+///   getLight() and raycast() treat chunks that are not ready as unloaded.
+/// - Blocks and segments of ready chunks are only written on the main
+///   thread, while holding the simulation's world mutex. Other threads must
+///   hold it while they read blocks: the simulation does for the whole tick,
+///   the light engine's job for the whole propagation.
+/// - Light levels are written by the light engine's job. They are stored
+///   atomically, so the main thread can read them at any time and sees an
+///   old or a new level, but a mesh may combine levels from before and
+///   after a propagation until the next light update remeshes it.
+/// - There are no immutable snapshots of chunks; meshing reads the live
+///   blocks and must therefore run on the main thread.
+/// - Everything that loads or modifies the world, i.e. getChunk() and
+///   getSegment() with \c initialize, updateBlock() and
+///   updatePlayerPosition(), must be called on the main thread. Lookups
+///   without \c initialize, getBlock(), getLight() and raycast() can be
+///   called from other threads while holding the world mutex.
 class World {
+public:
+   /// Update to a block that should be performed when the corresponding
+   /// chunk is generated.
+   struct DelayedBlockUpdate {
+      WorldPosition pos;
+      Block block;
+
+      DelayedBlockUpdate(const WorldPosition &pos, Block &&block)
+         : pos(pos), block(std::move(block))
+      { }
+   };
+
+private:
    /// Reference to the context instance.
    Application &app;
 
-   /// Storage for currently loaded world segments. This is structured like a
-   /// two-dimensional array.
-   WorldSegment ***loadedSegments = nullptr;
+   /// A fixed-size table of the loaded segments, covering segment x
+   /// coordinates in [minX, maxX) and z coordinates in [minZ, maxZ). Slots
+   /// are filled once and never cleared.
+   struct SegmentTable {
+      SegmentTable(int minX, int maxX, int minZ, int maxZ);
+
+      int minX;
+      int maxX;
+      int minZ;
+      int maxZ;
+
+      /// The segments, nullptr if not loaded.
+      std::unique_ptr<std::atomic<WorldSegment*>[]> segments;
+
+      /// \return The slot of a segment, or nullptr if it is out of range.
+      std::atomic<WorldSegment*> *getSlot(int x, int z) const;
+   };
+
+   /// The number of segments a table grows by in addition to the needed ones,
+   /// so that walking in one direction doesn't replace the table every time.
+   static constexpr int SegmentTableMargin = 2;
+
+   /// The current segment table.
+   std::atomic<SegmentTable*> segmentTable{ nullptr };
+
+   /// All segment tables, including the replaced ones.
+   std::vector<std::unique_ptr<SegmentTable>> segmentTables;
+
+   /// Serializes loading segments.
+   std::mutex segmentMutex;
 
    /// Chunks that will be rendered based on the current player position.
    Chunk **chunksToRender = nullptr;
@@ -86,26 +175,97 @@ class World {
    /// The terrain generated used in this world.
    WorldGenerator *worldGenerator = nullptr;
 
-   /// The entities contained in the world.
-   std::vector<Entity*> entities;
+   /// The low detail terrain rendered beyond the render distance.
+   FarTerrain *farTerrain = nullptr;
+
+   /// The engine that propagates sky and block light.
+   LightEngine *lightEngine = nullptr;
+
+   /// The fixed time step simulation of the entities in this world.
+   Simulation *simulation = nullptr;
+
+   /// The entities contained in the world. Entities in the currently
+   /// loaded chunks are active.
+   EntityStore entityStore;
+
+   /// A chunk that waits for its terrain to be generated.
+   struct ChunkLoadRequest {
+      /// The requested chunk.
+      Chunk *chunk;
+
+      /// The urgency of the request, lower values are loaded first.
+      float priority;
+   };
+
+   /// A chunk whose terrain was generated by a job.
+   struct GeneratedChunk {
+      /// The generated chunk.
+      Chunk *chunk;
+
+      /// The blocks the generator placed in other chunks.
+      std::vector<DelayedBlockUpdate> outsideBlocks;
+   };
 
-   /// The entities in the currently loaded chunks.
-   std::unordered_set<Entity*> activeEntities;
+   /// The maximum number of generated chunks integrated per frame.
+   static constexpr unsigned MaxChunksPerFrame = 8;
 
-   /// The lowest loaded x segment coordinate.
-   int minX = 0;
+   /// The time per frame after which no further chunks are integrated, in
+   /// milliseconds. At least one chunk is integrated every frame.
+   static constexpr float ChunkLoadBudget = 4.0f;
 
-   /// The highest loaded x segment coordinate.
-   int maxX = 0;
+   /// The maximum number of scheduled generation jobs per worker thread.
+   /// Keeping few jobs in flight lets the queue react to the player moving.
+   static constexpr unsigned MaxScheduledChunksPerThread = 2;
 
-   /// The lowest loaded z segment coordinate.
-   int minZ = 0;
+   /// The requested chunks within the render distance that were not
+   /// scheduled yet, in no particular order. Only used by the main thread.
+   std::vector<ChunkLoadRequest> loadQueue;
 
-   /// The highest loaded z segment coordinate.
-   int maxZ = 0;
+   /// The chunks with a submitted generation job that were not integrated
+   /// yet. Only used by the main thread.
+   std::vector<Chunk*> scheduledChunks;
 
-   /// Generate the terrain of the given segment.
-   void genWorld(WorldSegment &seg);
+   /// Protects the generated chunks.
+   std::mutex generatedMutex;
+
+   /// Chunks that were generated and wait to be integrated.
+   std::vector<GeneratedChunk> generatedChunks;
+
+   /// Counts the running generation jobs.
+   JobCounter generationJobs;
+
+   /// The number of chunks beyond the render distance that stay loaded, so
+   /// that walking back and forth doesn't regenerate them every time.
+   static constexpr int UnloadMargin = 2;
+
+   /// The ready chunks, in no particular order. Only used by the main thread.
+   std::vector<Chunk*> loadedChunks;
+
+   /// Job entry point for generating a chunk's terrain.
+   static void generateChunkTask(Chunk *chunk);
+
+   /// Generate a chunk on the main thread, if it is not being generated
+   /// already.
+   void generateChunk(Chunk &chunk);
+
+   /// Place the generated terrain of a chunk in the world and make the chunk
+   /// ready. Must be called on the main thread.
+   void finishChunk(GeneratedChunk &generated);
+
+   /// Unload the chunks that are more than the render distance plus
+   /// UnloadMargin chunks away from \p center. Must be called on the main
+   /// thread.
+   void unloadDistantChunks(const ChunkPosition &center);
+
+   /// \return The load priority of a chunk for a player at \p pos looking in
+   /// direction \p dir. This is the distance in chunks, with chunks behind
+   /// the player counting up to twice as far.
+   static float getLoadPriority(const Chunk &chunk, const glm::vec3 &pos,
+                                const glm::vec3 &dir);
+
+   /// Integrate generated chunks within the per-frame budget and schedule
+   /// the most urgent queued chunks.
+   void processLoadQueue();
 
    struct ChunkIndex {
       int segmentX;
@@ -117,27 +277,15 @@ class World {
    /// Get the unsigned vector index for a signed chunk coordinate.
    ChunkIndex getLocalChunkCoordinate(const ChunkPosition &chunkPos);
 
-   /// Get the unsigned vector index for a signed segment coordinate.
-   std::pair<int, int> getLocalSegmentCoordinate(int segmentX, int segmentZ);
+   /// Publish a larger segment table if the segment at \p x, \p z is out of
+   /// range. Must be called with the segment mutex held.
+   /// \return The current segment table.
+   SegmentTable *growWorld(int x, int z);
 
-   /// Load new chunks and generate their terrain.
-   void growWorld(int neededMinX, int neededMaxX,
-                  int neededMinZ, int neededMaxZ);
-
-   /// Load a chunk as the center of the visible area.
+   /// Make a chunk the center of the visible area. The chunk itself is
+   /// generated immediately, the chunks around it are queued.
    void loadChunk(Chunk *chunk);
 
-   // Update to a block that should be performed when the corresponding
-   // chunk is generated.
-   struct DelayedBlockUpdate {
-      WorldPosition pos;
-      Block block;
-
-      DelayedBlockUpdate(const WorldPosition &pos, Block &&block)
-         : pos(pos), block(std::move(block))
-      { }
-   };
-
    // Block updates that should be performed when a chunk is generated.
    std::unordered_map<ChunkPosition, std::vector<DelayedBlockUpdate>> blockUpdates;
 
@@ -146,14 +294,17 @@ public:
    explicit World(Application &app);
    ~World();
 
-   /// Disable copying.
+   /// Disable copying and moving. The generation and light jobs, the
+   /// simulation and every chunk refer to the world by address.
    World(const World &w) = delete;
    World &operator=(const World &w) = delete;
 
-   World(World &&w) noexcept;
-   World &operator=(World &&w) noexcept;
+   World(World &&w) = delete;
+   World &operator=(World &&w) = delete;
 
-   /// \return A chunk at the specified coordinates.
+   /// \return A chunk at the specified coordinates. Chunks are created on
+   /// demand if \p initialize is true, but their terrain is only generated
+   /// once they are in range of the player.
    Chunk *getChunk(const ChunkPosition &chunkPos, bool initialize = true);
 
    /// \return A block, if its corresponding chunk is loaded.
@@ -163,12 +314,38 @@ public:
    /// \return A block, if its corresponding chunk is loaded.
    const Block *getBlock(const WorldPosition &pos) const;
 
+   /// Follow a ray through the block grid until it hits a solid block.
+   /// Every block on the ray is visited exactly once, in order.
+   /// \param origin The start of the ray, in scene coordinates.
+   /// \param direction The direction of the ray, does not need to be normalized.
+   /// \param maxDistance The maximum length of the ray, in scene units.
+   /// \return The first solid block on the ray, if any.
+   llvm::Optional<RaycastResult> raycast(const ScenePosition &origin,
+                                         const glm::vec3 &direction,
+                                         float maxDistance) const;
+
+   /// \return The packed light level at a position. Positions in chunks that
+   /// are not loaded are fully exposed to the sky.
+   uint8_t getLight(const WorldPosition &pos) const;
+
    /// \return The world generator.
    WorldGenerator *getWorldGenerator() const { return worldGenerator; }
 
    /// Set the world generator.
    void setWorldGenerator(WorldGenerator *gen) { worldGenerator = gen; }
 
+   /// \return The light engine.
+   LightEngine *getLightEngine() const { return lightEngine; }
+
+   /// \return The entity simulation.
+   Simulation *getSimulation() const { return simulation; }
+
+   /// \return The far terrain, if it is enabled.
+   FarTerrain *getFarTerrain() const { return farTerrain; }
+
+   /// \return The chunk that the rendered area is centered around.
+   Chunk *getCenterChunk() const { return centerChunk; }
+
    enum BlockNeighbour {
       RightNeighbour,
       LeftNeighbour,
@@ -188,20 +365,50 @@ public:
    /// \return A segment at the specified coordinates.
    WorldSegment *getSegment(int x, int z, bool initialize = true);
 
-   /// Potentially update the rendered chunks based on the players position.
+   /// Potentially update the rendered chunks based on the players position,
+   /// and generate the most urgent of the requested chunks.
    void updatePlayerPosition();
 
+   /// Generate a chunk on the calling thread and make it ready, without
+   /// going through the load queue. Must be called on the main thread.
+   /// \return The chunk.
+   Chunk *generateChunkNow(const ChunkPosition &chunkPos);
+
+   /// \return The number of chunks waiting to be generated.
+   unsigned getNumQueuedChunks() const
+   {
+      return (unsigned)(loadQueue.size() + scheduledChunks.size());
+   }
+
    /// Update the visibility of chunks and entities.
    void updateVisibility();
 
+   /// Update the gauges of the chunk loading queues.
+   void updateMetrics();
+
    /// Get the currently rendered chunks.
    llvm::ArrayRef<Chunk*> getChunksToRender() const;
 
    /// Register an entity.
    void registerEntity(Entity *e);
 
-   /// \return The currently active entities.
-   const std::unordered_set<Entity*> &getActiveEntities() const { return activeEntities; }
+   /// Find the closest entity on a ray. Must not be called from the
+   /// simulation thread.
+   /// \param ignore An entity that is never hit, e.g. the one casting the ray.
+   /// \param distance If given, receives the distance to the hit.
+   /// \return The entity that was hit, or nullptr.
+   Entity *raycastEntities(const ScenePosition &origin,
+                           const glm::vec3 &direction, float maxDistance,
+                           const Entity *ignore = nullptr,
+                           float *distance = nullptr);
+
+   /// Find the entities whose bounding box is at most \p radius away from
+   /// \p center. Must not be called from the simulation thread.
+   void getEntitiesInRange(const ScenePosition &center, float radius,
+                           llvm::SmallVectorImpl<Entity*> &result);
+
+   /// \return The entity store.
+   EntityStore &getEntityStore() { return entityStore; }
 
    /// \return The context instance.
    Application &getApplication() const { return app; }
@@ -16,6 +16,15 @@ enum class Biome : uint8_t {
    Mountains,
 };
 
+/// The two-dimensional terrain fields of a single block column.
+struct TerrainColumn {
+   /// The y coordinate of the topmost terrain block.
+   int height = 0;
+
+   /// The biome of the chunk this column belongs to.
+   Biome biome = Biome::Undefined;
+};
+
 class WorldGenerator {
 protected:
    explicit WorldGenerator(World *world, WorldGenOptions options);
@@ -30,37 +39,55 @@ public:
    /// Virtual destructor to guarantee vtable generation.
    virtual ~WorldGenerator() = default;
 
+   /// \return The world generation options.
+   const WorldGenOptions &getOptions() const { return options; }
+
    /// Generate the terrain for a chunk according to the generation strategy.
-   virtual void generateTerrain(Chunk &chunk) = 0;
+   /// Called on worker threads, possibly for several chunks at once, so it
+   /// must only write to \p chunk. Blocks that belong to other chunks, e.g.
+   /// the leaves of trees close to the border, are appended to
+   /// \p outsideBlocks and placed on the main thread.
+   virtual void generateTerrain(
+      Chunk &chunk, std::vector<World::DelayedBlockUpdate> &outsideBlocks) = 0;
+
+   /// Evaluate only the height and biome fields of a block column, without
+   /// generating any blocks. The given noise generator is reconfigured on
+   /// every call, so it must not be shared between threads.
+   /// \return false iff this generator does not support height fields.
+   virtual bool sampleColumn(FastNoise &noise, int x, int z,
+                             TerrainColumn &column) {
+      return false;
+   }
 };
 
 class DefaultTerrainGenerator: public WorldGenerator {
 private:
-   /// The noise generator.
+   /// The noise generator. FastNoise is reconfigured on every call, so it is
+   /// only ever copied by the generation jobs.
    FastNoise noiseGenerator;
 
-   /// Random number generator.
-   std::mt19937 rng;
-
    /// Generate noise with the specified parameters.
-   float getNoise(int x, int z,
-                  float frequency = 0.01f,
-                  float lacunarity = 2.0f,
-                  float gain = 0.5f,
-                  FastNoise::FractalType type = FastNoise::FBM);
+   static float getNoise(FastNoise &noise, int x, int z,
+                         float frequency = 0.01f,
+                         float lacunarity = 2.0f,
+                         float gain = 0.5f,
+                         FastNoise::FractalType type = FastNoise::FBM);
 
    /// Configure the noise generator based on the biome.
-   float getNoise(Biome b, int x, int z);
+   static float getNoise(FastNoise &noise, Biome b, int x, int z);
 
    /// Configure the noise generator based on the biome.
-   float getTreeNoise(Biome b, int x, int z);
+   static float getTreeNoise(FastNoise &noise, Biome b, int x, int z);
    int getTreeNoiseFrequency(Biome b);
 
    /// Configure the noise generator based on the biome.
-   float getBiomeNoise(ChunkPosition chunkPos);
+   static float getBiomeNoise(FastNoise &noise, ChunkPosition chunkPos);
 
    /// Configure the noise generator based on the biome.
-   Biome getBiome(const Chunk &chunk);
+   static Biome getBiome(FastNoise &noise, ChunkPosition chunkPos);
+
+   /// \return The terrain height of a block column in the given biome.
+   static int getHeight(FastNoise &noise, Biome b, int x, int z);
 
    /// Visualize the generated noise.
    void visualizeNoise(const llvm::function_ref<float(int, int)> &noiseGen,
@@ -71,10 +98,17 @@ public:
    DefaultTerrainGenerator(World *world, WorldGenOptions &options);
 
    /// \inherit
-   void generateTerrain(Chunk &chunk) override;
+   void generateTerrain(
+      Chunk &chunk,
+      std::vector<World::DelayedBlockUpdate> &outsideBlocks) override;
+
+   /// \inherit
+   bool sampleColumn(FastNoise &noise, int x, int z,
+                     TerrainColumn &column) override;
 
    /// Generate a tree at the specified position.
-   void generateTree(Chunk &chunk, const WorldPosition &pos);
+   void generateTree(Chunk &chunk, std::mt19937 &rng, const WorldPosition &pos,
+                     std::vector<World::DelayedBlockUpdate> &outsideBlocks);
 };
 
 } // namespace mc
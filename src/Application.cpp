@@ -1,7 +1,11 @@
 #include "mineshaft/Application.h"
 #include "mineshaft/GameSave.h"
 #include "mineshaft/Entity/Player.h"
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/Metrics.h"
+#include "mineshaft/Support/Profiler.h"
 #include "mineshaft/World/Block.h"
+#include "mineshaft/World/Simulation.h"
 #include "mineshaft/World/World.h"
 
 #include <GL/glew.h>
@@ -20,6 +24,11 @@ using namespace mc;
 
 Application::Application()
    : camera(*this),
+     chunkSegmentPool(sizeof(ChunkSegment), alignof(ChunkSegment),
+                      "chunk segments"),
+     worldSegmentPool(sizeof(WorldSegment), alignof(WorldSegment),
+                      "world segments"),
+     assets(*this),
      events(*this),
      blockTextures(),
      defaultFont(*this)
@@ -29,6 +38,15 @@ Application::Application()
 
 Application::~Application()
 {
+   // Finish the background jobs while everything they reference is alive.
+   jobs.stop();
+
+   // The world releases GL buffers, so it has to go before the context.
+   loadedSave.reset();
+   gpuProfiler.clear();
+   assets.clear();
+   camera.clear();
+
    for (auto &T : loadedTextures) {
       T.~BasicTexture();
    }
@@ -170,10 +188,36 @@ static void handleKeyPressed(EventDispatcher &events, const Event &event)
       break;
    case GLFW_KEY_F3:
       app.renderDebugInfo = !app.renderDebugInfo;
+      reschedule = false;
+      break;
+   case GLFW_KEY_F4:
+      if (Profiler::exportChromeTrace("mineshaft-trace.json")) {
+         llvm::errs() << "Wrote profile to mineshaft-trace.json\n";
+      }
+      else {
+         llvm::errs() << "Failed to write mineshaft-trace.json\n";
+      }
+
       reschedule = false;
       break;
    case GLFW_KEY_F5:
       app.getCamera().cycleCameraMode();
+      reschedule = false;
+      break;
+   case GLFW_KEY_F6:
+      app.renderMetrics = !app.renderMetrics;
+      reschedule = false;
+      break;
+   case GLFW_KEY_F7:
+      if (Metrics::getDumpInterval() > 0) {
+         Metrics::setDumpInterval(0);
+         llvm::errs() << "Stopped dumping metrics\n";
+      }
+      else {
+         Metrics::setDumpInterval(5.0f);
+         llvm::errs() << "Dumping metrics to mineshaft-metrics.log\n";
+      }
+
       reschedule = false;
       break;
 #ifndef NDEBUG
@@ -318,20 +362,47 @@ bool Application::initialize()
    return false;
 }
 
-int Application::runGameLoop()
+bool Application::initializeHeadless()
 {
-   worldGenWorker.start();
+   headless = true;
+
+   // Meshing only needs the size of a block texture within the atlas.
+   auto atlas = TextureAtlas::fromFile(BasicTexture::DIFFUSE, "blocks.png",
+                                       16.0f, 16.0f, false);
 
+   if (!atlas) {
+      fprintf(stderr, "Failed to load the block textures\n");
+      return true;
+   }
+
+   blockTextures = std::move(*atlas);
+   return false;
+}
+
+int Application::runGameLoop()
+{
    int errorCode = 0;
    bool firstFrame = true;
 
+   Profiler::setThreadName("Main thread");
+
    do {
+      uint64_t frameStart = Profiler::now();
+      Profiler::beginFrame();
+      gpuProfiler.beginFrame();
+
       // Clear the screen.
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
       // Update camera time.
       camera.updateCurrentTime();
 
+      // Upload the assets that finished loading in the background.
+      {
+         MC_PROFILE_SCOPE("uploadAssets");
+         assets.update();
+      }
+
       switch (gameState) {
       case GameState::MainMenu:
          errorCode = handleMainMenu();
@@ -348,12 +419,19 @@ int Application::runGameLoop()
       events.dispatchEvents();
 
       // Render and poll events.
-      glfwSwapBuffers(window);
-      glfwPollEvents();
+      {
+         MC_PROFILE_SCOPE("swapBuffers");
+         glfwSwapBuffers(window);
+         glfwPollEvents();
+      }
 
       // Update camera time.
       camera.updateLastTime();
 
+      static MetricHistogram &frameTime = Metrics::getHistogram("frame.time.us");
+      frameTime.record((Profiler::now() - frameStart) / 1000);
+      updateMetrics();
+
 #ifdef __APPLE__
       if (firstFrame) {
          int x, y;
@@ -372,6 +450,33 @@ int Application::runGameLoop()
    return errorCode;
 }
 
+void Application::updateMetrics()
+{
+   static MetricGauge &chunkSegmentBytes =
+      Metrics::getGauge("memory.chunkSegmentPool");
+   static MetricGauge &worldSegmentBytes =
+      Metrics::getGauge("memory.worldSegmentPool");
+   static MetricGauge &allocatorBytes = Metrics::getGauge("memory.allocator");
+   static MetricGauge &numJobs = Metrics::getGauge("queue.jobs");
+   static MetricGauge &numAssets = Metrics::getGauge("queue.assets");
+
+   chunkSegmentBytes.set((int64_t)chunkSegmentPool.getStats().reservedBytes);
+   worldSegmentBytes.set((int64_t)worldSegmentPool.getStats().reservedBytes);
+   {
+      std::lock_guard<std::mutex> guard(allocatorMutex);
+      allocatorBytes.set((int64_t)Allocator.getBytesAllocated());
+   }
+
+   numJobs.set(jobs.getNumQueued());
+   numAssets.set(assets.getNumPendingRequests());
+
+   if (activeWorld) {
+      activeWorld->updateMetrics();
+   }
+
+   Metrics::update();
+}
+
 int Application::handleMainMenu()
 {
    loadedSave = std::make_unique<GameSave>(*this, WorldGenOptions());
@@ -382,6 +487,7 @@ int Application::handleMainMenu()
 
    // Initialize the world around the player on the main thread.
    activeWorld->updatePlayerPosition();
+   activeWorld->getSimulation()->start();
 
    return 0;
 }
@@ -394,30 +500,52 @@ static void worldGenTask(World *world)
 
 int Application::handleMainGame()
 {
+   MC_PROFILE_SCOPE("handleMainGame");
    auto *player = getPlayer();
 
+   // Pick up the entity positions of the latest ticks.
+   activeWorld->getSimulation()->interpolate();
+
    // Update player and camera positions.
    activeWorld->updatePlayerPosition();
-//   worldGenWorker.push_task(&worldGenTask, activeWorld);
+//   jobs.submit<&worldGenTask>(activeWorld);
    activeWorld->updateVisibility();
 
    player->updateViewingDirection(*this);
    camera.computeMatricesFromInputs();
+   camera.updateFrameData();
+
+   // Render the far terrain first, since it clears the depth buffer.
+   if (auto *farTerrain = activeWorld->getFarTerrain()) {
+      MC_PROFILE_SCOPE("renderFarTerrain");
+      camera.renderFarTerrain(*farTerrain);
+   }
 
    // Render UI.
-   camera.renderCrosshair();
-   camera.renderCoordinateSystem();
+   {
+      GPUScope scope(gpuProfiler, GPUPass::UI);
+      camera.renderCrosshair();
+      camera.renderCoordinateSystem();
+   }
 
    // Render chunks.
-   for (Chunk *chunk : activeWorld->getChunksToRender()) {
-      if (camera.boxInFrustum(chunk->getBoundingBox()) != Camera::Outside) {
-         chunk->updateVisibility();
-         chunksToRender.push_back(chunk);
+   {
+      MC_PROFILE_SCOPE("cullChunks");
+      for (Chunk *chunk : activeWorld->getChunksToRender()) {
+         if (camera.boxInFrustum(chunk->getBoundingBox()) != Camera::Outside) {
+            chunk->updateVisibility();
+            chunksToRender.push_back(chunk);
+         }
       }
    }
 
    camera.renderChunks(chunksToRender);
 
+   {
+      MC_PROFILE_SCOPE("renderEntities");
+      camera.renderEntities(*activeWorld);
+   }
+
    auto *activeBlock = camera.getPointedAtBlock(*activeWorld);
    if (activeBlock) {
       camera.renderBorders(*activeBlock);
@@ -428,6 +556,16 @@ int Application::handleMainGame()
       camera.renderDebugOverlay();
    }
 
+   if (renderMetrics) {
+      camera.renderMetricsOverlay();
+   }
+
+   // Draw the text queued in this frame.
+   {
+      GPUScope scope(gpuProfiler, GPUPass::UI);
+      defaultFont.flush();
+   }
+
    chunksToRender.clear();
    return 0;
 }
@@ -458,24 +596,6 @@ Player* Application::getPlayer() const
    return loadedSave->player;
 }
 
-Model* Application::getOrLoadModel(llvm::StringRef fileName)
-{
-   auto It = loadedModels.find(fileName);
-   if (It != loadedModels.end()) {
-      return It->getValue();
-   }
-
-   auto optModel = Model::loadFromFile(*this, fileName);
-   if (!optModel) {
-      return nullptr;
-   }
-
-   Model *model = new(*this) Model(std::move(*optModel));
-   loadedModels[fileName] = model;
-
-   return model;
-}
-
 bool Application::isModelLoaded(llvm::StringRef modelName)
 {
    return loadedModels.count(modelName) != 0;
@@ -503,13 +623,14 @@ BasicTexture* Application::loadTexture(BasicTexture::Kind K,
    fileName += "../assets/textures/";
    fileName += File;
 
-   sf::Image Img;
-   if (!Img.loadFromFile(fileName.str())) {
-      return nullptr;
-   }
+   // The texture is keyed by its short name, so that later requests for the
+   // same file find it.
+   auto *T = new(*this) BasicTexture(K, assets.getPlaceholderTexture(),
+                                     File.str());
+   T->pending = true;
 
-   auto *T = loadTexture(K, Img, fileName.str());
    loadedTextures.InsertNode(T, InsertPos);
+   assets.loadTexture(T, fileName.str());
 
    return T;
 }
@@ -523,7 +644,7 @@ BasicTexture* Application::loadTexture(BasicTexture::Kind K,
 
    GLuint textureID;
    glGenTextures(1, &textureID);
-   glBindTexture(GL_TEXTURE_2D, textureID);
+   RenderState::bindTexture(GL_TEXTURE_2D, textureID);
 
    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Img.getSize().x, Img.getSize().y,
                 0, GL_RGBA, GL_UNSIGNED_BYTE, Img.getPixelsPtr());
@@ -542,7 +663,7 @@ Application::loadCubeMapTexture(BasicTexture::Kind K,
                             const std::array<sf::Image, 6> &textures) {
    GLuint textureID;
    glGenTextures(1, &textureID);
-   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+   RenderState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
    static constexpr unsigned faceOrder[] = {
       // top, bottom, left, right, front, back
@@ -616,6 +737,21 @@ void Application::initializeShader(ShaderKind K)
       FragmentName += "../src/Shader/Shaders/WaterShader";
       break;
    }
+   case FAR_TERRAIN_SHADER: {
+      VertexName += "../src/Shader/Shaders/FarTerrainShader";
+      FragmentName += "../src/Shader/Shaders/FarTerrainShader";
+      break;
+   }
+   case BLOCKY_LIGHT_SHADER: {
+      VertexName += "../src/Shader/Shaders/BlockyLightShader";
+      FragmentName += "../src/Shader/Shaders/BlockyLightShader";
+      break;
+   }
+   case SMOOTH_LIGHT_SHADER: {
+      VertexName += "../src/Shader/Shaders/SmoothLightShader";
+      FragmentName += "../src/Shader/Shaders/SmoothLightShader";
+      break;
+   }
    case TEXTURE_ARRAY_SHADER_INSTANCED: {
       VertexName += "../src/Shader/Shaders/BasicShaderInstanced";
       FragmentName += "../src/Shader/Shaders/BasicShaderTextureArray";
@@ -2,13 +2,20 @@
 #include "mineshaft/Application.h"
 #include "mineshaft/Entity/Player.h"
 #include "mineshaft/Model/Model.h"
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/GPUProfiler.h"
+#include "mineshaft/Support/Metrics.h"
+#include "mineshaft/Support/Profiler.h"
 #include "mineshaft/utils.h"
 #include "mineshaft/World/Chunk.h"
+#include "mineshaft/World/FarTerrain.h"
+#include "mineshaft/World/Simulation.h"
 #include "mineshaft/World/World.h"
 #include "mineshaft/World/WorldGenerator.h"
 
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/Support/Format.h>
 
 #include <cstdio>
@@ -16,6 +23,9 @@
 using namespace glm;
 using namespace mc;
 
+/// The number of draw calls.
+static MetricCounter &numDrawCalls = Metrics::getCounter("render.drawCalls");
+
 Camera::Camera(Application &Ctx, GLFWwindow *window, glm::vec3 position,
                float FOV)
    : app(Ctx), window(window),
@@ -35,6 +45,12 @@ void Camera::initialize(GLFWwindow *window)
    aspectRatio = (float)windowWidth / (float)windowHeight;
 }
 
+void Camera::clear()
+{
+   entityRenderer.clear();
+   frameUniforms.clear();
+}
+
 void Camera::updateCurrentTime()
 {
    currentTime = (float)glfwGetTime();
@@ -251,11 +267,15 @@ Camera::sphereInFrustum(const BoundingSphere &sphere)
 }
 
 Camera::ViewCullingTestResult
-Camera::boxInFrustum(const BoundingBox &box)
+Camera::boxInFrustum(const BoundingBox &box, bool ignoreFarPlane)
 {
    ViewCullingTestResult result = Inside;
 
    for (auto &plane : viewFrustum.allPlanes) {
+      if (ignoreFarPlane && &plane == &viewFrustum.planes.far) {
+         continue;
+      }
+
       int out = 0;
       int in = 0;
 
@@ -351,7 +371,7 @@ void Camera::renderFrustum(const ViewFrustum &viewFrustum)
       }
 
       glGenVertexArrays(1, &VAO);
-      glBindVertexArray(VAO);
+      RenderState::bindVertexArray(VAO);
 
       glGenBuffers(1, &VBO);
       glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -362,7 +382,7 @@ void Camera::renderFrustum(const ViewFrustum &viewFrustum)
                             nullptr);
    }
 
-   glBindVertexArray(VAO);
+   RenderState::bindVertexArray(VAO);
    glDisable(GL_CULL_FACE);
 
    glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -376,9 +396,9 @@ void Camera::renderFrustum(const ViewFrustum &viewFrustum)
    for (int i = 0; i < vertices.size(); i += 6) {
       shader.setUniform("singleColor", colors[i / 6]);
       glDrawArrays(GL_TRIANGLES, i, 6);
+      numDrawCalls.add();
    }
 
-   glBindVertexArray(0);
    glDisableVertexAttribArray(0);
    glEnable(GL_CULL_FACE);
 }
@@ -421,7 +441,7 @@ void Camera::renderCoordinateSystem()
       };
 
       glGenVertexArrays(1, &VAO);
-      glBindVertexArray(VAO);
+      RenderState::bindVertexArray(VAO);
 
       glGenBuffers(1, &VBO);
       glBindBuffer(GL_ARRAY_BUFFER, VBO);
@@ -434,7 +454,7 @@ void Camera::renderCoordinateSystem()
                             nullptr);
    }
 
-   glBindVertexArray(VAO);
+   RenderState::bindVertexArray(VAO);
 
    auto &shader = app.getShader(Application::SINGLE_COLOR_SHADER);
    shader.useShader();
@@ -451,8 +471,7 @@ void Camera::renderCoordinateSystem()
    // z axis
    shader.setUniform("singleColor", glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
    glDrawArrays(GL_LINES, 4, 2);
-
-   glBindVertexArray(0);
+   numDrawCalls.add(3);
    glDisableVertexAttribArray(0);
 }
 
@@ -482,7 +501,7 @@ void Camera::renderCrosshair()
 
    if (!CrosshairVAO) {
       glGenVertexArrays(1, &CrosshairVAO);
-      glBindVertexArray(CrosshairVAO);
+      RenderState::bindVertexArray(CrosshairVAO);
 
       glGenBuffers(1, &CrosshairVBO);
       glBindBuffer(GL_ARRAY_BUFFER, CrosshairVBO);
@@ -497,11 +516,9 @@ void Camera::renderCrosshair()
    shader.useShader();
 
    // Render crosshair
-   glBindVertexArray(CrosshairVAO);
+   RenderState::bindVertexArray(CrosshairVAO);
    glDrawArrays(GL_LINES, 0, 8);
-
-   // Reset values.
-   glBindVertexArray(0);
+   numDrawCalls.add();
 }
 
 void Camera::renderBoundingBox(const mc::BoundingBox &boundingBox,
@@ -518,19 +535,28 @@ void Camera::renderBoundingBox(const mc::BoundingBox &boundingBox,
    mesh.render(shader, viewProjectionMatrices.getMatrix());
 }
 
+void Camera::updateFrameData()
+{
+   FrameData data;
+   data.viewProjectionMatrix = viewProjectionMatrices.getMatrix();
+   data.cameraPosition = glm::vec4(position, 1.0f);
+   data.globalTime = currentTime;
+   data.daylight = 1.0f;
+
+   frameUniforms.update(data);
+}
+
 void Camera::renderChunks(llvm::ArrayRef<const Chunk*> chunks)
 {
+   MC_PROFILE_SCOPE("renderChunks");
    if (chunks.empty()) {
       return;
    }
 
-   const Shader &shader = app.getShader(Application::BASIC_SHADER);
+   const Shader &shader = app.getShader(Application::SMOOTH_LIGHT_SHADER);
    const Shader &waterShader = app.getShader(Application::WATER_SHADER);
 
-   waterShader.useShader();
-   waterShader.setUniform("globalTime", currentTime);
-
-   auto vpMatrix = viewProjectionMatrices.getMatrix();
+   // The view-projection matrix, time and daylight come from the frame data.
    app.blockTextures.bind();
 
    for (auto it = chunks.rbegin(), end_it = chunks.rend(); it != end_it; ++it) {
@@ -539,68 +565,168 @@ void Camera::renderChunks(llvm::ArrayRef<const Chunk*> chunks)
       auto &chunkMesh = chunk->getChunkMesh();
       chunkMesh.finalize();
 
-      // Render terrain.
-      shader.useShader();
-      chunkMesh.terrainMesh.render(shader, vpMatrix);
+      for (auto &section : chunkMesh.sections) {
+         // Render terrain.
+         if (!section.terrainMesh.Indices.empty()) {
+            renderQueue.submit(RenderQueue::Opaque, section.terrainMesh,
+                               shader);
+         }
+
+         // Render translucent block faces.
+         if (!section.translucentMesh.Indices.empty()) {
+            renderQueue.submit(RenderQueue::Blended, section.translucentMesh,
+                               shader);
+         }
+
+         // Render water.
+         if (!section.waterMesh.Indices.empty()) {
+            renderQueue.submit(RenderQueue::Blended, section.waterMesh,
+                               waterShader);
+         }
+      }
    }
 
-   for (auto it = chunks.rbegin(), end_it = chunks.rend(); it != end_it; ++it) {
-      const Chunk *chunk = *it;
-      auto &chunkMesh = chunk->getChunkMesh();
+   auto &gpuProfiler = app.getGPUProfiler();
+   {
+      GPUScope scope(gpuProfiler, GPUPass::OpaqueTerrain);
+      renderQueue.execute(RenderQueue::Opaque);
+   }
+
+   {
+      GPUScope scope(gpuProfiler, GPUPass::Translucent);
+      renderQueue.execute(RenderQueue::Blended);
+   }
+}
+
+void Camera::renderEntities(World &world)
+{
+   const Entity *player = app.getPlayer();
+
+   // Use the entities of the interpolated snapshot rather than the entity
+   // store, which the simulation thread reorders while it holds the world
+   // mutex for a whole tick.
+   for (Entity *entity : world.getSimulation()->getInterpolatedEntities()) {
+      Model *model = entity->getModel();
+      if (!model) {
+         continue;
+      }
 
-      // Render translucent block faces.
-      chunkMesh.translucentMesh.render(shader, vpMatrix);
+      // Don't render the player from the inside.
+      if (entity == player && cameraMode == FirstPerson) {
+         continue;
+      }
 
-      // Render water.
-      if (!chunkMesh.waterMesh.Indices.empty()) {
-         waterShader.useShader();
-         chunkMesh.waterMesh.render(waterShader, vpMatrix);
+      auto box = entity->getBoundingBox().offsetBy(entity->getPosition());
+      if (boxInFrustum(box) == Outside) {
+         continue;
       }
+
+      entityRenderer.addInstance(model, entity->getModelMatrix());
    }
 
-   // Reset values.
-   glBindVertexArray(0);
-   glActiveTexture(GL_TEXTURE0);
+   GPUScope scope(app.getGPUProfiler(), GPUPass::Entities);
+   entityRenderer.flush(app.getShader(Application::BASIC_SHADER_INSTANCED));
 }
 
-const Block *Camera::getPointedAtBlock(World &world)
+void Camera::renderFarTerrain(FarTerrain &farTerrain)
 {
-   unsigned distance = app.gameOptions.interactionDistance;
-   glm::vec3 rd = glm::normalize(direction);
+   farTerrain.finalizeRegions();
 
-   // Follow the ray from the camera position until we hit a block.
-   float length = 0.5f;
-   WorldPosition lastPos;
+   GPUScope scope(app.getGPUProfiler(), GPUPass::FarTerrain);
+
+   const Shader &shader = app.getShader(Application::FAR_TERRAIN_SHADER);
+   shader.useShader();
+
+   // The far terrain uses its own projection, since it is located beyond
+   // the regular far clipping distance.
+   glm::mat4 projection = glm::perspective(
+      glm::radians(FOV),
+      (float)viewportWidth / (float)viewportHeight,
+      MC_BLOCK_SCALE,
+      FAR_TERRAIN_CLIPPING_DISTANCE);
+
+   float fogEnd = (float)app.gameOptions.farRenderDistance
+      * MC_CHUNK_WIDTH * MC_BLOCK_SCALE;
+
+   shader.setUniform("MVP", projection * viewProjectionMatrices.View);
+   shader.setUniform("viewPos", position);
+   shader.setUniform("lightDir", glm::normalize(glm::vec3(-0.3f, -1.0f, -0.5f)));
+   shader.setUniform("fogColor", glm::vec3(app.getBackgroundColor()));
+   shader.setUniform("fogStart", fogEnd * 0.6f);
+   shader.setUniform("fogEnd", fogEnd);
+
+   static constexpr unsigned chunksPerRegion =
+      MC_FAR_TERRAIN_REGION_SIZE * MC_FAR_TERRAIN_REGION_SIZE;
+
+   for (auto &regionPair : farTerrain.getRegions()) {
+      FarTerrainRegion *region = regionPair.second;
+      if (region->state.load() != FarTerrainRegion::State::Ready
+      || region->Indices.empty()) {
+         continue;
+      }
 
-   while (length < (float)distance) {
-      WorldPosition pos = getWorldPosition(position + (rd * length));
-      if (pos == lastPos) {
-         length += 0.5f;
+      if (boxInFrustum(region->boundingBox, true) == Outside) {
          continue;
       }
 
-      auto *block = world.getBlock(pos);
-      if (block && block->isSolid()) {
-         return block;
+      RenderState::bindVertexArray(region->VAO);
+
+      // Draw consecutive runs of chunks that are not rendered as blocks.
+      unsigned first = 0;
+      unsigned count = 0;
+
+      for (unsigned i = 0; i <= chunksPerRegion; ++i) {
+         if (i < chunksPerRegion
+         && !farTerrain.isChunkLoaded(region->getChunkPosition(i))) {
+            if (count++ == 0) {
+               first = i;
+            }
+
+            continue;
+         }
+
+         if (count != 0) {
+            glDrawElements(
+               GL_TRIANGLES,
+               count * FarTerrainRegion::IndicesPerChunk,
+               GL_UNSIGNED_INT,
+               (void*)(first * FarTerrainRegion::IndicesPerChunk * sizeof(unsigned)));
+            numDrawCalls.add();
+         }
+
+         count = 0;
       }
+   }
 
-      length += 0.5f;
-      lastPos = pos;
+   // Make sure the far terrain never covers the regular terrain.
+   glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+const Block *Camera::getPointedAtBlock(World &world)
+{
+   auto hit = world.raycast(position, direction,
+                            (float)app.gameOptions.interactionDistance);
+
+   if (!hit) {
+      return nullptr;
    }
 
-   return nullptr;
+   return hit->block;
 }
 
 void Camera::renderBorders(const mc::Block &block)
 {
-   auto *texture = app.loadTexture(BasicTexture::DIFFUSE, "block_border.png");
-   glActiveTexture(GL_TEXTURE0);
-   glBindTexture(GL_TEXTURE_2D, texture->getTextureID());
+   if (!borderTexture) {
+      borderTexture = app.loadTexture(BasicTexture::DIFFUSE, "block_border.png");
+      borderMesh = Mesh::createBoundingBox(app, BoundingBox::unitCube());
+   }
+
+   RenderState::activeTexture(GL_TEXTURE0);
+   RenderState::bindTexture(GL_TEXTURE_2D, borderTexture->getTextureID());
 
    auto &shader = app.getShader(Application::BASIC_SHADER);
    shader.setUniform("textureDiffuse1", 0);
 
-   BoundingBox boundingBox = BoundingBox::unitCube();
    auto scaledMatrix = glm::scale(
       glm::translate(glm::mat4(1.0f),
          getScenePosition(block.getPosition()) + MC_BLOCK_SCALE / 2.f),
@@ -608,8 +734,8 @@ void Camera::renderBorders(const mc::Block &block)
 
    scaledMatrix = glm::translate(scaledMatrix, glm::vec3(-(MC_BLOCK_SCALE/2.f)));
 
-   Mesh m = Mesh::createBoundingBox(app, boundingBox);
-   m.render(shader, viewProjectionMatrices.getMatrix(), scaledMatrix);
+   GPUScope scope(app.getGPUProfiler(), GPUPass::Borders);
+   borderMesh.render(shader, viewProjectionMatrices.getMatrix(), scaledMatrix);
 }
 
 llvm::StringRef getBiomeName(Biome b)
@@ -631,9 +757,15 @@ void Camera::renderDebugOverlay()
    auto playerPos = app.getPlayer()->getPosition();
    auto chunkPos = getChunkPosition(playerPos);
 
-   std::string debugInfo;
-   llvm::raw_string_ostream OS(debugInfo);
-   auto biomeName = getBiomeName(app.activeWorld->getChunk(chunkPos)->getBiome());
+   // Formatted on the stack, the font caches the layout while it doesn't
+   // change.
+   llvm::SmallString<1024> debugInfo;
+   llvm::raw_svector_ostream OS(debugInfo);
+   auto *chunk = app.activeWorld->getChunk(chunkPos, false);
+   llvm::StringRef biomeName = "loading";
+   if (chunk && chunk->isReady()) {
+      biomeName = getBiomeName(chunk->getBiome());
+   }
 
    OS << "Mineshaft v0.01a" << "\n";
    OS << "Player x: " << llvm::format("%0.2f", playerPos.x)
@@ -641,11 +773,82 @@ void Camera::renderDebugOverlay()
       << " z: " << llvm::format("%0.2f", playerPos.z) << "\n";
    OS << "Chunk x: " << chunkPos.x
       << " z: " << chunkPos.z << " (" << biomeName << ")\n";
+   OS << "Queued chunks: " << app.activeWorld->getNumQueuedChunks() << "\n";
+
+   for (auto *pool : { &app.getChunkSegmentPool(),
+                       &app.getWorldSegmentPool() }) {
+      auto stats = pool->getStats();
+      OS << "Pool " << pool->getName() << ": " << stats.liveObjects
+         << " live, " << stats.peakLiveObjects << " peak, "
+         << llvm::format("%0.1f", stats.reservedBytes / (1024.0 * 1024.0))
+         << " MiB\n";
+   }
+
+   // Where the time of the last frame went.
+   ProfileFrameSummary profile;
+   Profiler::summarizeLastFrame(profile);
+
+   auto printZone = [&](const ProfileZoneSummary &zone) {
+      OS.indent(2 * (zone.depth + 1)) << zone.name << ": "
+         << llvm::format("%0.2f", zone.time / 1e6) << " ms";
+
+      if (zone.count > 1) {
+         OS << " (" << zone.count << "x)";
+      }
+
+      OS << "\n";
+   };
+
+   OS << "Frame: " << llvm::format("%0.2f", profile.frameTime / 1e6)
+      << " ms\n";
+
+   for (auto &zone : profile.mainThreadZones) {
+      printZone(zone);
+   }
+
+   if (!profile.backgroundZones.empty()) {
+      OS << "Background:\n";
+      for (auto &zone : profile.backgroundZones) {
+         printZone(zone);
+      }
+   }
+
+   // The GPU times lag a few frames behind.
+   auto &gpuProfiler = app.getGPUProfiler();
+   if (gpuProfiler.isSupported()) {
+      OS << "GPU: " << llvm::format("%0.2f", gpuProfiler.getTotalTime() / 1e6)
+         << " ms";
+
+      if (auto numMissed = gpuProfiler.getNumMissedFrames()) {
+         OS << " (" << numMissed << " late)";
+      }
+
+      OS << "\n";
+
+      for (unsigned i = 0; i < GPUProfiler::NumPasses; ++i) {
+         auto pass = (GPUPass)i;
+         OS.indent(2) << GPUProfiler::getPassName(pass) << ": "
+            << llvm::format("%0.2f", gpuProfiler.getPassTime(pass) / 1e6)
+            << " ms\n";
+      }
+   }
 
    app.defaultFont.renderText(OS.str(), glm::vec2(2.0f, 2.0f),
                               3.0f);
 }
 
+void Camera::renderMetricsOverlay()
+{
+   llvm::SmallString<2048> metrics;
+   llvm::raw_svector_ostream OS(metrics);
+   Metrics::print(OS);
+
+   // Next to the debug overlay. The position is scaled with the text.
+   constexpr float scale = 3.0f;
+   app.defaultFont.renderText(
+      OS.str(), glm::vec2((float)viewportWidth / (2.0f * scale), 2.0f), scale);
+}
+
 const glm::vec3 &Camera::getPosition() const
 {
    return position;
@@ -52,37 +52,49 @@ glm::mat4 Entity::getModelMatrix() const
    return glm::translate(glm::mat4(1.0f), position);
 }
 
-bool MovableEntity::wouldCollide(Application &Ctx, const glm::vec3 &newPos) const
+void MovableEntity::requestMovement(const glm::vec3 &delta)
 {
-   if (!collides) {
-      return false;
-   }
-
-   BoundingBox newBoundingBox = boundingBox.offsetBy(newPos);
+   std::lock_guard<std::mutex> guard(inputMutex);
+   pendingMovement += delta;
+}
 
-   // Check surrounding blocks.
-   int blockWidth = std::ceil(boundingBox.maxX - boundingBox.minX / MC_BLOCK_SCALE) + 1;
-   int blockHeight = std::ceil((boundingBox.maxY - boundingBox.minY) / MC_BLOCK_SCALE) + 1;
-   int blockDepth = std::ceil((boundingBox.maxZ - boundingBox.minZ) / MC_BLOCK_SCALE) + 1;
+void MovableEntity::setPosition(const glm::vec3 &position)
+{
+   std::lock_guard<std::mutex> guard(inputMutex);
+   pendingPosition = position;
+   hasPendingPosition = true;
+}
 
-   auto worldPos = getWorldPosition(newPos);
+void MovableEntity::setMovementKind(MovementKind k)
+{
+   std::lock_guard<std::mutex> guard(inputMutex);
+   movementKind = k;
+}
 
-   for (int x = worldPos.x - blockWidth; x < worldPos.x + blockWidth; ++x) {
-      for (int y = worldPos.y - blockHeight; y < worldPos.y + blockHeight; ++y) {
-         for (int z = worldPos.z - blockDepth; z < worldPos.z + blockDepth; ++z) {
-            auto *block = Ctx.activeWorld->getBlock(WorldPosition(x, y, z));
+void MovableEntity::applyInput(ScenePosition &simulatedPosition,
+                               glm::vec3 &velocity, uint8_t &flags,
+                               glm::vec3 &movement) {
+   std::lock_guard<std::mutex> guard(inputMutex);
 
-            if (block && !block->isTransparent()) {
-               if (newBoundingBox.collidesWith(block->getBoundingBox())) {
-                  return true;
-               }
-            }
-         }
-      }
+   if (hasPendingPosition) {
+      simulatedPosition = pendingPosition;
+      hasPendingPosition = false;
+   }
+   if (pendingJumpVelocity != 0.0f) {
+      velocity.y = pendingJumpVelocity;
+      pendingJumpVelocity = 0.0f;
    }
 
-   // TODO consider other entities.
-   return false;
+   movement += pendingMovement;
+   pendingMovement = glm::vec3(0.0f);
+
+   flags = 0;
+   if (collides) {
+      flags |= EntityStore::Collides;
+   }
+   if (movementKind == MovementKind::Walking) {
+      flags |= EntityStore::HasGravity;
+   }
 }
 
 bool MovableEntity::strafeForward(Application &Ctx, float speed)
@@ -99,11 +111,7 @@ bool MovableEntity::strafeForward(Application &Ctx, float speed)
       break;
    }
 
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(newPos - position);
    return true;
 }
 
@@ -121,12 +129,7 @@ bool MovableEntity::strafeBackward(Application &Ctx, float speed)
       break;
    }
 
-
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(newPos - position);
    return true;
 }
 
@@ -144,11 +147,7 @@ bool MovableEntity::strafeLeft(Application &Ctx, float speed)
       break;
    }
 
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(newPos - position);
    return true;
 }
 
@@ -166,84 +165,32 @@ bool MovableEntity::strafeRight(Application &Ctx, float speed)
       break;
    }
 
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(newPos - position);
    return true;
 }
 
 bool MovableEntity::moveUp(Application &Ctx, float speed)
 {
    float deltaTime = Ctx.getCamera().getElapsedTime();
-   auto newPos = position + (glm::vec3(0.0f, 1.0f, 0.0f) * deltaTime * speed);
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(glm::vec3(0.0f, 1.0f, 0.0f) * deltaTime * speed);
    return true;
 }
 
 bool MovableEntity::moveDown(Application &Ctx, float speed)
 {
    float deltaTime = Ctx.getCamera().getElapsedTime();
-   auto newPos = position - (glm::vec3(0.0f, 1.0f, 0.0f) * deltaTime * speed);
-   if (wouldCollide(Ctx, newPos)) {
-      return false;
-   }
-
-   position = newPos;
+   requestMovement(glm::vec3(0.0f, -1.0f, 0.0f) * deltaTime * speed);
    return true;
 }
 
 void MovableEntity::initiateJump(Application &Ctx, float height, float speed)
 {
-   verticalVelocity = height * speed;
+   std::lock_guard<std::mutex> guard(inputMutex);
+   pendingJumpVelocity = height * speed;
 }
 
 void MovableEntity::updateVectors(Application &Ctx)
 {
-   // Compute time difference between current and last frame
-   float deltaTime = Ctx.getCamera().getElapsedTime();
-
-   // Amount of vertical velocity lost in a second.
-   static constexpr float gravity = 9.81f;
-   static constexpr float maxVelocity = gravity * 10;
-   static constexpr float velocityDecrease = 95.0f;
-
-   if (verticalVelocity == 0) {
-      if (movementKind == MovementKind::Walking) {
-         verticalVelocity = -gravity;
-      }
-   }
-   else {
-      auto newPos = position;
-      newPos.y += verticalVelocity * deltaTime;
-
-      if (wouldCollide(Ctx, newPos)) {
-         // Restore default negative velocity.
-         if (movementKind == MovementKind::Walking) {
-            verticalVelocity = -gravity;
-         }
-         else {
-            verticalVelocity = 0.0f;
-         }
-      }
-      else {
-         position = newPos;
-         verticalVelocity -= velocityDecrease * deltaTime;
-
-         if (verticalVelocity > maxVelocity) {
-            verticalVelocity = maxVelocity;
-         }
-         else if (verticalVelocity < -maxVelocity) {
-            verticalVelocity = -maxVelocity;
-         }
-      }
-   }
-
    switch (movementKind) {
    case MovementKind::Walking: {
       // When walking, only the x and z directions can be chaned.
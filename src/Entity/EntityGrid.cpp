@@ -0,0 +1,236 @@
+#include "mineshaft/Entity/EntityGrid.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace mc;
+
+WorldPosition EntityGrid::getCell(const glm::vec3 &pos)
+{
+   return WorldPosition((int)std::floor(pos.x / CellSize),
+                        (int)std::floor(pos.y / CellSize),
+                        (int)std::floor(pos.z / CellSize));
+}
+
+void EntityGrid::addToCells(EntityID id, const WorldPosition &min,
+                            const WorldPosition &max) {
+   for (int x = min.x; x <= max.x; ++x) {
+      for (int y = min.y; y <= max.y; ++y) {
+         for (int z = min.z; z <= max.z; ++z) {
+            cells[WorldPosition(x, y, z)].push_back(id);
+         }
+      }
+   }
+}
+
+void EntityGrid::removeFromCells(EntityID id, const WorldPosition &min,
+                                 const WorldPosition &max) {
+   for (int x = min.x; x <= max.x; ++x) {
+      for (int y = min.y; y <= max.y; ++y) {
+         for (int z = min.z; z <= max.z; ++z) {
+            auto it = cells.find(WorldPosition(x, y, z));
+            assert(it != cells.end() && "entity not in its cell!");
+
+            // Cells hold only a handful of entities, so the order is not
+            // worth preserving.
+            auto &cell = it->second;
+            auto entityIt = std::find(cell.begin(), cell.end(), id);
+            *entityIt = cell.back();
+            cell.pop_back();
+
+            if (cell.empty()) {
+               cells.erase(it);
+            }
+         }
+      }
+   }
+}
+
+void EntityGrid::update(EntityID id, const BoundingBox &box)
+{
+   if (id >= entries.size()) {
+      entries.resize(id + 1);
+   }
+
+   auto &entry = entries[id];
+   entry.box = box;
+
+   auto minCell = getCell(glm::vec3(box.minX, box.minY, box.minZ));
+   auto maxCell = getCell(glm::vec3(box.maxX, box.maxY, box.maxZ));
+
+   if (entry.inserted) {
+      // Most moves stay within the same cells.
+      if (minCell == entry.minCell && maxCell == entry.maxCell) {
+         return;
+      }
+
+      removeFromCells(id, entry.minCell, entry.maxCell);
+   }
+
+   addToCells(id, minCell, maxCell);
+
+   entry.minCell = minCell;
+   entry.maxCell = maxCell;
+   entry.inserted = true;
+}
+
+void EntityGrid::remove(EntityID id)
+{
+   if (id >= entries.size() || !entries[id].inserted) {
+      return;
+   }
+
+   auto &entry = entries[id];
+   removeFromCells(id, entry.minCell, entry.maxCell);
+   entry.inserted = false;
+}
+
+void EntityGrid::queryBox(const BoundingBox &box,
+                          llvm::SmallVectorImpl<EntityID> &result) const {
+   auto min = getCell(glm::vec3(box.minX, box.minY, box.minZ));
+   auto max = getCell(glm::vec3(box.maxX, box.maxY, box.maxZ));
+
+   for (int x = min.x; x <= max.x; ++x) {
+      for (int y = min.y; y <= max.y; ++y) {
+         for (int z = min.z; z <= max.z; ++z) {
+            auto it = cells.find(WorldPosition(x, y, z));
+            if (it == cells.end()) {
+               continue;
+            }
+
+            for (EntityID id : it->second) {
+               auto &entry = entries[id];
+
+               // An entity spanning several cells is only reported from the
+               // first cell it shares with the queried range.
+               if (x != std::max(entry.minCell.x, min.x)
+               || y != std::max(entry.minCell.y, min.y)
+               || z != std::max(entry.minCell.z, min.z)) {
+                  continue;
+               }
+
+               if (entry.box.collidesWith(box)) {
+                  result.push_back(id);
+               }
+            }
+         }
+      }
+   }
+}
+
+void EntityGrid::queryRange(const glm::vec3 &center, float radius,
+                            llvm::SmallVectorImpl<EntityID> &result) const {
+   BoundingBox box;
+   box.minX = center.x - radius;
+   box.maxX = center.x + radius;
+   box.minY = center.y - radius;
+   box.maxY = center.y + radius;
+   box.minZ = center.z - radius;
+   box.maxZ = center.z + radius;
+
+   unsigned first = (unsigned)result.size();
+   queryBox(box, result);
+
+   // Drop the entities that are only in the corners of the box.
+   auto isOutOfRange = [&](EntityID id) {
+      auto &entityBox = entries[id].box;
+      glm::vec3 closest = glm::clamp(
+         center,
+         glm::vec3(entityBox.minX, entityBox.minY, entityBox.minZ),
+         glm::vec3(entityBox.maxX, entityBox.maxY, entityBox.maxZ));
+
+      glm::vec3 diff = closest - center;
+      return glm::dot(diff, diff) > radius * radius;
+   };
+
+   result.erase(std::remove_if(result.begin() + first, result.end(),
+                               isOutOfRange),
+                result.end());
+}
+
+llvm::Optional<EntityRaycastResult>
+EntityGrid::raycast(const glm::vec3 &origin, const glm::vec3 &direction,
+                    float maxDistance, llvm::Optional<EntityID> ignore) const {
+   if (direction == glm::vec3(0.0f) || cells.empty()) {
+      return llvm::None;
+   }
+
+   // Walk the cells along the ray in the same way World::raycast walks the
+   // blocks. Distances are measured in cells until a box is tested.
+   glm::vec3 rd = glm::normalize(direction);
+   glm::vec3 ro = origin / CellSize;
+   float maxT = maxDistance / CellSize;
+
+   WorldPosition cell = getCell(origin);
+   int *cellCoords[3] = { &cell.x, &cell.y, &cell.z };
+
+   int step[3];
+   float tMax[3];
+   float tDelta[3];
+
+   for (int axis = 0; axis < 3; ++axis) {
+      if (rd[axis] > 0.0f) {
+         step[axis] = 1;
+         tDelta[axis] = 1.0f / rd[axis];
+         tMax[axis] = ((float)*cellCoords[axis] + 1.0f - ro[axis]) * tDelta[axis];
+      }
+      else if (rd[axis] < 0.0f) {
+         step[axis] = -1;
+         tDelta[axis] = -1.0f / rd[axis];
+         tMax[axis] = (ro[axis] - (float)*cellCoords[axis]) * tDelta[axis];
+      }
+      else {
+         step[axis] = 0;
+         tDelta[axis] = std::numeric_limits<float>::infinity();
+         tMax[axis] = std::numeric_limits<float>::infinity();
+      }
+   }
+
+   llvm::Optional<EntityRaycastResult> closestHit;
+   float t = 0.0f;
+
+   while (t <= maxT) {
+      auto it = cells.find(cell);
+      if (it != cells.end()) {
+         for (EntityID id : it->second) {
+            if (ignore && *ignore == id) {
+               continue;
+            }
+
+            auto hit = entries[id].box.intersects(origin, rd, 0.0f,
+                                                  maxDistance);
+            if (!hit.first) {
+               continue;
+            }
+
+            // The hit point is behind the origin if it's inside of the box.
+            float distance = std::max(glm::dot(hit.second - origin, rd), 0.0f);
+            if (!closestHit || distance < closestHit->distance) {
+               closestHit = EntityRaycastResult();
+               closestHit->id = id;
+               closestHit->distance = distance;
+            }
+         }
+      }
+
+      // Boxes in the following cells can't be closer than a hit that lies
+      // before the end of this cell.
+      int axis = 0;
+      if (tMax[1] < tMax[axis]) {
+         axis = 1;
+      }
+      if (tMax[2] < tMax[axis]) {
+         axis = 2;
+      }
+
+      if (closestHit && closestHit->distance <= tMax[axis] * CellSize) {
+         break;
+      }
+
+      t = tMax[axis];
+      tMax[axis] += tDelta[axis];
+      *cellCoords[axis] += step[axis];
+   }
+
+   return closestHit;
+}
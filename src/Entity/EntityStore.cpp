@@ -0,0 +1,127 @@
+#include "mineshaft/Entity/EntityStore.h"
+
+using namespace mc;
+
+void EntityStore::swapSlots(unsigned a, unsigned b)
+{
+   if (a == b) {
+      return;
+   }
+
+   std::swap(owners[a], owners[b]);
+   std::swap(positions[a], positions[b]);
+   std::swap(velocities[a], velocities[b]);
+   std::swap(boundingBoxes[a], boundingBoxes[b]);
+   std::swap(chunks[a], chunks[b]);
+   std::swap(flags[a], flags[b]);
+   std::swap(ids[a], ids[b]);
+
+   slots[ids[a]] = a;
+   slots[ids[b]] = b;
+}
+
+void EntityStore::activate(EntityID id)
+{
+   if (isActive(id)) {
+      return;
+   }
+
+   swapSlots(slots[id], numActive++);
+}
+
+void EntityStore::deactivate(EntityID id)
+{
+   if (!isActive(id)) {
+      return;
+   }
+
+   swapSlots(slots[id], --numActive);
+}
+
+EntityID EntityStore::addEntity(Entity *owner, const ScenePosition &position,
+                                const BoundingBox &boundingBox,
+                                uint8_t entityFlags) {
+   auto id = (EntityID)slots.size();
+   auto chunkPos = getChunkPosition(position);
+
+   slots.push_back((unsigned)ids.size());
+   ids.push_back(id);
+   owners.push_back(owner);
+   positions.push_back(position);
+   velocities.emplace_back(0.0f);
+   boundingBoxes.push_back(boundingBox);
+   chunks.push_back(chunkPos);
+   flags.push_back(entityFlags);
+
+   chunkBuckets[chunkPos].push_back(id);
+   grid.update(id, boundingBox.offsetBy(position));
+
+   if (activeArea.contains(chunkPos)) {
+      activate(id);
+   }
+
+   return id;
+}
+
+void EntityStore::setActiveArea(const ChunkArea &area)
+{
+   ChunkArea previousArea = activeArea;
+   activeArea = area;
+
+   // Only the occupied chunks are visited, so this is independent of the
+   // size of the area.
+   for (auto &bucket : chunkBuckets) {
+      bool wasActive = previousArea.contains(bucket.first);
+      bool isNowActive = area.contains(bucket.first);
+
+      if (wasActive == isNowActive) {
+         continue;
+      }
+
+      for (EntityID id : bucket.second) {
+         if (isNowActive) {
+            activate(id);
+         }
+         else {
+            deactivate(id);
+         }
+      }
+   }
+}
+
+void EntityStore::updateGrid(EntityID id)
+{
+   unsigned slot = slots[id];
+   grid.update(id, boundingBoxes[slot].offsetBy(positions[slot]));
+}
+
+void EntityStore::updateChunk(EntityID id)
+{
+   unsigned slot = slots[id];
+   auto chunkPos = getChunkPosition(positions[slot]);
+
+   if (chunkPos == chunks[slot]) {
+      return;
+   }
+
+   // Move the entity to its new bucket.
+   auto it = chunkBuckets.find(chunks[slot]);
+   assert(it != chunkBuckets.end() && "entity not in its chunk bucket!");
+
+   auto &bucket = it->second;
+   bucket.erase(std::find(bucket.begin(), bucket.end(), id));
+
+   if (bucket.empty()) {
+      chunkBuckets.erase(it);
+   }
+
+   chunks[slot] = chunkPos;
+   chunkBuckets[chunkPos].push_back(id);
+
+   if (activeArea.contains(chunkPos)) {
+      activate(id);
+   }
+   else {
+      deactivate(id);
+   }
+}
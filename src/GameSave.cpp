@@ -6,12 +6,6 @@
 
 using namespace mc;
 
-GameSave::GameSave(World &&world,
-                   WorldGenerator *worldGenerator,
-                   Player *player)
-   : overworld(std::move(world)), worldGenerator(worldGenerator), player(player)
-{ }
-
 GameSave::GameSave(Application &app, WorldGenOptions options)
    : overworld(app),
      worldGenerator(new(app) DefaultTerrainGenerator(&overworld, options)),
@@ -0,0 +1,156 @@
+#include "mineshaft/Model/InstancedRenderer.h"
+
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/Metrics.h"
+
+#include <GL/glew.h>
+
+#include <cstring>
+
+using namespace mc;
+
+/// The number of draw calls.
+static MetricCounter &numDrawCalls = Metrics::getCounter("render.drawCalls");
+
+/// The first attribute location of the instance matrix. A matrix takes up
+/// four consecutive locations, one per column.
+static constexpr GLuint InstanceMatrixLocation = 3;
+
+InstancedRenderer::~InstancedRenderer()
+{
+   clear();
+}
+
+void InstancedRenderer::clear()
+{
+   if (!instanceBuffer) {
+      return;
+   }
+
+   glDeleteBuffers(1, &instanceBuffer);
+   instanceBuffer = 0;
+   regionCapacity = 0;
+   currentRegion = 0;
+}
+
+void InstancedRenderer::addInstance(const Model *model,
+                                    const glm::mat4 &modelMatrix) {
+   auto it = batchIndices.find(model);
+   if (it == batchIndices.end()) {
+      it = batchIndices.try_emplace(model, (unsigned)batches.size()).first;
+      batches.emplace_back(model, std::vector<glm::mat4>());
+   }
+
+   batches[it->second].second.push_back(modelMatrix);
+   ++numInstances;
+}
+
+void InstancedRenderer::reserveInstances()
+{
+   if (!instanceBuffer) {
+      glGenBuffers(1, &instanceBuffer);
+   }
+   else if (numInstances <= regionCapacity) {
+      return;
+   }
+
+   regionCapacity = std::max(numInstances + numInstances / 2, 256u);
+
+   // This orphans the old storage, so regions that are still in use by the
+   // GPU are not overwritten.
+   glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+   glBufferData(GL_ARRAY_BUFFER,
+                NumRegions * regionCapacity * sizeof(glm::mat4),
+                nullptr, GL_STREAM_DRAW);
+}
+
+void InstancedRenderer::setInstanceAttributes(size_t offset)
+{
+   for (GLuint i = 0; i < 4; ++i) {
+      GLuint location = InstanceMatrixLocation + i;
+
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void*)(offset + i * sizeof(glm::vec4)));
+      glVertexAttribDivisor(location, 1);
+   }
+}
+
+void InstancedRenderer::resetInstanceAttributes()
+{
+   for (GLuint i = 0; i < 4; ++i) {
+      glVertexAttribDivisor(InstanceMatrixLocation + i, 0);
+      glDisableVertexAttribArray(InstanceMatrixLocation + i);
+   }
+}
+
+void InstancedRenderer::flush(const Shader &shader)
+{
+   if (!numInstances) {
+      return;
+   }
+
+   reserveInstances();
+
+   size_t regionOffset = currentRegion * regionCapacity * sizeof(glm::mat4);
+
+   // The region was last used NumRegions frames ago, so there's no need to
+   // wait for the GPU before writing to it.
+   glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+   auto *matrices = (glm::mat4*)glMapBufferRange(
+      GL_ARRAY_BUFFER, regionOffset, numInstances * sizeof(glm::mat4),
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+   if (!matrices) {
+      for (auto &batch : batches) {
+         batch.second.clear();
+      }
+
+      numInstances = 0;
+      return;
+   }
+
+   for (auto &batch : batches) {
+      auto &batchMatrices = batch.second;
+      std::memcpy(matrices, batchMatrices.data(),
+                  batchMatrices.size() * sizeof(glm::mat4));
+
+      matrices += batchMatrices.size();
+   }
+
+   glUnmapBuffer(GL_ARRAY_BUFFER);
+
+   size_t offset = regionOffset;
+   for (auto &batch : batches) {
+      auto numBatchInstances = (GLsizei)batch.second.size();
+      if (!numBatchInstances) {
+         continue;
+      }
+
+      for (auto &mesh : batch.first->getMeshes()) {
+         if (mesh.Indices.empty()) {
+            continue;
+         }
+
+         mesh.bind(shader);
+
+         glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+         setInstanceAttributes(offset);
+
+         glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)mesh.Indices.size(),
+                                 GL_UNSIGNED_INT, nullptr, numBatchInstances);
+         numDrawCalls.add();
+
+         resetInstanceAttributes();
+      }
+
+      offset += numBatchInstances * sizeof(glm::mat4);
+
+      // Keep the vectors around, the same models are likely to be drawn in
+      // the next frame.
+      batch.second.clear();
+   }
+
+   currentRegion = (currentRegion + 1) % NumRegions;
+   numInstances = 0;
+}
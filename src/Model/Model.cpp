@@ -1,5 +1,8 @@
 #include "mineshaft/Application.h"
 #include "mineshaft/Model/Model.h"
+#include "mineshaft/Model/OBJParser.h"
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/Metrics.h"
 #include "mineshaft/utils.h"
 #include "mineshaft/World/Block.h"
 
@@ -182,11 +185,14 @@ Mesh::Mesh(mc::Mesh &&other) noexcept
    : Vertices(move(other.Vertices)),
      Indices(move(other.Indices)),
      Textures(move(other.Textures)),
-     VAO(other.VAO), VBO(other.VBO), EBO(other.EBO)
+     VAO(other.VAO), VBO(other.VBO), EBO(other.EBO),
+     VertexCapacity(other.VertexCapacity), IndexCapacity(other.IndexCapacity)
 {
    other.VAO = 0;
    other.VBO = 0;
    other.EBO = 0;
+   other.VertexCapacity = 0;
+   other.IndexCapacity = 0;
 }
 
 Mesh& Mesh::operator=(Mesh &&other) noexcept
@@ -197,12 +203,35 @@ Mesh& Mesh::operator=(Mesh &&other) noexcept
    std::swap(VAO, other.VAO);
    std::swap(VBO, other.VBO);
    std::swap(EBO, other.EBO);
+   std::swap(VertexCapacity, other.VertexCapacity);
+   std::swap(IndexCapacity, other.IndexCapacity);
 
    return *this;
 }
 
+/// The number of draw calls.
+static MetricCounter &numDrawCalls = Metrics::getCounter("render.drawCalls");
+
+/// The size of the GPU buffers of all meshes.
+static MetricGauge &meshBufferBytes = Metrics::getGauge("gpu.meshBufferBytes");
+
+/// \return The size of GPU buffers with the given capacities.
+static int64_t getBufferBytes(unsigned numVertices, unsigned numIndices)
+{
+   return (int64_t)numVertices * sizeof(Vertex)
+      + (int64_t)numIndices * sizeof(unsigned);
+}
+
 Mesh::~Mesh()
 {
+   // Meshes that were never uploaded, e.g. in headless mode, own no buffers.
+   if (!VAO) {
+      return;
+   }
+
+   meshBufferBytes.add(-getBufferBytes(VertexCapacity, IndexCapacity));
+
+   RenderState::forgetVertexArray(VAO);
    glDeleteVertexArrays(1, &VAO);
    glDeleteBuffers(1, &EBO);
    glDeleteBuffers(1, &VBO);
@@ -394,7 +423,7 @@ void Mesh::initializeMesh()
    glGenBuffers(1, &VBO);
    glGenBuffers(1, &EBO);
 
-   glBindVertexArray(VAO);
+   RenderState::bindVertexArray(VAO);
    glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
    glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertex),
@@ -404,6 +433,10 @@ void Mesh::initializeMesh()
    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned),
                 Indices.data(), GL_STATIC_DRAW);
 
+   VertexCapacity = (unsigned)Vertices.size();
+   IndexCapacity = (unsigned)Indices.size();
+   meshBufferBytes.add(getBufferBytes(VertexCapacity, IndexCapacity));
+
    // vertex positions
    glEnableVertexAttribArray(0);
    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), nullptr);
@@ -418,22 +451,80 @@ void Mesh::initializeMesh()
    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                          (void*)offsetof(Vertex, Normal));
 
-   glBindVertexArray(0);
+   // vertex light and occlusion, locations 3-6 are reserved for instance
+   // matrices
+   glEnableVertexAttribArray(7);
+   glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                         (void*)offsetof(Vertex, Light));
+
+   RenderState::bindVertexArray(0);
+}
+
+void Mesh::updateMesh()
+{
+   if (!VAO) {
+      return initializeMesh();
+   }
+
+   auto numVertices = (unsigned)Vertices.size();
+   auto numIndices = (unsigned)Indices.size();
+
+   RenderState::bindVertexArray(VAO);
+   glBindBuffer(GL_ARRAY_BUFFER, VBO);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+   int64_t oldBytes = getBufferBytes(VertexCapacity, IndexCapacity);
+
+   // Grow the buffers with some slack, since the mesh was modified before and
+   // is likely to be modified again.
+   if (numVertices > VertexCapacity) {
+      VertexCapacity = numVertices + numVertices / 4;
+      glBufferData(GL_ARRAY_BUFFER, VertexCapacity * sizeof(Vertex),
+                   nullptr, GL_DYNAMIC_DRAW);
+   }
+
+   if (numIndices > IndexCapacity) {
+      IndexCapacity = numIndices + numIndices / 4;
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, IndexCapacity * sizeof(unsigned),
+                   nullptr, GL_DYNAMIC_DRAW);
+   }
+
+   meshBufferBytes.add(getBufferBytes(VertexCapacity, IndexCapacity) - oldBytes);
+
+   if (numVertices) {
+      glBufferSubData(GL_ARRAY_BUFFER, 0, numVertices * sizeof(Vertex),
+                      Vertices.data());
+   }
+
+   if (numIndices) {
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, numIndices * sizeof(unsigned),
+                      Indices.data());
+   }
+
+   RenderState::bindVertexArray(0);
 }
 
+/// The maximum number of textures of each kind a mesh can use.
+static constexpr unsigned MaxTexturesPerKind = 4;
+
+/// The sampler uniform names of each texture kind, hashed at compile time
+/// instead of being built for every draw.
+static constexpr UniformName TextureUniformNames[][MaxTexturesPerKind] = {
+   { "textureDiffuse1", "textureDiffuse2", "textureDiffuse3", "textureDiffuse4" },
+   { "textureSpecular1", "textureSpecular2", "textureSpecular3", "textureSpecular4" },
+   { "textureNormal1", "textureNormal2", "textureNormal3", "textureNormal4" },
+   { "textureHeight1", "textureHeight2", "textureHeight3", "textureHeight4" },
+};
+
 void Mesh::bind(const mc::Shader &shader) const
 {
    shader.useShader();
 
-   unsigned int diffuseNr = 1;
-   unsigned int specularNr = 1;
-   unsigned int normalNr = 1;
-   unsigned int heightNr = 1;
-
+   unsigned texturesOfKind[4] = { 0, 0, 0, 0 };
    unsigned NumTextures = (unsigned)Textures.size();
 
    for (unsigned int i = 0; i < NumTextures; i++) {
-      glActiveTexture(GL_TEXTURE0 + i);
+      RenderState::activeTexture(GL_TEXTURE0 + i);
 
       const Texture &T = Textures[i];
       if (T.texture->getGLTextureKind() == GL_TEXTURE_CUBE_MAP) {
@@ -442,33 +533,26 @@ void Mesh::bind(const mc::Shader &shader) const
       else {
          assert(T.texture->getGLTextureKind() == GL_TEXTURE_2D);
 
-         std::string name;
-         switch (T.texture->getKind()) {
-         case BasicTexture::DIFFUSE:
-            name += "textureDiffuse";
-            name += std::to_string(diffuseNr++);
-            break;
-         case BasicTexture::SPECULAR:
-            name += "textureSpecular";
-            name += std::to_string(specularNr++);
-            break;
-         case BasicTexture::NORMAL:
-            name += "textureNormal";
-            name += std::to_string(normalNr++);
-            break;
-         case BasicTexture::HEIGHT:
-            name += "textureHeight";
-            name += std::to_string(heightNr++);
-            break;
-         }
+         // The table rows are in the order of the texture kinds.
+         unsigned kind = T.texture->getKind();
+         unsigned idx = texturesOfKind[kind]++;
+         assert(idx < MaxTexturesPerKind && "too many textures of one kind!");
 
-         shader.setUniform(name.c_str(), (GLint)i);
+         shader.setUniform(TextureUniformNames[kind][idx], (GLint)i);
       }
 
-      glBindTexture(T.texture->getGLTextureKind(), T.texture->getTextureID());
+      RenderState::bindTexture(T.texture->getGLTextureKind(), T.texture->getTextureID());
    }
 
-   glBindVertexArray(VAO);
+   RenderState::bindVertexArray(VAO);
+}
+
+void Mesh::draw() const
+{
+   // The bindings are left in place, RenderState skips rebinding them if
+   // the next draw uses the same ones.
+   glDrawElements(GL_TRIANGLES, Indices.size(), GL_UNSIGNED_INT, nullptr);
+   numDrawCalls.add();
 }
 
 void Mesh::render(const Shader &shader,
@@ -477,12 +561,13 @@ void Mesh::render(const Shader &shader,
    bind(shader);
    shader.setUniform("MVP", viewProjectionMatrix * modelMatrix);
 
-   // Render mesh
-   glDrawElements(GL_TRIANGLES, Indices.size(), GL_UNSIGNED_INT, nullptr);
+   draw();
+}
 
-   // Reset values.
-   glBindVertexArray(0);
-   glActiveTexture(GL_TEXTURE0);
+void Mesh::render(const Shader &shader) const
+{
+   bind(shader);
+   draw();
 }
 
 void Mesh::dump() const
@@ -537,8 +622,24 @@ void Mesh::print(llvm::raw_ostream &OS) const
    OS << "\n";
 }
 
-void ChunkMesh::addFace(Application &C, const Block &block, unsigned faceMask)
+const int ChunkSectionMesh::FaceCorners[6][4][3] = {
+   { { 1, 0, 1 }, { 1, 1, 1 }, { 1, 1, 0 }, { 1, 0, 0 } }, // Right
+   { { 0, 0, 0 }, { 0, 1, 0 }, { 0, 1, 1 }, { 0, 0, 1 } }, // Left
+   { { 0, 1, 1 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 } }, // Top
+   { { 0, 0, 0 }, { 0, 0, 1 }, { 1, 0, 1 }, { 1, 0, 0 } }, // Bottom
+   { { 0, 0, 1 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 0, 1 } }, // Front
+   { { 1, 0, 0 }, { 1, 1, 0 }, { 0, 1, 0 }, { 0, 0, 0 } }, // Back
+};
+
+/// \return The brightness of a face corner, used to pick the quad diagonal.
+static unsigned getCornerBrightness(const glm::u8vec4 &light)
 {
+   return std::max(light.x, light.y) + light.z;
+}
+
+void ChunkSectionMesh::addFace(Application &C, const Block &block,
+                               unsigned faceMask,
+                               const glm::u8vec4 (&vertexLight)[6][4]) {
    auto &boundingBox = block.getBoundingBox();
 
    float blockWidth = C.blockTextures.getTextureWidth();
@@ -564,14 +665,81 @@ void ChunkMesh::addFace(Application &C, const Block &block, unsigned faceMask)
       addCubeFace(face, mesh->Indices, mesh->Vertices, boundingBox,
                   block.getTextureUV(face),
                   blockWidth, blockHeight);
+
+      size_t idx0 = mesh->Vertices.size() - 4;
+      for (unsigned j = 0; j < 4; ++j) {
+         mesh->Vertices[idx0 + j].Light = vertexLight[i][j];
+      }
+
+      // The quad is split along the top left - bottom right diagonal by
+      // default. Split it along the brighter diagonal instead, otherwise the
+      // interpolated light and occlusion is visibly anisotropic.
+      unsigned diag02 = getCornerBrightness(vertexLight[i][0])
+         + getCornerBrightness(vertexLight[i][2]);
+      unsigned diag13 = getCornerBrightness(vertexLight[i][1])
+         + getCornerBrightness(vertexLight[i][3]);
+
+      if (diag02 > diag13) {
+         unsigned *indices = mesh->Indices.data() + mesh->Indices.size() - 6;
+
+         // first triangle (bottom left - bottom right - top right)
+         indices[0] = idx0;
+         indices[1] = idx0 + 3;
+         indices[2] = idx0 + 2;
+
+         // second triangle (bottom left - top right - top left)
+         indices[3] = idx0;
+         indices[4] = idx0 + 2;
+         indices[5] = idx0 + 1;
+      }
+   }
+
+   needsUpload = true;
+}
+
+void ChunkSectionMesh::clear()
+{
+   needsUpload |= !terrainMesh.Vertices.empty()
+      || !translucentMesh.Vertices.empty()
+      || !waterMesh.Vertices.empty();
+
+   terrainMesh.Vertices.clear();
+   terrainMesh.Indices.clear();
+   translucentMesh.Vertices.clear();
+   translucentMesh.Indices.clear();
+   waterMesh.Vertices.clear();
+   waterMesh.Indices.clear();
+}
+
+void ChunkSectionMesh::finalize() const
+{
+   if (!needsUpload) {
+      return;
+   }
+
+   for (Mesh *mesh : { &terrainMesh, &translucentMesh, &waterMesh }) {
+      // Don't create buffers for empty meshes.
+      if (mesh->VAO || !mesh->Vertices.empty()) {
+         mesh->updateMesh();
+      }
    }
+
+   needsUpload = false;
 }
 
 void ChunkMesh::finalize() const
 {
-   terrainMesh.initializeMesh();
-   translucentMesh.initializeMesh();
-   waterMesh.initializeMesh();
+   for (auto &section : sections) {
+      section.finalize();
+   }
+}
+
+Model::Model()
+   : NumMeshes(0),
+     boundingBoxCalculated(false), boundingSphereCalculated(false),
+     MultipleMeshes(nullptr)
+{
+
 }
 
 Model::Model(llvm::MutableArrayRef<Mesh> Meshes)
@@ -788,8 +956,8 @@ void Model::renderNormals(mc::Application &Ctx, glm::vec4 normalColor,
    render(shader, modelMatrix, viewProjectionMatrix);
 }
 
-static void loadTexture(Application &Ctx, aiMaterial *Mat, aiTextureType Kind,
-                        std::vector<Texture> &Textures,
+static void loadTexture(aiMaterial *Mat, aiTextureType Kind,
+                        std::vector<ModelData::TextureRef> &Textures,
                         llvm::StringRef Path) {
    float shininess;
    if (Mat->Get(AI_MATKEY_SHININESS, shininess) != AI_SUCCESS) {
@@ -830,19 +998,17 @@ static void loadTexture(Application &Ctx, aiMaterial *Mat, aiTextureType Kind,
          continue;
       }
 
-      auto TexPtr = Ctx.loadTexture(TextureKind, realFile);
-      if (TexPtr) {
-         Textures.emplace_back(TexPtr, Material{shininess});
-      }
+      Textures.push_back(ModelData::TextureRef{
+         TextureKind, shininess, std::move(realFile) });
    }
 }
 
-static void processMesh(Application &Ctx, aiMesh *M, const aiScene *Scene,
-                        llvm::SmallVectorImpl<Mesh> &Meshes,
+static void processMesh(aiMesh *M, const aiScene *Scene,
+                        std::vector<ModelData::MeshData> &Meshes,
                         llvm::StringRef Path) {
-   std::vector<Vertex> vertices;
-   std::vector<unsigned> indices;
-   std::vector<Texture> textures;
+   auto &Data = Meshes.emplace_back();
+   auto &vertices = Data.Vertices;
+   auto &indices = Data.Indices;
 
    bool hasTexture = M->mTextureCoords[0];
    for (unsigned i = 0; i < M->mNumVertices; i++) {
@@ -873,31 +1039,43 @@ static void processMesh(Application &Ctx, aiMesh *M, const aiScene *Scene,
    // process material
    if (M->mMaterialIndex >= 0) {
       aiMaterial *material = Scene->mMaterials[M->mMaterialIndex];
-      loadTexture(Ctx, material, aiTextureType_DIFFUSE, textures, Path);
-      loadTexture(Ctx, material, aiTextureType_SPECULAR, textures, Path);
-      loadTexture(Ctx, material, aiTextureType_NORMALS, textures, Path);
-      loadTexture(Ctx, material, aiTextureType_HEIGHT, textures, Path);
+      loadTexture(material, aiTextureType_DIFFUSE, Data.Textures, Path);
+      loadTexture(material, aiTextureType_SPECULAR, Data.Textures, Path);
+      loadTexture(material, aiTextureType_NORMALS, Data.Textures, Path);
+      loadTexture(material, aiTextureType_HEIGHT, Data.Textures, Path);
    }
-
-   Meshes.emplace_back(move(vertices), move(indices), move(textures));
 }
 
-static void processNode(Application &Ctx, aiNode *Node, const aiScene *Scene,
-                        llvm::SmallVectorImpl<Mesh> &Meshes,
+static void processNode(aiNode *Node, const aiScene *Scene,
+                        std::vector<ModelData::MeshData> &Meshes,
                         llvm::StringRef Path) {
    // process all the node's meshes (if any)
    for (unsigned int i = 0; i < Node->mNumMeshes; i++) {
-      processMesh(Ctx, Scene->mMeshes[Node->mMeshes[i]], Scene, Meshes, Path);
+      processMesh(Scene->mMeshes[Node->mMeshes[i]], Scene, Meshes, Path);
    }
 
    // then do the same for each of its children
    for (unsigned int i = 0; i < Node->mNumChildren; i++) {
-      processNode(Ctx, Node->mChildren[i], Scene, Meshes, Path);
+      processNode(Node->mChildren[i], Scene, Meshes, Path);
    }
 }
 
 llvm::Optional<Model> Model::loadFromFile(Application &Ctx,
                                           llvm::StringRef FileName) {
+   ModelData Data;
+   if (!importFile(FileName, Data, &Ctx.getJobSystem())) {
+      return llvm::None;
+   }
+
+   return fromData(Ctx, std::move(Data));
+}
+
+bool Model::importFile(llvm::StringRef FileName, ModelData &Data,
+                       JobSystem *Jobs) {
+   if (FileName.endswith_insensitive(".obj")) {
+      return parseOBJFile(FileName, Data, Jobs);
+   }
+
    Assimp::Importer Importer;
    const aiScene *scene = Importer.ReadFile(FileName.str(),
       aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices);
@@ -906,13 +1084,35 @@ llvm::Optional<Model> Model::loadFromFile(Application &Ctx,
    || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
    || !scene->mRootNode) {
       llvm::errs() << "ERROR::ASSIMP::" << Importer.GetErrorString() << "\n";
-      return llvm::None;
+      return false;
    }
 
    llvm::StringRef Path = getPath(FileName);
+   processNode(scene->mRootNode, scene, Data.Meshes, Path);
+
+   return !Data.Meshes.empty();
+}
+
+llvm::Optional<Model> Model::fromData(Application &Ctx, ModelData &&Data)
+{
+   if (Data.Meshes.empty()) {
+      return llvm::None;
+   }
 
    llvm::SmallVector<Mesh, 2> Meshes;
-   processNode(Ctx, scene->mRootNode, scene, Meshes, Path);
+   for (auto &MeshData : Data.Meshes) {
+      std::vector<Texture> textures;
+      for (auto &Ref : MeshData.Textures) {
+         auto TexPtr = Ctx.loadTexture(Ref.Kind, Ref.File);
+         if (TexPtr) {
+            textures.emplace_back(TexPtr, Material{Ref.Shininess});
+         }
+      }
+
+      Meshes.emplace_back(std::move(MeshData.Vertices),
+                          std::move(MeshData.Indices),
+                          std::move(textures));
+   }
 
    return Model(Meshes);
-}
\ No newline at end of file
+}
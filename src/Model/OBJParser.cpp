@@ -0,0 +1,662 @@
+#include "mineshaft/Model/OBJParser.h"
+
+#include "mineshaft/Model/Model.h"
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/utils.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+using namespace mc;
+
+/// Files smaller than this are parsed in a single chunk.
+static constexpr size_t MinChunkSize = 1 << 20;
+
+namespace {
+
+/// A face corner, i.e. one index into each of the position, texture
+/// coordinate and normal lists.
+struct Corner {
+   enum Attribute : uint8_t {
+      Position = 0, TexCoord, Normal,
+   };
+
+   /// The zero-based indices. Relative indices are resolved against the
+   /// chunk they appear in and have to be offset by the chunk's base index.
+   int32_t Indices[3];
+
+   /// The attributes that are present.
+   uint8_t PresentMask;
+
+   /// The attributes whose index is relative to the chunk.
+   uint8_t RelativeMask;
+};
+
+/// A material switch within a chunk.
+struct MaterialUse {
+   /// The index of the first face using the material.
+   size_t FirstFace;
+
+   /// The name of the material.
+   llvm::StringRef Name;
+};
+
+/// The parsed contents of a line-aligned part of the file.
+struct Chunk {
+   const char *Begin;
+   const char *End;
+
+   std::vector<glm::vec3> Positions;
+   std::vector<glm::vec2> TexCoords;
+   std::vector<glm::vec3> Normals;
+
+   /// The corners of all faces.
+   std::vector<Corner> Corners;
+
+   /// The end of each face in \c Corners.
+   std::vector<uint32_t> FaceEnds;
+
+   /// The material switches, ordered by face.
+   std::vector<MaterialUse> Materials;
+
+   /// The referenced material libraries.
+   llvm::SmallVector<llvm::StringRef, 1> MaterialLibs;
+};
+
+/// A material from a material library.
+struct MaterialInfo {
+   float Shininess = 0.0f;
+   std::string DiffuseTexture;
+};
+
+/// Maps position / texture coordinate / normal index triples to output
+/// vertices, using a flat open addressing table with linear probing.
+class VertexDedupTable {
+   struct Slot {
+      int32_t Key[3];
+      uint32_t Value;
+   };
+
+   static constexpr uint32_t EmptySlot = ~0u;
+
+   std::vector<Slot> Slots;
+   size_t NumEntries = 0;
+
+   static size_t hash(const int32_t Key[3])
+   {
+      uint32_t h = (uint32_t)Key[0] * 0x9E3779B1u;
+      h ^= (uint32_t)Key[1] * 0x85EBCA77u;
+      h ^= (uint32_t)Key[2] * 0xC2B2AE3Du;
+      h ^= h >> 15;
+
+      return h;
+   }
+
+   void grow()
+   {
+      std::vector<Slot> OldSlots = std::move(Slots);
+      Slots.assign(std::max<size_t>(OldSlots.size() * 2, 64),
+                   Slot{ { 0, 0, 0 }, EmptySlot });
+
+      size_t Mask = Slots.size() - 1;
+      for (auto &S : OldSlots) {
+         if (S.Value == EmptySlot) {
+            continue;
+         }
+
+         size_t Idx = hash(S.Key) & Mask;
+         while (Slots[Idx].Value != EmptySlot) {
+            Idx = (Idx + 1) & Mask;
+         }
+
+         Slots[Idx] = S;
+      }
+   }
+
+public:
+   /// Find the vertex of a key, or insert \p Value for it.
+   /// \return The vertex of the key and whether it was newly inserted.
+   std::pair<uint32_t, bool> insert(const int32_t Key[3], uint32_t Value)
+   {
+      if ((NumEntries + 1) * 2 > Slots.size()) {
+         grow();
+      }
+
+      size_t Mask = Slots.size() - 1;
+      size_t Idx = hash(Key) & Mask;
+
+      while (Slots[Idx].Value != EmptySlot) {
+         auto &S = Slots[Idx];
+         if (std::memcmp(S.Key, Key, sizeof(S.Key)) == 0) {
+            return { S.Value, false };
+         }
+
+         Idx = (Idx + 1) & Mask;
+      }
+
+      std::memcpy(Slots[Idx].Key, Key, sizeof(Slots[Idx].Key));
+      Slots[Idx].Value = Value;
+      ++NumEntries;
+
+      return { Value, true };
+   }
+};
+
+} // anonymous namespace
+
+static void skipSpaces(const char *&Ptr, const char *End)
+{
+   while (Ptr < End && (*Ptr == ' ' || *Ptr == '\t' || *Ptr == '\r')) {
+      ++Ptr;
+   }
+}
+
+static bool isDigit(char c)
+{
+   return c >= '0' && c <= '9';
+}
+
+/// Parse a float in place, without allocating.
+/// \return false if there is no number at \p Ptr.
+static bool parseFloat(const char *&Ptr, const char *End, float &Value)
+{
+   static constexpr double PowersOfTen[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+   };
+
+   skipSpaces(Ptr, End);
+
+   bool Negative = false;
+   if (Ptr < End && (*Ptr == '-' || *Ptr == '+')) {
+      Negative = *Ptr++ == '-';
+   }
+
+   uint64_t Mantissa = 0;
+   int Exponent = 0;
+   unsigned NumDigits = 0;
+
+   for (; Ptr < End && isDigit(*Ptr); ++Ptr, ++NumDigits) {
+      if (Mantissa < (UINT64_MAX - 9) / 10) {
+         Mantissa = Mantissa * 10 + (*Ptr - '0');
+      }
+      else {
+         ++Exponent;
+      }
+   }
+
+   if (Ptr < End && *Ptr == '.') {
+      for (++Ptr; Ptr < End && isDigit(*Ptr); ++Ptr, ++NumDigits) {
+         if (Mantissa < (UINT64_MAX - 9) / 10) {
+            Mantissa = Mantissa * 10 + (*Ptr - '0');
+            --Exponent;
+         }
+      }
+   }
+
+   if (NumDigits == 0) {
+      return false;
+   }
+
+   if (Ptr < End && (*Ptr == 'e' || *Ptr == 'E')) {
+      ++Ptr;
+
+      bool NegativeExp = false;
+      if (Ptr < End && (*Ptr == '-' || *Ptr == '+')) {
+         NegativeExp = *Ptr++ == '-';
+      }
+
+      int Exp = 0;
+      for (; Ptr < End && isDigit(*Ptr); ++Ptr) {
+         Exp = std::min(Exp * 10 + (*Ptr - '0'), 1000);
+      }
+
+      Exponent += NegativeExp ? -Exp : Exp;
+   }
+
+   double Result = (double)Mantissa;
+   if (Exponent < 0 && -Exponent <= 22) {
+      Result /= PowersOfTen[-Exponent];
+   }
+   else if (Exponent > 0 && Exponent <= 22) {
+      Result *= PowersOfTen[Exponent];
+   }
+   else if (Exponent != 0) {
+      Result *= std::pow(10.0, Exponent);
+   }
+
+   Value = (float)(Negative ? -Result : Result);
+   return true;
+}
+
+/// Parse an integer in place.
+/// \return false if there is no number at \p Ptr.
+static bool parseInt(const char *&Ptr, const char *End, int32_t &Value)
+{
+   bool Negative = false;
+   if (Ptr < End && (*Ptr == '-' || *Ptr == '+')) {
+      Negative = *Ptr++ == '-';
+   }
+
+   if (Ptr == End || !isDigit(*Ptr)) {
+      return false;
+   }
+
+   int64_t Result = 0;
+   for (; Ptr < End && isDigit(*Ptr); ++Ptr) {
+      Result = std::min<int64_t>(Result * 10 + (*Ptr - '0'), INT32_MAX);
+   }
+
+   Value = (int32_t)(Negative ? -Result : Result);
+   return true;
+}
+
+/// \return true if the line at \p Ptr starts with the keyword \p Keyword
+/// followed by whitespace, and advances past it.
+static bool consumeKeyword(const char *&Ptr, const char *End,
+                           llvm::StringRef Keyword) {
+   size_t Len = Keyword.size();
+   if ((size_t)(End - Ptr) <= Len
+   || std::memcmp(Ptr, Keyword.data(), Len) != 0
+   || (Ptr[Len] != ' ' && Ptr[Len] != '\t')) {
+      return false;
+   }
+
+   Ptr += Len;
+   return true;
+}
+
+/// \return The rest of the line at \p Ptr without surrounding whitespace.
+static llvm::StringRef restOfLine(const char *Ptr, const char *End)
+{
+   return llvm::StringRef(Ptr, End - Ptr).trim();
+}
+
+/// Parse a face corner of the form v, v/t, v//n or v/t/n.
+static bool parseCorner(const char *&Ptr, const char *End, const Chunk &C,
+                        Corner &Result) {
+   const size_t Counts[3] = {
+      C.Positions.size(), C.TexCoords.size(), C.Normals.size(),
+   };
+
+   Result.PresentMask = 0;
+   Result.RelativeMask = 0;
+
+   for (unsigned i = 0; i < 3; ++i) {
+      Result.Indices[i] = 0;
+
+      if (i != 0) {
+         if (Ptr == End || *Ptr != '/') {
+            break;
+         }
+
+         ++Ptr;
+      }
+
+      int32_t Idx;
+      if (!parseInt(Ptr, End, Idx)) {
+         if (i == 0) {
+            return false;
+         }
+
+         continue;
+      }
+
+      Result.PresentMask |= 1 << i;
+
+      if (Idx < 0) {
+         // Relative to the last element parsed so far.
+         Result.Indices[i] = (int32_t)Counts[i] + Idx;
+         Result.RelativeMask |= 1 << i;
+      }
+      else {
+         Result.Indices[i] = Idx - 1;
+      }
+   }
+
+   return true;
+}
+
+static void parseChunk(Chunk &C);
+
+/// Job entry point for parsing a chunk.
+static void parseChunkTask(Chunk *C)
+{
+   parseChunk(*C);
+}
+
+static void parseChunk(Chunk &C)
+{
+   const char *Ptr = C.Begin;
+   while (Ptr < C.End) {
+      const char *LineEnd = static_cast<const char*>(
+         std::memchr(Ptr, '\n', C.End - Ptr));
+
+      if (!LineEnd) {
+         LineEnd = C.End;
+      }
+
+      skipSpaces(Ptr, LineEnd);
+
+      if (Ptr + 1 < LineEnd && Ptr[0] == 'v') {
+         float x = 0.0f, y = 0.0f, z = 0.0f;
+
+         switch (Ptr[1]) {
+         case ' ':
+         case '\t':
+            ++Ptr;
+            parseFloat(Ptr, LineEnd, x);
+            parseFloat(Ptr, LineEnd, y);
+            parseFloat(Ptr, LineEnd, z);
+            C.Positions.emplace_back(x, y, z);
+            break;
+         case 't':
+            Ptr += 2;
+            parseFloat(Ptr, LineEnd, x);
+            parseFloat(Ptr, LineEnd, y);
+
+            // Flip the V coordinate, like the assimp import does.
+            C.TexCoords.emplace_back(x, 1.0f - y);
+            break;
+         case 'n':
+            Ptr += 2;
+            parseFloat(Ptr, LineEnd, x);
+            parseFloat(Ptr, LineEnd, y);
+            parseFloat(Ptr, LineEnd, z);
+            C.Normals.emplace_back(x, y, z);
+            break;
+         default:
+            break;
+         }
+      }
+      else if (Ptr + 1 < LineEnd && Ptr[0] == 'f'
+            && (Ptr[1] == ' ' || Ptr[1] == '\t')) {
+         ++Ptr;
+
+         size_t FirstCorner = C.Corners.size();
+         while (true) {
+            skipSpaces(Ptr, LineEnd);
+
+            Corner Cnr;
+            if (Ptr == LineEnd || !parseCorner(Ptr, LineEnd, C, Cnr)) {
+               break;
+            }
+
+            C.Corners.push_back(Cnr);
+         }
+
+         // Ignore degenerate faces.
+         if (C.Corners.size() - FirstCorner < 3) {
+            C.Corners.resize(FirstCorner);
+         }
+         else {
+            C.FaceEnds.push_back((uint32_t)C.Corners.size());
+         }
+      }
+      else if (consumeKeyword(Ptr, LineEnd, "usemtl")) {
+         C.Materials.push_back(MaterialUse{
+            C.FaceEnds.size(), restOfLine(Ptr, LineEnd) });
+      }
+      else if (consumeKeyword(Ptr, LineEnd, "mtllib")) {
+         C.MaterialLibs.push_back(restOfLine(Ptr, LineEnd));
+      }
+
+      // Everything else (comments, objects, groups, smoothing) is ignored.
+      Ptr = LineEnd + 1;
+   }
+}
+
+static void parseMaterialLib(llvm::StringRef File, llvm::StringRef Path,
+                             llvm::StringMap<MaterialInfo> &Materials) {
+   if (File.empty()) {
+      return;
+   }
+
+   std::string RealFile = findFileInDirectories(File, Path.str());
+   if (RealFile.empty()) {
+      return;
+   }
+
+   auto MaybeBuf = llvm::MemoryBuffer::getFile(RealFile, /*IsText=*/false,
+                                               /*RequiresNullTerminator=*/false);
+   if (!MaybeBuf) {
+      return;
+   }
+
+   llvm::StringRef MtlPath = getPath(RealFile);
+   MaterialInfo *Current = nullptr;
+
+   const char *Ptr = MaybeBuf.get()->getBufferStart();
+   const char *End = MaybeBuf.get()->getBufferEnd();
+
+   while (Ptr < End) {
+      const char *LineEnd = static_cast<const char*>(
+         std::memchr(Ptr, '\n', End - Ptr));
+
+      if (!LineEnd) {
+         LineEnd = End;
+      }
+
+      skipSpaces(Ptr, LineEnd);
+
+      if (consumeKeyword(Ptr, LineEnd, "newmtl")) {
+         Current = &Materials[restOfLine(Ptr, LineEnd)];
+      }
+      else if (Current && consumeKeyword(Ptr, LineEnd, "Ns")) {
+         parseFloat(Ptr, LineEnd, Current->Shininess);
+      }
+      else if (Current && consumeKeyword(Ptr, LineEnd, "map_Kd")) {
+         llvm::StringRef Texture = restOfLine(Ptr, LineEnd);
+         if (!Texture.empty()) {
+            Current->DiffuseTexture = findFileInDirectories(Texture,
+                                                            MtlPath.str());
+         }
+      }
+
+      Ptr = LineEnd + 1;
+   }
+}
+
+bool mc::parseOBJFile(llvm::StringRef FileName, ModelData &Data,
+                      JobSystem *Jobs) {
+   auto MaybeBuf = llvm::MemoryBuffer::getFile(FileName, /*IsText=*/false,
+                                               /*RequiresNullTerminator=*/false);
+   if (!MaybeBuf) {
+      llvm::errs() << "ERROR::OBJ::cannot read '" << FileName << "'\n";
+      return false;
+   }
+
+   const char *Begin = MaybeBuf.get()->getBufferStart();
+   const char *End = MaybeBuf.get()->getBufferEnd();
+   size_t Size = End - Begin;
+
+   // Split the file into line-aligned chunks, one per worker and one for the
+   // calling thread.
+   size_t MaxChunks = Jobs ? Jobs->getNumThreads() + 1 : 1;
+   size_t NumChunks = std::max<size_t>(
+      std::min<size_t>(Size / MinChunkSize, MaxChunks), 1);
+
+   std::vector<Chunk> Chunks(NumChunks);
+
+   const char *ChunkBegin = Begin;
+   for (size_t i = 0; i < NumChunks; ++i) {
+      const char *ChunkEnd = End;
+      if (i + 1 < NumChunks) {
+         ChunkEnd = std::max(ChunkBegin, Begin + Size * (i + 1) / NumChunks);
+
+         auto *NewLine = static_cast<const char*>(
+            std::memchr(ChunkEnd, '\n', End - ChunkEnd));
+
+         ChunkEnd = NewLine ? NewLine + 1 : End;
+      }
+
+      Chunks[i].Begin = ChunkBegin;
+      Chunks[i].End = ChunkEnd;
+      ChunkBegin = ChunkEnd;
+   }
+
+   // Parse the first chunk on this thread and the rest as jobs. Waiting runs
+   // other jobs, so this doesn't block a worker when called from a job.
+   JobCounter ChunkJobs;
+   for (size_t i = 1; i < NumChunks; ++i) {
+      Jobs->submit<&parseChunkTask>(&Chunks[i],
+                                    JobOptions(JobPriority::Normal, &ChunkJobs));
+   }
+
+   parseChunk(Chunks.front());
+
+   if (Jobs) {
+      Jobs->wait(ChunkJobs);
+   }
+
+   // Merge the attribute lists.
+   std::vector<glm::vec3> Positions;
+   std::vector<glm::vec2> TexCoords;
+   std::vector<glm::vec3> Normals;
+
+   llvm::SmallVector<std::array<int32_t, 3>, 8> Bases;
+   for (auto &C : Chunks) {
+      Bases.push_back({ (int32_t)Positions.size(), (int32_t)TexCoords.size(),
+                        (int32_t)Normals.size() });
+
+      Positions.insert(Positions.end(), C.Positions.begin(), C.Positions.end());
+      TexCoords.insert(TexCoords.end(), C.TexCoords.begin(), C.TexCoords.end());
+      Normals.insert(Normals.end(), C.Normals.begin(), C.Normals.end());
+   }
+
+   const size_t Counts[3] = {
+      Positions.size(), TexCoords.size(), Normals.size(),
+   };
+
+   // Load the materials.
+   llvm::StringRef Path = getPath(FileName);
+   llvm::StringMap<MaterialInfo> Materials;
+
+   for (auto &C : Chunks) {
+      for (auto Lib : C.MaterialLibs) {
+         parseMaterialLib(Lib, Path, Materials);
+      }
+   }
+
+   // Create one mesh per material, deduplicating the vertices by their
+   // index triple.
+   Data.Meshes.clear();
+
+   llvm::StringMap<unsigned> MeshIndices;
+   std::vector<VertexDedupTable> Tables;
+
+   auto getMesh = [&](llvm::StringRef Material) -> unsigned {
+      auto It = MeshIndices.try_emplace(Material, (unsigned)Data.Meshes.size());
+      if (!It.second) {
+         return It.first->getValue();
+      }
+
+      auto &Mesh = Data.Meshes.emplace_back();
+      Tables.emplace_back();
+
+      auto MatIt = Materials.find(Material);
+      if (MatIt != Materials.end()
+      && !MatIt->getValue().DiffuseTexture.empty()) {
+         Mesh.Textures.push_back(ModelData::TextureRef{
+            BasicTexture::DIFFUSE, MatIt->getValue().Shininess,
+            MatIt->getValue().DiffuseTexture });
+      }
+
+      return It.first->getValue();
+   };
+
+   // Faces keep the material of the previous chunk until they switch it.
+   unsigned MeshIdx = ~0u;
+
+   for (size_t ChunkIdx = 0; ChunkIdx < NumChunks; ++ChunkIdx) {
+      auto &C = Chunks[ChunkIdx];
+      auto &Base = Bases[ChunkIdx];
+
+      size_t NextMaterial = 0;
+      uint32_t FaceBegin = 0;
+
+      for (size_t FaceIdx = 0; FaceIdx < C.FaceEnds.size(); ++FaceIdx) {
+         while (NextMaterial < C.Materials.size()
+         && C.Materials[NextMaterial].FirstFace <= FaceIdx) {
+            MeshIdx = getMesh(C.Materials[NextMaterial++].Name);
+         }
+
+         if (MeshIdx == ~0u) {
+            MeshIdx = getMesh("");
+         }
+
+         auto &Mesh = Data.Meshes[MeshIdx];
+         auto &Table = Tables[MeshIdx];
+
+         auto emitCorner = [&](const Corner &Cnr) -> bool {
+            int32_t Key[3];
+            for (unsigned i = 0; i < 3; ++i) {
+               if (!(Cnr.PresentMask & (1 << i))) {
+                  Key[i] = -1;
+                  continue;
+               }
+
+               Key[i] = Cnr.Indices[i];
+               if (Cnr.RelativeMask & (1 << i)) {
+                  Key[i] += Base[i];
+               }
+
+               if (Key[i] < 0 || (size_t)Key[i] >= Counts[i]) {
+                  return false;
+               }
+            }
+
+            auto Result = Table.insert(Key, (uint32_t)Mesh.Vertices.size());
+            if (Result.second) {
+               Vertex &V = Mesh.Vertices.emplace_back();
+               V.Position = Positions[Key[Corner::Position]];
+               V.Texture = Key[Corner::TexCoord] == -1
+                  ? glm::vec2(0.0f) : TexCoords[Key[Corner::TexCoord]];
+               V.Normal = Key[Corner::Normal] == -1
+                  ? glm::vec3(0.0f) : Normals[Key[Corner::Normal]];
+            }
+
+            Mesh.Indices.push_back(Result.first);
+            return true;
+         };
+
+         // Triangulate polygons as a fan around their first corner.
+         uint32_t FaceEnd = C.FaceEnds[FaceIdx];
+         for (uint32_t i = FaceBegin + 1; i + 1 < FaceEnd; ++i) {
+            if (!emitCorner(C.Corners[FaceBegin])
+            || !emitCorner(C.Corners[i])
+            || !emitCorner(C.Corners[i + 1])) {
+               llvm::errs() << "ERROR::OBJ::invalid index in '"
+                            << FileName << "'\n";
+
+               Data.Meshes.clear();
+               return false;
+            }
+         }
+
+         FaceBegin = FaceEnd;
+      }
+
+      // Material switches after the last face of the chunk apply to the
+      // faces of the next one.
+      while (NextMaterial < C.Materials.size()) {
+         MeshIdx = getMesh(C.Materials[NextMaterial++].Name);
+      }
+   }
+
+   // Drop materials that were switched to but never used.
+   Data.Meshes.erase(
+      std::remove_if(Data.Meshes.begin(), Data.Meshes.end(),
+                     [](const ModelData::MeshData &Mesh) {
+         return Mesh.Indices.empty();
+      }), Data.Meshes.end());
+
+   return !Data.Meshes.empty();
+}
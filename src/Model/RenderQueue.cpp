@@ -0,0 +1,83 @@
+#include "mineshaft/Model/RenderQueue.h"
+
+#include "mineshaft/Model/Model.h"
+
+#include <algorithm>
+
+using namespace mc;
+
+/// The layout of a sort key, from the most to the least significant bits.
+static constexpr unsigned PassBits = 2;
+static constexpr unsigned ShaderBits = 14;
+static constexpr unsigned TextureBits = 16;
+static constexpr unsigned VertexArrayBits = 32;
+
+static constexpr unsigned PassShift = 64 - PassBits;
+static constexpr unsigned ShaderShift = PassShift - ShaderBits;
+static constexpr unsigned TextureShift = ShaderShift - TextureBits;
+
+static_assert(TextureShift == VertexArrayBits, "bad sort key layout!");
+
+/// \return The lowest \p bits bits of \p value.
+static uint64_t truncate(uint64_t value, unsigned bits)
+{
+   return value & ((uint64_t(1) << bits) - 1);
+}
+
+void RenderQueue::submit(Pass pass, const Mesh &mesh, const Shader &shader)
+{
+   uint64_t key = uint64_t(pass) << PassShift;
+
+   if (pass == Blended) {
+      // Blended draws have to keep their order, so the key below the pass
+      // is the submission index.
+      key |= truncate(commands.size(), PassShift);
+   }
+   else {
+      GLuint texture = 0;
+      if (!mesh.Textures.empty()) {
+         texture = mesh.Textures.front().texture->getTextureID();
+      }
+
+      key |= truncate(shader.getProgramID(), ShaderBits) << ShaderShift;
+      key |= truncate(texture, TextureBits) << TextureShift;
+      key |= truncate(mesh.VAO, VertexArrayBits);
+   }
+
+   commands.push_back(Command{ key, &mesh, &shader });
+}
+
+void RenderQueue::execute()
+{
+   std::sort(commands.begin(), commands.end(),
+             [](const Command &lhs, const Command &rhs) {
+      return lhs.key < rhs.key;
+   });
+
+   // RenderState skips the binds that are shared with the previous draw.
+   for (auto &command : commands) {
+      command.mesh->render(*command.shader);
+   }
+
+   commands.clear();
+}
+
+void RenderQueue::execute(Pass pass)
+{
+   // Move the draws of the pass to the end, then restore their order.
+   auto first = std::partition(commands.begin(), commands.end(),
+                               [&](const Command &command) {
+      return (command.key >> PassShift) != pass;
+   });
+
+   std::sort(first, commands.end(),
+             [](const Command &lhs, const Command &rhs) {
+      return lhs.key < rhs.key;
+   });
+
+   for (auto it = first, end = commands.end(); it != end; ++it) {
+      it->mesh->render(*it->shader);
+   }
+
+   commands.erase(first, commands.end());
+}
@@ -0,0 +1,153 @@
+#include "mineshaft/Shader/RenderState.h"
+
+#include "mineshaft/Support/Metrics.h"
+
+using namespace mc;
+
+/// Marks a binding whose current value is not known.
+static constexpr GLuint UnknownBinding = ~0u;
+
+/// The texture targets whose bindings are tracked.
+static constexpr GLenum TrackedTargets[] = {
+   GL_TEXTURE_2D,
+   GL_TEXTURE_CUBE_MAP,
+   GL_TEXTURE_2D_ARRAY,
+   GL_TEXTURE_CUBE_MAP_ARRAY,
+};
+
+static constexpr unsigned NumTrackedTargets =
+   sizeof(TrackedTargets) / sizeof(TrackedTargets[0]);
+
+namespace {
+
+/// The tracked bindings of the context.
+struct TrackedState {
+   GLuint program;
+   GLuint vertexArray;
+   GLuint activeUnit;
+   GLuint textures[RenderState::NumTrackedUnits][NumTrackedTargets];
+
+   TrackedState() { reset(); }
+
+   void reset()
+   {
+      program = UnknownBinding;
+      vertexArray = UnknownBinding;
+      activeUnit = UnknownBinding;
+
+      for (auto &unit : textures) {
+         for (auto &texture : unit) {
+            texture = UnknownBinding;
+         }
+      }
+   }
+};
+
+} // anonymous namespace
+
+static TrackedState state;
+
+/// The number of bindings that were not skipped.
+static MetricCounter &numStateChanges =
+   Metrics::getCounter("render.stateChanges");
+
+/// \return The index of a texture target in the tracked state, or -1 if it
+/// isn't tracked.
+static int getTargetIndex(GLenum target)
+{
+   for (unsigned i = 0; i < NumTrackedTargets; ++i) {
+      if (TrackedTargets[i] == target) {
+         return (int)i;
+      }
+   }
+
+   return -1;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+   if (state.program == program) {
+      return;
+   }
+
+   glUseProgram(program);
+   state.program = program;
+   numStateChanges.add();
+}
+
+void RenderState::bindVertexArray(GLuint vertexArray)
+{
+   if (state.vertexArray == vertexArray) {
+      return;
+   }
+
+   glBindVertexArray(vertexArray);
+   state.vertexArray = vertexArray;
+   numStateChanges.add();
+}
+
+void RenderState::activeTexture(GLenum unit)
+{
+   GLuint unitIdx = unit - GL_TEXTURE0;
+   if (state.activeUnit == unitIdx) {
+      return;
+   }
+
+   glActiveTexture(unit);
+   state.activeUnit = unitIdx;
+   numStateChanges.add();
+}
+
+void RenderState::bindTexture(GLenum target, GLuint texture)
+{
+   int targetIdx = getTargetIndex(target);
+   if (targetIdx == -1 || state.activeUnit >= NumTrackedUnits) {
+      glBindTexture(target, texture);
+      numStateChanges.add();
+
+      return;
+   }
+
+   auto &binding = state.textures[state.activeUnit][targetIdx];
+   if (binding == texture) {
+      return;
+   }
+
+   glBindTexture(target, texture);
+   binding = texture;
+   numStateChanges.add();
+}
+
+void RenderState::forgetProgram(GLuint program)
+{
+   // Deleting the current program doesn't unbind it, but it mustn't be
+   // skipped if a new program gets the same name.
+   if (state.program == program) {
+      state.program = UnknownBinding;
+   }
+}
+
+void RenderState::forgetVertexArray(GLuint vertexArray)
+{
+   // Deleting a bound vertex array reverts the binding to zero.
+   if (state.vertexArray == vertexArray) {
+      state.vertexArray = 0;
+   }
+}
+
+void RenderState::forgetTexture(GLuint texture)
+{
+   // Deleting a texture reverts all of its bindings to zero.
+   for (auto &unit : state.textures) {
+      for (auto &binding : unit) {
+         if (binding == texture) {
+            binding = 0;
+         }
+      }
+   }
+}
+
+void RenderState::invalidate()
+{
+   state.reset();
+}
@@ -1,10 +1,13 @@
 #include "mineshaft/Shader/Shader.h"
 
+#include "mineshaft/Shader/RenderState.h"
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cassert>
 #include <cstdio>
 #include <fstream>
 #include <iostream>
@@ -14,41 +17,129 @@
 
 using namespace mc;
 
+FrameUniformBuffer::~FrameUniformBuffer()
+{
+   clear();
+}
+
+void FrameUniformBuffer::clear()
+{
+   if (!BufferID) {
+      return;
+   }
+
+   glDeleteBuffers(1, &BufferID);
+   BufferID = 0;
+}
+
+void FrameUniformBuffer::update(const FrameData &Data)
+{
+   if (!BufferID) {
+      glGenBuffers(1, &BufferID);
+      glBindBuffer(GL_UNIFORM_BUFFER, BufferID);
+      glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr,
+                   GL_DYNAMIC_DRAW);
+
+      glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, BufferID);
+   }
+   else {
+      glBindBuffer(GL_UNIFORM_BUFFER, BufferID);
+   }
+
+   glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &Data);
+   glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 Shader::Shader(unsigned ProgramID)
    : ProgramID(ProgramID)
 {
-
+   reflectUniforms();
 }
 
 Shader::Shader(Shader &&Other) noexcept
-   : ProgramID(Other.ProgramID)
+   : ProgramID(Other.ProgramID),
+     UniformLocations(std::move(Other.UniformLocations))
 {
    Other.ProgramID = 0;
 }
 
 Shader::~Shader()
 {
+   RenderState::forgetProgram(ProgramID);
    glDeleteProgram(ProgramID);
 }
 
 Shader& Shader::operator=(Shader &&Other) noexcept
 {
-   this->~Shader();
+   RenderState::forgetProgram(ProgramID);
+   glDeleteProgram(ProgramID);
 
    ProgramID = Other.ProgramID;
+   UniformLocations = std::move(Other.UniformLocations);
    Other.ProgramID = 0;
 
    return *this;
 }
 
+void Shader::reflectUniforms()
+{
+   if (!ProgramID) {
+      return;
+   }
+
+   GLint NumUniforms = 0;
+   GLint MaxNameLength = 0;
+   glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORMS, &NumUniforms);
+   glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &MaxNameLength);
+
+   std::vector<char> NameBuf((unsigned)MaxNameLength + 1);
+   for (GLint i = 0; i < NumUniforms; ++i) {
+      GLsizei Length = 0;
+      GLint Size;
+      GLenum Type;
+      glGetActiveUniform(ProgramID, (GLuint)i, (GLsizei)NameBuf.size(),
+                         &Length, &Size, &Type, NameBuf.data());
+
+      // Members of uniform blocks don't have a location.
+      GLint Location = glGetUniformLocation(ProgramID, NameBuf.data());
+      if (Location < 0) {
+         continue;
+      }
+
+      // Arrays are reported as 'name[0]', but set using their plain name.
+      llvm::StringRef Name(NameBuf.data(), (size_t)Length);
+      if (Name.endswith("[0]")) {
+         Name = Name.drop_back(3);
+      }
+
+      uint32_t Hash = UniformName::get(Name).getHash();
+      assert(getUniformLocation(UniformName::get(Name)) == -1
+             && "uniform name hash collision!");
+
+      UniformLocations.emplace_back(Hash, Location);
+   }
+
+   GLuint FrameDataIndex = glGetUniformBlockIndex(ProgramID, "FrameData");
+   if (FrameDataIndex != GL_INVALID_INDEX) {
+      glUniformBlockBinding(ProgramID, FrameDataIndex,
+                            FrameUniformBuffer::BindingPoint);
+   }
+}
+
 void Shader::useShader() const
 {
-   glUseProgram(ProgramID);
+   RenderState::useProgram(ProgramID);
 }
 
-GLint Shader::getUniformLocation(const char *Name) const
+GLint Shader::getUniformLocation(UniformName Name) const
 {
-   return glGetUniformLocation(ProgramID, Name);
+   for (auto &Entry : UniformLocations) {
+      if (Entry.first == Name.getHash()) {
+         return Entry.second;
+      }
+   }
+
+   return -1;
 }
 
 void Shader::setUniform(GLint Location, GLint Val) const
@@ -81,32 +172,32 @@ void Shader::setUniform(GLint Location, glm::mat4 Val) const
    glUniformMatrix4fv(Location, 1, GL_FALSE, glm::value_ptr(Val));
 }
 
-void Shader::setUniform(const char *Name, GLint Val) const
+void Shader::setUniform(UniformName Name, GLint Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
 
-void Shader::setUniform(const char *Name, GLuint Val) const
+void Shader::setUniform(UniformName Name, GLuint Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
 
-void Shader::setUniform(const char *Name, float Val) const
+void Shader::setUniform(UniformName Name, float Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
 
-void Shader::setUniform(const char *Name, glm::vec3 Val) const
+void Shader::setUniform(UniformName Name, glm::vec3 Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
 
-void Shader::setUniform(const char *Name, glm::vec4 Val) const
+void Shader::setUniform(UniformName Name, glm::vec4 Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
 
-void Shader::setUniform(const char *Name, glm::mat4 Val) const
+void Shader::setUniform(UniformName Name, glm::mat4 Val) const
 {
    setUniform(getUniformLocation(Name), Val);
 }
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include "mineshaft/Support/AssetCache.h"
+
+#include "mineshaft/Model/Model.h"
+
+#include <SFML/Graphics/Image.hpp>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace mc;
+
+/// The directory cache files are stored in.
+static constexpr const char *CacheDirectory = "../assets/cache/";
+
+/// The kinds of cached assets.
+enum class AssetKind : uint32_t {
+   Texture = 0,
+   Model,
+};
+
+namespace {
+
+/// The header of every cache file.
+struct FileHeader {
+   char magic[4];
+   uint32_t version;
+   AssetKind kind;
+   uint32_t reserved;
+
+   /// The size of the source file, to detect stale entries.
+   uint64_t sourceSize;
+
+   /// The modification time of the source file, to detect stale entries.
+   int64_t sourceTime;
+};
+
+static constexpr char Magic[4] = { 'M', 'C', 'A', 'C' };
+
+/// Reads values from a mapped cache file with bounds checking.
+class Reader {
+   const char *cur;
+   const char *end;
+
+public:
+   explicit Reader(const llvm::MemoryBuffer &buffer)
+      : cur(buffer.getBufferStart()), end(buffer.getBufferEnd())
+   {}
+
+   /// \return A pointer to the next \p size bytes, or nullptr if the file
+   /// is too short.
+   const char *skip(size_t size)
+   {
+      if ((size_t)(end - cur) < size) {
+         return nullptr;
+      }
+
+      const char *ptr = cur;
+      cur += size;
+
+      return ptr;
+   }
+
+   /// \return The number of bytes that were not read yet.
+   size_t remaining() const { return (size_t)(end - cur); }
+
+   bool read(void *dst, size_t size)
+   {
+      const char *ptr = skip(size);
+      if (!ptr) {
+         return false;
+      }
+
+      std::memcpy(dst, ptr, size);
+      return true;
+   }
+
+   template<class T>
+   bool read(T &value)
+   {
+      return read(&value, sizeof(T));
+   }
+};
+
+} // anonymous namespace
+
+/// Create the header for a cache entry of \p sourcePath.
+/// \return false if the source file doesn't exist.
+static bool createHeader(llvm::StringRef sourcePath, AssetKind kind,
+                         FileHeader &header) {
+   llvm::sys::fs::file_status status;
+   if (llvm::sys::fs::status(sourcePath, status)) {
+      return false;
+   }
+
+   std::memcpy(header.magic, Magic, sizeof(Magic));
+   header.version = AssetCache::Version;
+   header.kind = kind;
+   header.reserved = 0;
+   header.sourceSize = status.getSize();
+   header.sourceTime = status.getLastModificationTime()
+      .time_since_epoch().count();
+
+   return true;
+}
+
+/// Map the cache file of \p sourcePath and check that it is up-to-date.
+static std::unique_ptr<llvm::MemoryBuffer>
+openCacheFile(llvm::StringRef sourcePath, AssetKind kind) {
+   FileHeader expected;
+   if (!createHeader(sourcePath, kind, expected)) {
+      return nullptr;
+   }
+
+   auto optBuffer = llvm::MemoryBuffer::getFile(
+      AssetCache::getCachePath(sourcePath), /*IsText=*/false,
+      /*RequiresNullTerminator=*/false);
+
+   if (!optBuffer) {
+      return nullptr;
+   }
+
+   auto buffer = std::move(optBuffer.get());
+
+   FileHeader header;
+   Reader reader(*buffer);
+   if (!reader.read(header)
+   || std::memcmp(&header, &expected, sizeof(FileHeader)) != 0) {
+      return nullptr;
+   }
+
+   return buffer;
+}
+
+/// Write a cache file. The file is written to a temporary file first so that
+/// a crash never leaves a truncated entry behind.
+template<class Fn>
+static void writeCacheFile(llvm::StringRef sourcePath, AssetKind kind,
+                           Fn writeBody) {
+   FileHeader header;
+   if (!createHeader(sourcePath, kind, header)) {
+      return;
+   }
+
+   if (llvm::sys::fs::create_directories(CacheDirectory)) {
+      return;
+   }
+
+   std::string cachePath = AssetCache::getCachePath(sourcePath);
+   std::string tmpPath = cachePath + ".tmp";
+
+   {
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(tmpPath, EC, llvm::sys::fs::OF_None);
+      if (EC) {
+         return;
+      }
+
+      OS.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+      writeBody(OS);
+
+      if (OS.has_error()) {
+         OS.clear_error();
+         return;
+      }
+   }
+
+   llvm::sys::fs::rename(tmpPath, cachePath);
+}
+
+template<class T>
+static void write(llvm::raw_ostream &OS, const T &value)
+{
+   OS.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void TextureData::buildFromImage(const sf::Image &image)
+{
+   width = image.getSize().x;
+   height = image.getSize().y;
+
+   unsigned numLevels = 1;
+   for (uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+      ++numLevels;
+   }
+
+   size_t totalSize = 0;
+   for (unsigned i = 0; i < numLevels; ++i) {
+      totalSize += (size_t)std::max(width >> i, 1u)
+         * std::max(height >> i, 1u) * 4;
+   }
+
+   pixels.resize(totalSize);
+   std::memcpy(pixels.data(), image.getPixelsPtr(), (size_t)width * height * 4);
+
+   levels.clear();
+   levels.emplace_back(pixels.data(), (size_t)width * height * 4);
+
+   // Average each 2x2 block of the previous level.
+   for (unsigned i = 1; i < numLevels; ++i) {
+      uint32_t srcWidth = std::max(width >> (i - 1), 1u);
+      uint32_t srcHeight = std::max(height >> (i - 1), 1u);
+      uint32_t dstWidth = std::max(width >> i, 1u);
+      uint32_t dstHeight = std::max(height >> i, 1u);
+
+      const uint8_t *src = levels.back().data();
+      uint8_t *dst = const_cast<uint8_t*>(src + levels.back().size());
+
+      for (uint32_t y = 0; y < dstHeight; ++y) {
+         uint32_t y0 = std::min(y * 2, srcHeight - 1);
+         uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+
+         for (uint32_t x = 0; x < dstWidth; ++x) {
+            uint32_t x0 = std::min(x * 2, srcWidth - 1);
+            uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+            for (unsigned c = 0; c < 4; ++c) {
+               unsigned sum = src[(y0 * srcWidth + x0) * 4 + c]
+                  + src[(y0 * srcWidth + x1) * 4 + c]
+                  + src[(y1 * srcWidth + x0) * 4 + c]
+                  + src[(y1 * srcWidth + x1) * 4 + c];
+
+               dst[(y * dstWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+         }
+      }
+
+      levels.emplace_back(dst, (size_t)dstWidth * dstHeight * 4);
+   }
+}
+
+size_t TextureData::getTotalSize() const
+{
+   size_t size = 0;
+   for (auto &level : levels) {
+      size += level.size();
+   }
+
+   return size;
+}
+
+std::string AssetCache::getCachePath(llvm::StringRef sourcePath)
+{
+   std::string path = CacheDirectory;
+   for (char c : sourcePath.ltrim("./")) {
+      path += std::isalnum((unsigned char)c) ? c : '_';
+   }
+
+   path += ".mcc";
+   return path;
+}
+
+bool AssetCache::loadTexture(llvm::StringRef sourcePath, TextureData &data)
+{
+   auto buffer = openCacheFile(sourcePath, AssetKind::Texture);
+   if (!buffer) {
+      return false;
+   }
+
+   Reader reader(*buffer);
+   reader.skip(sizeof(FileHeader));
+
+   uint32_t width, height, numLevels;
+   if (!reader.read(width) || !reader.read(height) || !reader.read(numLevels)) {
+      return false;
+   }
+
+   // Every level halves the size, down to 1x1. More levels than that would
+   // shift by 32 or more bits below.
+   if (!width || !height || !numLevels
+   || numLevels > llvm::Log2_32(std::max(width, height)) + 1) {
+      return false;
+   }
+
+   data.width = width;
+   data.height = height;
+   data.levels.clear();
+
+   // The levels point directly into the mapped file.
+   for (unsigned i = 0; i < numLevels; ++i) {
+      uint64_t numPixels = (uint64_t)std::max(width >> i, 1u)
+         * std::max(height >> i, 1u);
+
+      // Compare before multiplying, so that the size can't overflow.
+      if (numPixels > reader.remaining() / 4) {
+         return false;
+      }
+
+      size_t size = (size_t)numPixels * 4;
+      const char *pixels = reader.skip(size);
+      if (!pixels) {
+         return false;
+      }
+
+      data.levels.emplace_back(reinterpret_cast<const uint8_t*>(pixels), size);
+   }
+
+   data.mapping = std::move(buffer);
+   return true;
+}
+
+void AssetCache::storeTexture(llvm::StringRef sourcePath,
+                              const TextureData &data) {
+   writeCacheFile(sourcePath, AssetKind::Texture, [&](llvm::raw_ostream &OS) {
+      write(OS, data.width);
+      write(OS, data.height);
+      write(OS, (uint32_t)data.levels.size());
+
+      for (auto &level : data.levels) {
+         OS.write(reinterpret_cast<const char*>(level.data()), level.size());
+      }
+   });
+}
+
+bool AssetCache::loadModel(llvm::StringRef sourcePath, ModelData &data)
+{
+   auto buffer = openCacheFile(sourcePath, AssetKind::Model);
+   if (!buffer) {
+      return false;
+   }
+
+   Reader reader(*buffer);
+   reader.skip(sizeof(FileHeader));
+
+   uint32_t numMeshes;
+   // Every mesh stores at least its three counts. Checking the counts
+   // against the file size keeps a corrupt file from allocating gigabytes.
+   if (!reader.read(numMeshes)
+   || (uint64_t)numMeshes * 3 * sizeof(uint32_t) > reader.remaining()) {
+      return false;
+   }
+
+   // Parse into a local so that a truncated file leaves no partial data.
+   ModelData result;
+   result.Meshes.resize(numMeshes);
+
+   for (auto &mesh : result.Meshes) {
+      uint32_t numVertices, numIndices, numTextures;
+      if (!reader.read(numVertices)
+      || !reader.read(numIndices)
+      || !reader.read(numTextures)) {
+         return false;
+      }
+
+      if ((uint64_t)numVertices * sizeof(Vertex) > reader.remaining()
+      || (uint64_t)numIndices * sizeof(unsigned)
+         > reader.remaining() - numVertices * sizeof(Vertex)) {
+         return false;
+      }
+
+      mesh.Vertices.resize(numVertices);
+      mesh.Indices.resize(numIndices);
+
+      if (!reader.read(mesh.Vertices.data(), numVertices * sizeof(Vertex))
+      || !reader.read(mesh.Indices.data(), numIndices * sizeof(unsigned))) {
+         return false;
+      }
+
+      for (unsigned i = 0; i < numTextures; ++i) {
+         uint32_t kind, length;
+         float shininess;
+
+         if (!reader.read(kind)
+         || !reader.read(shininess)
+         || !reader.read(length)) {
+            return false;
+         }
+
+         const char *file = reader.skip(length);
+         if (!file) {
+            return false;
+         }
+
+         mesh.Textures.push_back(ModelData::TextureRef{
+            (BasicTexture::Kind)kind, shininess, std::string(file, length) });
+      }
+   }
+
+   data = std::move(result);
+   return true;
+}
+
+void AssetCache::storeModel(llvm::StringRef sourcePath, const ModelData &data)
+{
+   writeCacheFile(sourcePath, AssetKind::Model, [&](llvm::raw_ostream &OS) {
+      write(OS, (uint32_t)data.Meshes.size());
+
+      for (auto &mesh : data.Meshes) {
+         write(OS, (uint32_t)mesh.Vertices.size());
+         write(OS, (uint32_t)mesh.Indices.size());
+         write(OS, (uint32_t)mesh.Textures.size());
+
+         OS.write(reinterpret_cast<const char*>(mesh.Vertices.data()),
+                  mesh.Vertices.size() * sizeof(Vertex));
+         OS.write(reinterpret_cast<const char*>(mesh.Indices.data()),
+                  mesh.Indices.size() * sizeof(unsigned));
+
+         for (auto &texture : mesh.Textures) {
+            write(OS, (uint32_t)texture.Kind);
+            write(OS, texture.Shininess);
+            write(OS, (uint32_t)texture.File.size());
+            OS << texture.File;
+         }
+      }
+   });
+}
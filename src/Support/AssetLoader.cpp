@@ -0,0 +1,257 @@
+#include "mineshaft/Support/AssetLoader.h"
+
+#include "mineshaft/Application.h"
+#include "mineshaft/Model/Model.h"
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/AssetCache.h"
+#include "mineshaft/Support/Profiler.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace mc;
+
+struct AssetLoader::TextureRequest {
+   AssetLoader *loader;
+   BasicTexture *texture;
+   std::string path;
+
+   /// The decoded mip chain, only valid if \c success is true.
+   TextureData data;
+   bool success = false;
+};
+
+struct AssetLoader::ModelRequest {
+   AssetLoader *loader;
+   Model *model;
+   std::string path;
+
+   /// The processed meshes, only valid if \c success is true.
+   ModelData data;
+   bool success = false;
+};
+
+AssetLoader::AssetLoader(Application &app)
+   : app(app)
+{
+
+}
+
+AssetLoader::~AssetLoader()
+{
+   // The requests reference this loader, so wait for them to finish.
+   app.getJobSystem().wait(pendingRequests);
+
+   for (auto *request : finishedTextures) {
+      delete request;
+   }
+   for (auto *request : finishedModels) {
+      delete request;
+   }
+}
+
+void AssetLoader::clear()
+{
+   if (uploadBuffer) {
+      glDeleteBuffers(1, &uploadBuffer);
+      uploadBuffer = 0;
+   }
+
+   if (placeholderTexture) {
+      RenderState::forgetTexture(placeholderTexture);
+      glDeleteTextures(1, &placeholderTexture);
+      placeholderTexture = 0;
+   }
+}
+
+GLuint AssetLoader::getPlaceholderTexture()
+{
+   if (placeholderTexture) {
+      return placeholderTexture;
+   }
+
+   // A single white texel, so that placeholders take on the color of the
+   // lighting.
+   static constexpr uint8_t pixel[] = { 255, 255, 255, 255 };
+
+   glGenTextures(1, &placeholderTexture);
+   RenderState::bindTexture(GL_TEXTURE_2D, placeholderTexture);
+
+   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                pixel);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+   return placeholderTexture;
+}
+
+void AssetLoader::loadTexture(BasicTexture *texture, llvm::StringRef path)
+{
+   auto *request = new TextureRequest{ this, texture, path.str() };
+   app.getJobSystem().submit<&decodeTexture>(
+      request, JobOptions(JobPriority::Normal, &pendingRequests));
+}
+
+void AssetLoader::loadModel(Model *model, llvm::StringRef path)
+{
+   auto *request = new ModelRequest{ this, model, path.str() };
+   app.getJobSystem().submit<&importModel>(
+      request, JobOptions(JobPriority::Normal, &pendingRequests));
+}
+
+void AssetLoader::decodeTexture(TextureRequest *request)
+{
+   MC_PROFILE_SCOPE("decodeTexture");
+   if (AssetCache::loadTexture(request->path, request->data)) {
+      request->success = true;
+   }
+   else {
+      sf::Image image;
+      request->success = image.loadFromFile(request->path);
+
+      if (request->success) {
+         request->data.buildFromImage(image);
+         AssetCache::storeTexture(request->path, request->data);
+      }
+   }
+
+   auto *loader = request->loader;
+   std::lock_guard<std::mutex> guard(loader->finishedMutex);
+   loader->finishedTextures.push_back(request);
+}
+
+void AssetLoader::importModel(ModelRequest *request)
+{
+   MC_PROFILE_SCOPE("importModel");
+   if (AssetCache::loadModel(request->path, request->data)) {
+      request->success = true;
+   }
+   else {
+      request->success = Model::importFile(request->path, request->data,
+                                           &request->loader->app.getJobSystem());
+
+      if (request->success) {
+         AssetCache::storeModel(request->path, request->data);
+      }
+   }
+
+   auto *loader = request->loader;
+   std::lock_guard<std::mutex> guard(loader->finishedMutex);
+   loader->finishedModels.push_back(request);
+}
+
+void AssetLoader::uploadTexture(TextureRequest &request)
+{
+   if (!request.success || request.data.levels.empty()) {
+      llvm::errs() << "failed to load texture '" << request.path << "'\n";
+      return;
+   }
+
+   auto &data = request.data;
+   auto size = (GLsizeiptr)data.getTotalSize();
+
+   if (!uploadBuffer) {
+      glGenBuffers(1, &uploadBuffer);
+   }
+
+   // Orphan the previous contents of the buffer, so that mapping it doesn't
+   // wait for the last upload to finish.
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+   glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+   void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+   if (!pixels) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      return;
+   }
+
+   size_t offset = 0;
+   for (auto &level : data.levels) {
+      std::memcpy(static_cast<char*>(pixels) + offset, level.data(),
+                  level.size());
+      offset += level.size();
+   }
+
+   glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+   GLuint textureID;
+   glGenTextures(1, &textureID);
+   RenderState::bindTexture(GL_TEXTURE_2D, textureID);
+
+   // The pixels are copied from the bound pixel buffer, without stalling.
+   // The mip chain is precomputed, so there is no need to generate it here.
+   offset = 0;
+   for (unsigned i = 0; i < data.levels.size(); ++i) {
+      auto width = (GLsizei)std::max(data.width >> i, 1u);
+      auto height = (GLsizei)std::max(data.height >> i, 1u);
+
+      glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA, width, height, 0,
+                   GL_RGBA, GL_UNSIGNED_BYTE,
+                   reinterpret_cast<const void*>(offset));
+
+      offset += data.levels[i].size();
+   }
+
+   glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                   (GLint)data.levels.size() - 1);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+   // Everyone holding the handle uses the real texture from now on.
+   request.texture->textureID = textureID;
+   request.texture->pending = false;
+}
+
+void AssetLoader::finishModel(ModelRequest &request)
+{
+   if (!request.success) {
+      return;
+   }
+
+   auto model = Model::fromData(app, std::move(request.data));
+   if (model) {
+      *request.model = std::move(*model);
+   }
+}
+
+void AssetLoader::update()
+{
+   llvm::SmallVector<TextureRequest*, MaxTextureUploadsPerFrame> textures;
+   llvm::SmallVector<ModelRequest*, MaxModelsPerFrame> models;
+
+   {
+      std::lock_guard<std::mutex> guard(finishedMutex);
+
+      unsigned numTextures = std::min((unsigned)finishedTextures.size(),
+                                      MaxTextureUploadsPerFrame);
+      textures.append(finishedTextures.begin(),
+                      finishedTextures.begin() + numTextures);
+      finishedTextures.erase(finishedTextures.begin(),
+                             finishedTextures.begin() + numTextures);
+
+      unsigned numModels = std::min((unsigned)finishedModels.size(),
+                                    MaxModelsPerFrame);
+      models.append(finishedModels.begin(),
+                    finishedModels.begin() + numModels);
+      finishedModels.erase(finishedModels.begin(),
+                           finishedModels.begin() + numModels);
+   }
+
+   for (auto *request : textures) {
+      uploadTexture(*request);
+      delete request;
+   }
+
+   for (auto *request : models) {
+      finishModel(*request);
+      delete request;
+   }
+}
@@ -0,0 +1,138 @@
+#include "mineshaft/Support/GPUProfiler.h"
+
+#include "mineshaft/Support/Profiler.h"
+
+#include <llvm/Support/ErrorHandling.h>
+
+#include <cassert>
+
+using namespace mc;
+
+const char *GPUProfiler::getPassName(GPUPass pass)
+{
+   switch (pass) {
+   case GPUPass::FarTerrain:
+      return "gpu:farTerrain";
+   case GPUPass::OpaqueTerrain:
+      return "gpu:opaqueTerrain";
+   case GPUPass::Translucent:
+      return "gpu:translucent";
+   case GPUPass::Entities:
+      return "gpu:entities";
+   case GPUPass::Borders:
+      return "gpu:borders";
+   case GPUPass::UI:
+      return "gpu:ui";
+   default:
+      llvm_unreachable("bad GPU pass");
+   }
+}
+
+void GPUProfiler::beginFrame()
+{
+   if (!initialized) {
+      initialized = true;
+      supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+   }
+
+   if (!supported) {
+      return;
+   }
+
+   assert(!measuring && "pass still measured at the end of the frame");
+
+   currentFrame = (currentFrame + 1) % Latency;
+
+   auto &frame = frames[currentFrame];
+   readResults(frame);
+
+   frame.numUsed = 0;
+   frame.passes.clear();
+   frame.cpuBegin.clear();
+}
+
+void GPUProfiler::readResults(FrameQueries &frame)
+{
+   if (frame.numUsed == 0) {
+      return;
+   }
+
+   // The queries finish in order, so the others are done if the last one is.
+   GLint available = 0;
+   glGetQueryObjectiv(frame.queries[frame.numUsed - 1],
+                      GL_QUERY_RESULT_AVAILABLE, &available);
+
+   if (!available) {
+      ++numMissedFrames;
+      return;
+   }
+
+   for (auto &time : passTimes) {
+      time = 0;
+   }
+
+   for (unsigned i = 0; i < frame.numUsed; ++i) {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed);
+
+      passTimes[(unsigned)frame.passes[i]] += elapsed;
+
+      // The GPU clock is not synchronized with the CPU one, so the zone is
+      // placed where its commands were submitted.
+      Profiler::recordGPUZone(getPassName(frame.passes[i]), frame.cpuBegin[i],
+                              frame.cpuBegin[i] + elapsed);
+   }
+}
+
+bool GPUProfiler::beginPass(GPUPass pass)
+{
+   if (!supported || measuring) {
+      return false;
+   }
+
+   auto &frame = frames[currentFrame];
+   if (frame.numUsed == frame.queries.size()) {
+      GLuint query;
+      glGenQueries(1, &query);
+      frame.queries.push_back(query);
+   }
+
+   glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.numUsed++]);
+   frame.passes.push_back(pass);
+   frame.cpuBegin.push_back(Profiler::now());
+
+   measuring = true;
+   return true;
+}
+
+void GPUProfiler::endPass()
+{
+   assert(measuring && "no pass is measured");
+
+   glEndQuery(GL_TIME_ELAPSED);
+   measuring = false;
+}
+
+void GPUProfiler::clear()
+{
+   for (auto &frame : frames) {
+      if (!frame.queries.empty()) {
+         glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+      }
+
+      frame.queries.clear();
+      frame.passes.clear();
+      frame.cpuBegin.clear();
+      frame.numUsed = 0;
+   }
+}
+
+uint64_t GPUProfiler::getTotalTime() const
+{
+   uint64_t total = 0;
+   for (auto time : passTimes) {
+      total += time;
+   }
+
+   return total;
+}
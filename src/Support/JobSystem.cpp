@@ -0,0 +1,330 @@
+#include "mineshaft/Support/JobSystem.h"
+#include "mineshaft/Support/Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace mc;
+
+struct JobCounter::Job {
+   /// The function to run.
+   JobSystem::JobFn fn;
+
+   /// The argument to pass.
+   void *arg;
+
+   /// The priority of the job.
+   JobPriority priority;
+
+   /// The counter to signal once the job finished.
+   JobCounter *counter;
+
+   /// If set, the job is skipped.
+   const std::atomic<bool> *cancelled;
+};
+
+namespace {
+
+/// The worker the current thread belongs to.
+struct CurrentWorker {
+   const JobSystem *system = nullptr;
+   int index = -1;
+};
+
+} // anonymous namespace
+
+static thread_local CurrentWorker currentWorker;
+
+bool JobCounter::isDone() const
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   return count.load(std::memory_order_relaxed) == 0;
+}
+
+bool JobSystem::WorkStealingDeque::push(Job *job)
+{
+   int64_t b = bottom.load(std::memory_order_relaxed);
+   int64_t t = top.load(std::memory_order_acquire);
+
+   if (b - t >= Capacity) {
+      return false;
+   }
+
+   buffer[b & (Capacity - 1)].store(job, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   bottom.store(b + 1, std::memory_order_relaxed);
+
+   return true;
+}
+
+JobSystem::Job *JobSystem::WorkStealingDeque::pop()
+{
+   int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+   bottom.store(b, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t t = top.load(std::memory_order_relaxed);
+
+   if (t > b) {
+      // The deque was empty.
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+   }
+
+   Job *job = buffer[b & (Capacity - 1)].load(std::memory_order_relaxed);
+   if (t == b) {
+      // This is the last job, race the thieves for it.
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+         job = nullptr;
+      }
+
+      bottom.store(b + 1, std::memory_order_relaxed);
+   }
+
+   return job;
+}
+
+JobSystem::Job *JobSystem::WorkStealingDeque::steal()
+{
+   int64_t t = top.load(std::memory_order_acquire);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   int64_t b = bottom.load(std::memory_order_acquire);
+
+   if (t >= b) {
+      return nullptr;
+   }
+
+   Job *job = buffer[t & (Capacity - 1)].load(std::memory_order_relaxed);
+   if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed)) {
+      return nullptr;
+   }
+
+   return job;
+}
+
+JobSystem::JobSystem(unsigned numThreads)
+{
+   if (!numThreads) {
+      numThreads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+   }
+
+   workers.reserve(numThreads);
+   for (unsigned i = 0; i < numThreads; ++i) {
+      workers.push_back(std::make_unique<Worker>());
+   }
+
+   // Start the threads only after all workers exist, since they steal from
+   // each other.
+   for (unsigned i = 0; i < numThreads; ++i) {
+      workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+   }
+}
+
+JobSystem::~JobSystem()
+{
+   stop();
+}
+
+int JobSystem::getCurrentWorker() const
+{
+   return currentWorker.system == this ? currentWorker.index : -1;
+}
+
+void JobSystem::submitImpl(JobFn fn, void *arg, const JobOptions &options)
+{
+   auto *job = new Job{ fn, arg, options.priority, options.counter,
+                        options.cancelled };
+
+   if (job->counter) {
+      job->counter->count.fetch_add(1, std::memory_order_relaxed);
+   }
+
+   if (auto *dependency = options.dependency) {
+      std::lock_guard<std::mutex> guard(dependency->mutex);
+      if (dependency->count.load(std::memory_order_relaxed) != 0) {
+         dependency->waiters.push_back(job);
+         return;
+      }
+   }
+
+   schedule(job);
+}
+
+void JobSystem::schedule(Job *job)
+{
+   auto priority = (unsigned)job->priority;
+
+   // Only workers push to their own queues, and they are still running.
+   int self = getCurrentWorker();
+   if (self == -1 || !workers[self]->queues[priority].push(job)) {
+      std::unique_lock<std::mutex> guard(injectionMutex);
+
+      // The flag is set under the same lock before stop() drains the
+      // injection queues for the last time, so the job is either drained or
+      // runs right here.
+      if (workersStopped) {
+         guard.unlock();
+         execute(job);
+
+         return;
+      }
+
+      injectionQueues[priority].push_back(job);
+      numInjected.fetch_add(1);
+   }
+
+   // Wake a single sleeping worker, if there is one. Incrementing the queued
+   // count before checking for sleepers guarantees that a worker that is
+   // about to go to sleep sees the job.
+   numQueued.fetch_add(1);
+   if (numSleeping.load()) {
+      { std::lock_guard<std::mutex> guard(sleepMutex); }
+      sleepCondition.notify_one();
+   }
+}
+
+JobSystem::Job *JobSystem::findJob(int self)
+{
+   for (unsigned priority = 0; priority < NumPriorities; ++priority) {
+      if (self != -1) {
+         if (Job *job = workers[self]->queues[priority].pop()) {
+            return job;
+         }
+      }
+
+      if (numInjected.load(std::memory_order_relaxed)) {
+         std::lock_guard<std::mutex> guard(injectionMutex);
+
+         auto &queue = injectionQueues[priority];
+         if (!queue.empty()) {
+            Job *job = queue.front();
+            queue.pop_front();
+            numInjected.fetch_sub(1);
+
+            return job;
+         }
+      }
+
+      // Steal from the other workers, starting with the next one so that
+      // the thieves spread out.
+      auto numWorkers = (unsigned)workers.size();
+      for (unsigned i = 1; i <= numWorkers; ++i) {
+         unsigned victim = (unsigned)(self + i) % numWorkers;
+         if ((int)victim == self) {
+            continue;
+         }
+
+         if (Job *job = workers[victim]->queues[priority].steal()) {
+            return job;
+         }
+      }
+   }
+
+   return nullptr;
+}
+
+void JobSystem::execute(Job *job)
+{
+   if (!job->cancelled || !job->cancelled->load(std::memory_order_relaxed)) {
+      job->fn(job->arg);
+   }
+
+   JobCounter *counter = job->counter;
+   delete job;
+
+   if (!counter) {
+      return;
+   }
+
+   // The counter may be destroyed as soon as it is observed to be done, so
+   // the final decrement has to happen while holding its lock.
+   std::vector<Job*> waiters;
+   {
+      std::lock_guard<std::mutex> guard(counter->mutex);
+      if (counter->count.fetch_sub(1) != 1) {
+         return;
+      }
+
+      std::swap(waiters, counter->waiters);
+   }
+
+   // Schedule the jobs that waited for the counter.
+
+   for (Job *waiter : waiters) {
+      schedule(waiter);
+   }
+}
+
+void JobSystem::workerLoop(unsigned index)
+{
+   currentWorker.system = this;
+   currentWorker.index = (int)index;
+
+   Profiler::setThreadName("Worker");
+
+   for (;;) {
+      if (Job *job = findJob((int)index)) {
+         numQueued.fetch_sub(1);
+         execute(job);
+
+         continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      numSleeping.fetch_add(1);
+
+      sleepCondition.wait(lock, [&] {
+         return numQueued.load() != 0 || stopping.load();
+      });
+
+      numSleeping.fetch_sub(1);
+
+      // Only exit once all work is done.
+      if (stopping.load() && numQueued.load() == 0) {
+         return;
+      }
+   }
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+   int self = getCurrentWorker();
+   while (!counter.isDone()) {
+      if (Job *job = findJob(self)) {
+         numQueued.fetch_sub(1);
+         execute(job);
+      }
+      else {
+         std::this_thread::yield();
+      }
+   }
+}
+
+void JobSystem::stop()
+{
+   {
+      std::lock_guard<std::mutex> guard(sleepMutex);
+      if (stopping.exchange(true)) {
+         return;
+      }
+   }
+
+   sleepCondition.notify_all();
+
+   for (auto &worker : workers) {
+      worker->thread.join();
+   }
+
+   // Run the jobs that were submitted from other threads while the workers
+   // exited. Later jobs run immediately.
+   {
+      std::lock_guard<std::mutex> guard(injectionMutex);
+      workersStopped = true;
+   }
+
+   while (Job *job = findJob(-1)) {
+      numQueued.fetch_sub(1);
+      execute(job);
+   }
+}
@@ -0,0 +1,302 @@
+#include "mineshaft/Support/Metrics.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace mc;
+
+namespace {
+
+/// The bookkeeping of a counter's rates.
+struct CounterEntry {
+   std::unique_ptr<MetricCounter> counter;
+
+   /// The value at the last update.
+   uint64_t lastValue = 0;
+
+   /// The increase between the last two updates.
+   uint64_t perFrame = 0;
+
+   /// The value at the start of the current one-second window.
+   uint64_t windowValue = 0;
+
+   /// The increase per second in the last finished window.
+   double perSecond = 0;
+};
+
+/// The registered metrics.
+struct MetricRegistry {
+   using Clock = std::chrono::steady_clock;
+
+   /// Protects the registry.
+   std::mutex mutex;
+
+   llvm::StringMap<CounterEntry> counters;
+   llvm::StringMap<std::unique_ptr<MetricGauge>> gauges;
+   llvm::StringMap<std::unique_ptr<MetricHistogram>> histograms;
+
+   /// The start of the current rate window.
+   Clock::time_point windowStart = Clock::now();
+
+   /// The interval at which the metrics are dumped in seconds, or zero.
+   float dumpInterval = 0;
+
+   /// The file the metrics are dumped to.
+   std::string dumpFile;
+
+   /// The time of the last dump.
+   Clock::time_point lastDump = Clock::now();
+};
+
+} // anonymous namespace
+
+static MetricRegistry &getRegistry()
+{
+   // Never destroyed, since metrics may be updated by static destructors.
+   static auto *registry = new MetricRegistry;
+   return *registry;
+}
+
+unsigned MetricCounter::getShardIndex()
+{
+   static std::atomic<unsigned> nextIndex{ 0 };
+   static thread_local unsigned index = nextIndex.fetch_add(1) % NumShards;
+
+   return index;
+}
+
+uint64_t MetricCounter::getValue() const
+{
+   uint64_t value = 0;
+   for (auto &shard : shards) {
+      value += shard.value.load(std::memory_order_relaxed);
+   }
+
+   return value;
+}
+
+/// \return The bucket of \p value.
+static unsigned getBucket(uint64_t value)
+{
+   unsigned bucket = 0;
+   while (value && bucket < MetricHistogram::NumBuckets - 1) {
+      value >>= 1;
+      ++bucket;
+   }
+
+   return bucket;
+}
+
+void MetricHistogram::record(uint64_t value)
+{
+   buckets[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+   count.fetch_add(1, std::memory_order_relaxed);
+   sum.fetch_add(value, std::memory_order_relaxed);
+
+   uint64_t prev = max.load(std::memory_order_relaxed);
+   while (value > prev
+   && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+      // Retry with the updated maximum.
+   }
+}
+
+double MetricHistogram::getMean() const
+{
+   uint64_t n = getCount();
+   if (!n) {
+      return 0;
+   }
+
+   return (double)sum.load(std::memory_order_relaxed) / (double)n;
+}
+
+uint64_t MetricHistogram::getPercentile(double percentile) const
+{
+   uint64_t n = getCount();
+   if (!n) {
+      return 0;
+   }
+
+   auto rank = (uint64_t)std::ceil(n * std::min(percentile, 100.0) / 100.0);
+   uint64_t seen = 0;
+
+   for (unsigned i = 0; i < NumBuckets; ++i) {
+      seen += buckets[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+         // The upper bound of the bucket, but never more than the maximum.
+         uint64_t bound = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+         return std::min(bound, getMax());
+      }
+   }
+
+   return getMax();
+}
+
+MetricCounter &Metrics::getCounter(llvm::StringRef name)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   auto &entry = registry.counters[name];
+   if (!entry.counter) {
+      entry.counter = std::make_unique<MetricCounter>();
+   }
+
+   return *entry.counter;
+}
+
+MetricGauge &Metrics::getGauge(llvm::StringRef name)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   auto &gauge = registry.gauges[name];
+   if (!gauge) {
+      gauge = std::make_unique<MetricGauge>();
+   }
+
+   return *gauge;
+}
+
+MetricHistogram &Metrics::getHistogram(llvm::StringRef name)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   auto &histogram = registry.histograms[name];
+   if (!histogram) {
+      histogram = std::make_unique<MetricHistogram>();
+   }
+
+   return *histogram;
+}
+
+void Metrics::update()
+{
+   using Clock = MetricRegistry::Clock;
+
+   auto &registry = getRegistry();
+   auto now = Clock::now();
+
+   std::string dumpFile;
+   {
+      std::lock_guard<std::mutex> guard(registry.mutex);
+
+      float elapsed = std::chrono::duration<float>(
+         now - registry.windowStart).count();
+
+      bool windowDone = elapsed >= 1.0f;
+      if (windowDone) {
+         registry.windowStart = now;
+      }
+
+      for (auto &entry : registry.counters) {
+         auto &counter = entry.getValue();
+         uint64_t value = counter.counter->getValue();
+
+         counter.perFrame = value - counter.lastValue;
+         counter.lastValue = value;
+
+         if (windowDone) {
+            counter.perSecond = (value - counter.windowValue) / elapsed;
+            counter.windowValue = value;
+         }
+      }
+
+      if (registry.dumpInterval <= 0
+      || std::chrono::duration<float>(now - registry.lastDump).count()
+         < registry.dumpInterval) {
+         return;
+      }
+
+      registry.lastDump = now;
+      dumpFile = registry.dumpFile;
+   }
+
+   std::error_code EC;
+   llvm::raw_fd_ostream OS(dumpFile, EC, llvm::sys::fs::OF_Append);
+   if (EC) {
+      llvm::errs() << "Failed to dump metrics to " << dumpFile << ": "
+                   << EC.message() << "\n";
+
+      setDumpInterval(0);
+      return;
+   }
+
+   auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+
+   OS << "--- " << timestamp << "\n";
+   print(OS);
+
+   OS.close();
+   if (OS.has_error()) {
+      OS.clear_error();
+   }
+}
+
+void Metrics::setDumpInterval(float interval, llvm::StringRef fileName)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   registry.dumpInterval = interval;
+   registry.dumpFile = fileName.str();
+   registry.lastDump = MetricRegistry::Clock::now();
+}
+
+float Metrics::getDumpInterval()
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   return registry.dumpInterval;
+}
+
+/// \return The keys of \p map, sorted.
+template<class T>
+static std::vector<llvm::StringRef> getSortedKeys(const llvm::StringMap<T> &map)
+{
+   std::vector<llvm::StringRef> keys;
+   for (auto &entry : map) {
+      keys.push_back(entry.getKey());
+   }
+
+   std::sort(keys.begin(), keys.end());
+   return keys;
+}
+
+void Metrics::print(llvm::raw_ostream &OS)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   for (auto name : getSortedKeys(registry.counters)) {
+      auto &entry = registry.counters.find(name)->getValue();
+      OS << name << ": " << entry.lastValue << " (" << entry.perFrame
+         << "/frame, " << llvm::format("%0.1f", entry.perSecond) << "/s)\n";
+   }
+
+   for (auto name : getSortedKeys(registry.gauges)) {
+      OS << name << ": " << registry.gauges.find(name)->getValue()->getValue()
+         << "\n";
+   }
+
+   for (auto name : getSortedKeys(registry.histograms)) {
+      auto &histogram = *registry.histograms.find(name)->getValue();
+      OS << name << ": n=" << histogram.getCount()
+         << " mean=" << llvm::format("%0.1f", histogram.getMean())
+         << " p50<=" << histogram.getPercentile(50)
+         << " p99<=" << histogram.getPercentile(99)
+         << " max=" << histogram.getMax() << "\n";
+   }
+}
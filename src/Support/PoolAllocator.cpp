@@ -0,0 +1,177 @@
+#include "mineshaft/Support/PoolAllocator.h"
+
+#include <algorithm>
+
+using namespace mc;
+
+/// The source of unique pool IDs. Zero marks an unused thread cache.
+static std::atomic<unsigned> nextPoolID{ 1 };
+
+thread_local PoolAllocator::ThreadCache
+   PoolAllocator::threadCaches[PoolAllocator::MaxThreadCaches];
+
+PoolAllocator::PoolAllocator(size_t objectSize, size_t alignment,
+                             const char *name)
+   : name(name), id(nextPoolID.fetch_add(1)),
+     alignment(std::max(alignment, alignof(FreeObject)))
+{
+   // Freed objects store the free list link in place.
+   objectSize = std::max(objectSize, sizeof(FreeObject));
+   this->objectSize = (objectSize + this->alignment - 1)
+      & ~(this->alignment - 1);
+
+   objectsPerSlab = (unsigned)std::max<size_t>(SlabSize / this->objectSize, 1);
+   batchSize = std::max(objectsPerSlab / 4, 1u);
+}
+
+PoolAllocator::~PoolAllocator()
+{
+   for (void *slab : slabs) {
+      ::operator delete(slab, std::align_val_t(alignment));
+   }
+}
+
+PoolAllocator::ThreadCache *PoolAllocator::getThreadCache()
+{
+   auto &cache = threadCaches[id % MaxThreadCaches];
+   if (cache.poolID == id) {
+      return &cache;
+   }
+
+   // The slot may still hold objects of a pool that was destroyed, which
+   // must not be touched anymore. Only claim unused slots.
+   if (cache.poolID != 0) {
+      return nullptr;
+   }
+
+   cache.poolID = id;
+   return &cache;
+}
+
+void PoolAllocator::reserveSlab()
+{
+   auto *slab = static_cast<char*>(
+      ::operator new(objectsPerSlab * objectSize, std::align_val_t(alignment)));
+
+   slabs.push_back(slab);
+
+   // Link the objects in address order.
+   for (unsigned i = objectsPerSlab; i-- > 0;) {
+      auto *obj = reinterpret_cast<FreeObject*>(slab + i * objectSize);
+      obj->next = freeList;
+      freeList = obj;
+   }
+}
+
+void PoolAllocator::refill(ThreadCache &cache)
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   if (!freeList) {
+      reserveSlab();
+   }
+
+   while (freeList && cache.count < batchSize) {
+      FreeObject *obj = freeList;
+      freeList = obj->next;
+
+      obj->next = cache.head;
+      cache.head = obj;
+      ++cache.count;
+   }
+}
+
+void PoolAllocator::flush(ThreadCache &cache)
+{
+   // Detach a batch before taking the lock.
+   FreeObject *first = cache.head;
+   FreeObject *last = first;
+   for (unsigned i = 1; i < batchSize; ++i) {
+      last = last->next;
+   }
+
+   cache.head = last->next;
+   cache.count -= batchSize;
+
+   std::lock_guard<std::mutex> guard(mutex);
+   last->next = freeList;
+   freeList = first;
+}
+
+void *PoolAllocator::Allocate()
+{
+   totalAllocations.fetch_add(1, std::memory_order_relaxed);
+
+   size_t live = liveObjects.fetch_add(1, std::memory_order_relaxed) + 1;
+   size_t peak = peakLiveObjects.load(std::memory_order_relaxed);
+   while (live > peak
+   && !peakLiveObjects.compare_exchange_weak(peak, live,
+                                             std::memory_order_relaxed)) {
+      // Retry with the updated peak.
+   }
+
+   ThreadCache *cache = getThreadCache();
+   if (!cache) {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (!freeList) {
+         reserveSlab();
+      }
+
+      FreeObject *obj = freeList;
+      freeList = obj->next;
+
+      return obj;
+   }
+
+   if (!cache->head) {
+      refill(*cache);
+   }
+
+   FreeObject *obj = cache->head;
+   cache->head = obj->next;
+   --cache->count;
+
+   return obj;
+}
+
+void PoolAllocator::Deallocate(void *ptr)
+{
+   if (!ptr) {
+      return;
+   }
+
+   liveObjects.fetch_sub(1, std::memory_order_relaxed);
+
+   auto *obj = static_cast<FreeObject*>(ptr);
+
+   ThreadCache *cache = getThreadCache();
+   if (!cache) {
+      std::lock_guard<std::mutex> guard(mutex);
+      obj->next = freeList;
+      freeList = obj;
+
+      return;
+   }
+
+   obj->next = cache->head;
+   cache->head = obj;
+
+   // Keep at most two batches, so that memory freed on one thread can be
+   // reused by the others.
+   if (++cache->count >= 2 * batchSize) {
+      flush(*cache);
+   }
+}
+
+PoolStats PoolAllocator::getStats()
+{
+   PoolStats stats;
+   stats.objectSize = objectSize;
+   stats.liveObjects = liveObjects.load(std::memory_order_relaxed);
+   stats.peakLiveObjects = peakLiveObjects.load(std::memory_order_relaxed);
+   stats.totalAllocations = totalAllocations.load(std::memory_order_relaxed);
+
+   std::lock_guard<std::mutex> guard(mutex);
+   stats.reservedBytes = slabs.size() * objectsPerSlab * objectSize;
+
+   return stats;
+}
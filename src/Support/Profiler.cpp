@@ -0,0 +1,347 @@
+#include "mineshaft/Support/Profiler.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace mc;
+
+namespace {
+
+/// An event in a ring buffer. Other threads may read an event while it is
+/// overwritten, so the fields are atomic; torn events are detected and
+/// dropped by the reader.
+struct EventSlot {
+   std::atomic<const char*> name;
+   std::atomic<uint64_t> begin;
+   std::atomic<uint64_t> end;
+   std::atomic<uint32_t> depth;
+
+   void store(const ProfileEvent &event)
+   {
+      name.store(event.name, std::memory_order_relaxed);
+      begin.store(event.begin, std::memory_order_relaxed);
+      end.store(event.end, std::memory_order_relaxed);
+      depth.store(event.depth, std::memory_order_relaxed);
+   }
+
+   ProfileEvent load() const
+   {
+      return ProfileEvent{ name.load(std::memory_order_relaxed),
+                           begin.load(std::memory_order_relaxed),
+                           end.load(std::memory_order_relaxed),
+                           depth.load(std::memory_order_relaxed) };
+   }
+};
+
+/// The zones recorded by a single thread.
+struct ThreadBuffer {
+   /// The ring buffer of events. Only written by the owning thread.
+   EventSlot events[Profiler::BufferSize];
+
+   /// The number of events recorded so far.
+   std::atomic<uint64_t> numEvents{ 0 };
+
+   /// The current nesting depth. Only used by the owning thread.
+   uint32_t depth = 0;
+
+   /// The name of the thread, or nullptr.
+   std::atomic<const char*> name{ nullptr };
+
+   /// The ID of the thread in the exported traces.
+   unsigned id = 0;
+};
+
+/// The buffers of all threads that ever recorded a zone. Buffers are never
+/// freed, so that the zones of finished threads can still be exported.
+struct BufferRegistry {
+   std::mutex mutex;
+   std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+} // anonymous namespace
+
+std::atomic<bool> Profiler::enabled{ true };
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+static BufferRegistry &getRegistry()
+{
+   static BufferRegistry registry;
+   return registry;
+}
+
+static thread_local ThreadBuffer *currentBuffer = nullptr;
+
+/// The buffer of the thread that renders the frames.
+static std::atomic<ThreadBuffer*> mainThreadBuffer{ nullptr };
+
+/// The start of the current frame.
+static std::atomic<uint64_t> currentFrameBegin{ 0 };
+
+/// The bounds of the last finished frame.
+static std::atomic<uint64_t> lastFrameBegin{ 0 };
+static std::atomic<uint64_t> lastFrameEnd{ 0 };
+
+/// The track of the GPU zones, written by the thread that owns the GL
+/// context.
+static ThreadBuffer *gpuBuffer = nullptr;
+
+/// Add a new buffer to the registry.
+static ThreadBuffer *createBuffer()
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+
+   auto *buffer = registry.buffers.back().get();
+   buffer->id = (unsigned)registry.buffers.size();
+
+   return buffer;
+}
+
+static ThreadBuffer &getThreadBuffer()
+{
+   if (!currentBuffer) {
+      currentBuffer = createBuffer();
+   }
+
+   return *currentBuffer;
+}
+
+/// Append an event to a buffer. Must only be called by the buffer's writer.
+static void appendEvent(ThreadBuffer &buffer, const ProfileEvent &event)
+{
+   uint64_t idx = buffer.numEvents.load(std::memory_order_relaxed);
+   buffer.events[idx % Profiler::BufferSize].store(event);
+   buffer.numEvents.store(idx + 1, std::memory_order_release);
+}
+
+/// Copy the events of \p buffer that are still intact and ended after
+/// \p minEnd, oldest first. The owning thread keeps recording, so events that
+/// were overwritten while copying are dropped.
+static void copyEvents(const ThreadBuffer &buffer,
+                       std::vector<ProfileEvent> &events,
+                       uint64_t minEnd = 0) {
+   events.clear();
+
+   uint64_t end = buffer.numEvents.load(std::memory_order_acquire);
+   uint64_t begin = end > Profiler::BufferSize ? end - Profiler::BufferSize : 0;
+
+   // Events are recorded in the order they end, so only the newest ones need
+   // to be copied.
+   uint64_t first = end;
+   while (first > begin) {
+      auto &slot = buffer.events[(first - 1) % Profiler::BufferSize];
+      ProfileEvent event = slot.load();
+      if (event.end <= minEnd) {
+         break;
+      }
+
+      events.push_back(event);
+      --first;
+   }
+
+   std::reverse(events.begin(), events.end());
+   std::atomic_thread_fence(std::memory_order_acquire);
+
+   uint64_t newEnd = buffer.numEvents.load(std::memory_order_relaxed);
+   if (newEnd > Profiler::BufferSize
+   && newEnd - Profiler::BufferSize > first) {
+      uint64_t numOverwritten = std::min<uint64_t>(
+         newEnd - Profiler::BufferSize - first, events.size());
+
+      events.erase(events.begin(), events.begin() + numOverwritten);
+   }
+}
+
+/// Add an event to the zone summaries, merging it with an earlier zone of
+/// the same name and depth.
+static void addToSummary(llvm::SmallVectorImpl<ProfileZoneSummary> &zones,
+                         const ProfileEvent &event, uint32_t depth) {
+   for (auto &zone : zones) {
+      if (zone.depth == depth && llvm::StringRef(zone.name) == event.name) {
+         zone.time += event.end - event.begin;
+         ++zone.count;
+
+         return;
+      }
+   }
+
+   zones.push_back(ProfileZoneSummary{ event.name, depth,
+                                       event.end - event.begin, 1 });
+}
+
+uint64_t Profiler::now()
+{
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Profiler::setThreadName(const char *name)
+{
+   getThreadBuffer().name.store(name);
+}
+
+void Profiler::beginFrame()
+{
+   mainThreadBuffer.store(&getThreadBuffer());
+
+   uint64_t time = now();
+   lastFrameBegin.store(currentFrameBegin.exchange(time));
+   lastFrameEnd.store(time);
+}
+
+uint32_t Profiler::enterZone()
+{
+   return getThreadBuffer().depth++;
+}
+
+void Profiler::leaveZone()
+{
+   --getThreadBuffer().depth;
+}
+
+void Profiler::record(const char *name, uint64_t begin, uint32_t depth)
+{
+   appendEvent(getThreadBuffer(), ProfileEvent{ name, begin, now(), depth });
+}
+
+void Profiler::recordGPUZone(const char *name, uint64_t begin, uint64_t end)
+{
+   if (!isEnabled()) {
+      return;
+   }
+
+   if (!gpuBuffer) {
+      gpuBuffer = createBuffer();
+      gpuBuffer->name.store("GPU");
+   }
+
+   appendEvent(*gpuBuffer, ProfileEvent{ name, begin, end, 0 });
+}
+
+void Profiler::summarizeLastFrame(ProfileFrameSummary &summary)
+{
+   summary.frameTime = 0;
+   summary.mainThreadZones.clear();
+   summary.backgroundZones.clear();
+
+   uint64_t frameBegin = lastFrameBegin.load();
+   uint64_t frameEnd = lastFrameEnd.load();
+   if (frameEnd <= frameBegin) {
+      return;
+   }
+
+   summary.frameTime = frameEnd - frameBegin;
+
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   std::vector<ProfileEvent> events;
+   for (auto &buffer : registry.buffers) {
+      copyEvents(*buffer, events, frameBegin);
+
+      // GPU zones lag behind, they are shown by the GPU profiler.
+      if (buffer.get() == gpuBuffer) {
+         continue;
+      }
+
+      if (buffer.get() != mainThreadBuffer.load()) {
+         for (auto &event : events) {
+            if (event.depth == 0 && event.end > frameBegin
+            && event.end <= frameEnd) {
+               addToSummary(summary.backgroundZones, event, 0);
+            }
+         }
+
+         continue;
+      }
+
+      // Zones are recorded when they end, i.e. after their children. Sort
+      // them so that every zone precedes its children.
+      events.erase(std::remove_if(events.begin(), events.end(),
+                                  [&](const ProfileEvent &event) {
+                                     return event.begin < frameBegin
+                                        || event.end > frameEnd;
+                                  }),
+                   events.end());
+
+      std::sort(events.begin(), events.end(),
+                [](const ProfileEvent &lhs, const ProfileEvent &rhs) {
+                   if (lhs.begin != rhs.begin) {
+                      return lhs.begin < rhs.begin;
+                   }
+
+                   return lhs.depth < rhs.depth;
+                });
+
+      for (auto &event : events) {
+         addToSummary(summary.mainThreadZones, event, event.depth);
+      }
+   }
+}
+
+void Profiler::exportChromeTrace(llvm::raw_ostream &OS)
+{
+   auto &registry = getRegistry();
+   std::lock_guard<std::mutex> guard(registry.mutex);
+
+   OS << "{\"traceEvents\":[\n";
+
+   bool first = true;
+   auto separate = [&]() {
+      if (!first) {
+         OS << ",\n";
+      }
+
+      first = false;
+   };
+
+   std::vector<ProfileEvent> events;
+   for (auto &buffer : registry.buffers) {
+      if (const char *name = buffer->name.load()) {
+         separate();
+         OS << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":"
+            << buffer->id << ",\"args\":{\"name\":\"" << name << "\"}}";
+      }
+
+      copyEvents(*buffer, events);
+      for (auto &event : events) {
+         separate();
+         OS << "{\"name\":\"" << event.name
+            << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->id
+            << ",\"ts\":" << llvm::format("%.3f", event.begin / 1000.0)
+            << ",\"dur\":"
+            << llvm::format("%.3f", (event.end - event.begin) / 1000.0)
+            << "}";
+      }
+   }
+
+   OS << "\n]}\n";
+}
+
+bool Profiler::exportChromeTrace(llvm::StringRef fileName)
+{
+   std::error_code EC;
+   llvm::raw_fd_ostream OS(fileName, EC, llvm::sys::fs::OF_None);
+   if (EC) {
+      return false;
+   }
+
+   exportChromeTrace(OS);
+   OS.close();
+
+   if (OS.has_error()) {
+      OS.clear_error();
+      return false;
+   }
+
+   return true;
+}
@@ -64,6 +64,7 @@ class BlockFunctionEmitter {
 
    void emitIsTransparent(llvm::ArrayRef<Record*> blocks);
    void emitIsSolid(llvm::ArrayRef<Record*> blocks);
+   void emitGetLightLevel(llvm::ArrayRef<Record*> blocks);
    void emitUseCubeMap(llvm::ArrayRef<Record*> blocks);
    void emitGetTextureUV(llvm::ArrayRef<Record *> blocks);
    void emitCreate(Record *block);
@@ -87,6 +88,7 @@ void BlockFunctionEmitter::Emit()
 
    emitIsTransparent(blocks);
    emitIsSolid(blocks);
+   emitGetLightLevel(blocks);
 
    for (auto *block : blocks) {
       emitCreate(block);
@@ -179,6 +181,22 @@ void BlockFunctionEmitter::emitIsSolid(llvm::ArrayRef<Record *> blocks)
    OS << "   }\n}\n";
 }
 
+void BlockFunctionEmitter::emitGetLightLevel(llvm::ArrayRef<Record *> blocks)
+{
+   OS << "uint8_t Block::getLightLevel(BlockID blockID)\n{\n";
+   OS << "   switch (blockID) {\n";
+
+   for (auto *block : blocks) {
+      auto lightLevel = support::cast<IntegerLiteral>(
+         block->getFieldValue("lightLevel"))->getVal().getZExtValue();
+
+      OS << "   case BlockID::" << block->getName() << ": return "
+         << lightLevel << ";\n";
+   }
+
+   OS << "   }\n}\n";
+}
+
 void BlockFunctionEmitter::emitUseCubeMap(llvm::ArrayRef<Record *> blocks)
 {
    OS << "bool Block::usesCubeMap(BlockID blockID)\n{\n";
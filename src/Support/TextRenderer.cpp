@@ -66,50 +66,118 @@ void TextRenderer::initialize(llvm::StringRef bmfontFile)
                                  (float) Ctx.getCamera().getViewportHeight(), 0.0f);
 }
 
-void TextRenderer::renderCharacter(CharacterData &data,
-                                   const glm::vec2 &pos,
-                                   float scale) {
-   if (!data.mesh.VAO) {
-      glm::vec2 uv;
-      uv.x = (float)data.x / (float)width;
-      uv.y = (float)data.y / (float)height;
-
-      float x = (float)data.xoffset;
-      float y = (float)data.yoffset;
-
-      data.mesh = Mesh::createQuad(glm::vec3(x, y, 0.0f),
-                                   glm::vec3(x, y + data.height, 0.0f),
-                                   glm::vec3(x + data.width, y + data.height, 0.0f),
-                                   glm::vec3(x + data.width, y, 0.0f),
-                                   uv, (float)data.width / (float)width,
-                                   (float)data.height / (float)height,
-                                   GL_CW);
-
-      data.mesh.Textures.emplace_back(fontTexture, Material());
+TextRenderer::TextLayout &TextRenderer::getLayout(llvm::StringRef text)
+{
+   auto It = layoutCache.try_emplace(text);
+   auto &layout = It.first->getValue();
+   layout.lastUsedFrame = frameCount;
+
+   if (!It.second) {
+      return layout;
    }
 
-   glm::mat4 modelMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, 0.0f));
-   modelMatrix = glm::translate(modelMatrix, glm::vec3(pos, 0.0f));
+   glm::vec2 cursor(0.0f);
+   for (char c : text) {
+      if (c == '\n') {
+         cursor.x = 0.0f;
+         cursor.y += charHeight;
 
-   auto &shader = Ctx.getShader(Application::BASIC_SHADER);
-   data.mesh.render(shader, projectionMatrix, modelMatrix);
+         continue;
+      }
+
+      auto charIt = characterData.find((unsigned char)c);
+      if (charIt == characterData.end()) {
+         continue;
+      }
+
+      auto &data = charIt->second;
+
+      glm::vec2 uv((float)data.x / (float)width, (float)data.y / (float)height);
+      glm::vec2 uvSize((float)data.width / (float)width,
+                       (float)data.height / (float)height);
+
+      float x = cursor.x + (float)data.xoffset;
+      float y = cursor.y + (float)data.yoffset;
+
+      // Bottom left, top left, top right, bottom right, with the same
+      // texture coordinates as a clockwise Mesh::createQuad.
+      auto &vertices = layout.vertices;
+      vertices.emplace_back(glm::vec3(x, y, 0.0f), uv, glm::vec3());
+      vertices.emplace_back(glm::vec3(x, y + data.height, 0.0f),
+                            glm::vec2(uv.x, uv.y + uvSize.y), glm::vec3());
+      vertices.emplace_back(glm::vec3(x + data.width, y + data.height, 0.0f),
+                            uv + uvSize, glm::vec3());
+      vertices.emplace_back(glm::vec3(x + data.width, y, 0.0f),
+                            glm::vec2(uv.x + uvSize.x, uv.y), glm::vec3());
+
+      cursor.x += data.xadvance;
+   }
+
+   return layout;
 }
 
 void TextRenderer::renderText(llvm::StringRef text,
                               const glm::vec2 &pos,
                               float scale) {
-   glm::vec2 cursor = pos;
-   for (auto &c : text) {
-      if (c == '\n') {
-         cursor.x = pos.x;
-         cursor.y += charHeight;
+   auto &layout = getLayout(text);
+   if (layout.vertices.empty()) {
+      return;
+   }
 
-         continue;
+   auto &vertices = batch.Vertices;
+   size_t firstVertex = vertices.size();
+   vertices.insert(vertices.end(), layout.vertices.begin(),
+                   layout.vertices.end());
+
+   // Move the glyphs into screen space.
+   for (size_t i = firstVertex; i < vertices.size(); ++i) {
+      auto &position = vertices[i].Position;
+      position.x = (position.x + pos.x) * scale;
+      position.y = (position.y + pos.y) * scale;
+   }
+
+   // Every glyph quad uses the same index pattern, so the indices only have
+   // to grow with the number of queued glyphs.
+   auto &indices = batch.Indices;
+   auto numQuads = (unsigned)(vertices.size() / 4);
+
+   for (auto quad = (unsigned)(indices.size() / 6); quad < numQuads; ++quad) {
+      unsigned base = quad * 4;
+      indices.insert(indices.end(), {
+         base, base + 2, base + 3, base, base + 1, base + 2,
+      });
+   }
+}
+
+void TextRenderer::flush()
+{
+   ++frameCount;
+
+   // Forget strings that were not drawn in the last frame once the cache
+   // gets too big, e.g. because of constantly changing numbers.
+   if (layoutCache.size() > MaxCachedLayouts) {
+      for (auto It = layoutCache.begin(); It != layoutCache.end();) {
+         auto Curr = It++;
+         if (Curr->getValue().lastUsedFrame + 1 < frameCount) {
+            layoutCache.erase(Curr);
+         }
       }
+   }
 
-      auto &data = characterData[c];
-      renderCharacter(data, cursor, scale);
+   if (batch.Vertices.empty()) {
+      return;
+   }
 
-      cursor.x += data.xadvance;
+   if (batch.Textures.empty()) {
+      batch.Textures.emplace_back(fontTexture, Material());
    }
-}
\ No newline at end of file
+
+   // Only draw the indices of the glyphs queued in this frame.
+   batch.Indices.resize(batch.Vertices.size() / 4 * 6);
+   batch.updateMesh();
+
+   auto &shader = Ctx.getShader(Application::BASIC_SHADER);
+   batch.render(shader, projectionMatrix, glm::mat4(1.0f));
+
+   batch.Vertices.clear();
+}
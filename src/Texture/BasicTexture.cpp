@@ -1,5 +1,7 @@
 #include "mineshaft/Texture/BasicTexture.h"
 
+#include "mineshaft/Shader/RenderState.h"
+
 using namespace mc;
 
 BasicTexture::BasicTexture()
@@ -10,6 +12,17 @@ BasicTexture::BasicTexture()
 
 BasicTexture::~BasicTexture()
 {
+   // The placeholder texture is shared and owned by the asset loader.
+   if (pending) {
+      return;
+   }
+
+   // Headless textures are never uploaded.
+   if (!textureID) {
+      return;
+   }
+
+   RenderState::forgetTexture(textureID);
    glDeleteTextures(1, &textureID);
 }
 
@@ -35,5 +48,5 @@ BasicTexture::BasicTexture(Kind K, GLuint textureID, std::string &&File,
 
 void BasicTexture::bindTexture() const
 {
-   glBindTexture(GL_TEXTURE_2D, textureID);
+   RenderState::bindTexture(GL_TEXTURE_2D, textureID);
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "mineshaft/Texture/TextureArray.h"
 
+#include "mineshaft/Shader/RenderState.h"
+
 using namespace mc;
 
 TextureArray::TextureArray(BasicTexture::Kind textureKind, GLuint textureID,
@@ -16,47 +18,47 @@ TextureArray::TextureArray() : TextureArray(BasicTexture::DIFFUSE, 0, 0)
 TextureArray TextureArray::create(BasicTexture::Kind textureKind,
                                   unsigned height, unsigned width,
                                   unsigned layers) {
-   glActiveTexture(GL_TEXTURE0);
+   RenderState::activeTexture(GL_TEXTURE0);
 
    GLuint textureID;
    glGenTextures(1, &textureID);
 
-   glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+   RenderState::bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA,
                 width, height, layers,
                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
-   glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+   RenderState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
    return TextureArray(textureKind, textureID, GL_TEXTURE_2D_ARRAY);
 }
 
 TextureArray TextureArray::createCubemap(mc::BasicTexture::Kind textureKind,
                                          unsigned height, unsigned width,
                                          unsigned layers) {
-   glActiveTexture(GL_TEXTURE1);
+   RenderState::activeTexture(GL_TEXTURE1);
 
    GLuint textureID;
    glGenTextures(1, &textureID);
 
-   glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, textureID);
+   RenderState::bindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, textureID);
    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_RGBA,
                 width, height, layers * 6,
                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
-   glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+   RenderState::bindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
    return TextureArray(textureKind, textureID, GL_TEXTURE_CUBE_MAP_ARRAY);
 }
 
 void TextureArray::bind() const
 {
    if (isCubeMap()) {
-      glActiveTexture(GL_TEXTURE1);
+      RenderState::activeTexture(GL_TEXTURE1);
    }
    else {
-      glActiveTexture(GL_TEXTURE0);
+      RenderState::activeTexture(GL_TEXTURE0);
    }
 
-   glBindTexture(glTextureKind, textureID);
+   RenderState::bindTexture(glTextureKind, textureID);
 }
 
 void TextureArray::addTexture(const sf::Image &Img, unsigned layer,
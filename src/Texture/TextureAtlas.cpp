@@ -1,5 +1,6 @@
 #include "mineshaft/Texture/TextureAtlas.h"
 #include "mineshaft/Application.h"
+#include "mineshaft/Shader/RenderState.h"
 
 #include <llvm/ADT/SmallString.h>
 
@@ -9,7 +10,8 @@ llvm::Optional<TextureAtlas>
 TextureAtlas::fromFile(BasicTexture::Kind textureKind,
                        llvm::StringRef FileName,
                        float textureWidth,
-                       float textureHeight) {
+                       float textureHeight,
+                       bool upload) {
    llvm::SmallString<64> fileName;
    fileName += "../assets/textures/";
    fileName += FileName;
@@ -21,9 +23,14 @@ TextureAtlas::fromFile(BasicTexture::Kind textureKind,
       return llvm::None;
    }
 
+   if (!upload) {
+      return TextureAtlas(textureKind, 0, std::move(str), std::move(Img),
+                          textureWidth, textureHeight);
+   }
+
    GLuint textureID;
    glGenTextures(1, &textureID);
-   glBindTexture(GL_TEXTURE_2D, textureID);
+   RenderState::bindTexture(GL_TEXTURE_2D, textureID);
 
    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, Img.getSize().x, Img.getSize().y,
                 0, GL_RGBA, GL_UNSIGNED_BYTE, Img.getPixelsPtr());
@@ -104,8 +111,8 @@ glm::vec2 TextureAtlas::getTextureUVCoords(GLuint BeginX, GLuint BeginY)
 
 void TextureAtlas::bind() const
 {
-   glActiveTexture(GL_TEXTURE0);
-   glBindTexture(GL_TEXTURE_2D, textureID);
+   RenderState::activeTexture(GL_TEXTURE0);
+   RenderState::bindTexture(GL_TEXTURE_2D, textureID);
 }
 
 BasicTexture *TextureAtlas::getTexture(Application &Ctx,
@@ -1,23 +1,49 @@
 #include "mineshaft/World/Chunk.h"
 
 #include "mineshaft/Application.h"
+#include "mineshaft/Support/Metrics.h"
+#include "mineshaft/Support/Profiler.h"
+#include "mineshaft/World/LightEngine.h"
 #include "mineshaft/World/World.h"
 
 using namespace mc;
 
+/// The number of chunks that were meshed.
+static MetricCounter &numMeshedChunks = Metrics::getCounter("chunks.meshed");
+
+/// The time it takes to mesh a chunk in microseconds.
+static MetricHistogram &meshTime = Metrics::getHistogram("chunks.meshTime.us");
+
+/// The number of vertices in all chunk meshes.
+static MetricGauge &numMeshVertices = Metrics::getGauge("mesh.vertices");
+
+/// The number of indices in all chunk meshes.
+static MetricGauge &numMeshIndices = Metrics::getGauge("mesh.indices");
+
+/// Add the size of \p mesh, multiplied by \p sign, to the mesh gauges.
+static void countSectionMesh(const ChunkSectionMesh &mesh, int sign)
+{
+   for (const Mesh *part : { &mesh.terrainMesh, &mesh.translucentMesh,
+                             &mesh.waterMesh }) {
+      numMeshVertices.add(sign * (int64_t)part->Vertices.size());
+      numMeshIndices.add(sign * (int64_t)part->Indices.size());
+   }
+}
+
 ChunkSegment::ChunkSegment()
 {
    std::memset(blockStorage, 0, sizeof(blockStorage));
+   std::memset(collisionMask, 0, sizeof(collisionMask));
+
+   for (auto &light : lightStorage) {
+      light.store(FullSkyLight, std::memory_order_relaxed);
+   }
 }
 
 Block &ChunkSegment::getBlockAt(const BlockPositionChunk &pos)
 {
-   int x = pos.x, y = pos.y, z = pos.z;
-   y += MC_CHUNK_HEIGHT / 2;
-   y %= MC_CHUNK_SEGMENT_HEIGHT;
-
    auto *blockPtr = reinterpret_cast<Block*>(&blockStorage);
-   return blockPtr[x + MC_CHUNK_WIDTH * (y + MC_CHUNK_SEGMENT_HEIGHT * z)];
+   return blockPtr[getIndex(pos)];
 }
 
 const Block &ChunkSegment::getBlockAt(const BlockPositionChunk &pos) const
@@ -37,13 +63,32 @@ Chunk::Chunk(World *world, int x, int z)
    initialize(world, x, z);
 }
 
+Chunk::~Chunk()
+{
+   for (auto &sectionMesh : chunkMesh.sections) {
+      countSectionMesh(sectionMesh, -1);
+   }
+
+   if (!world) {
+      return;
+   }
+
+   auto &pool = world->getApplication().getChunkSegmentPool();
+   for (auto *seg : chunkSegments) {
+      pool.destroy(seg);
+   }
+}
+
 Chunk::Chunk(mc::Chunk &&Other) noexcept
    : Chunk()
 {
    std::swap(world, Other.world);
    std::swap(x, Other.x);
    std::swap(z, Other.z);
+   generationState.store(Other.generationState.exchange(generationState.load()));
    std::swap(chunkMesh, Other.chunkMesh);
+   std::swap(dirtySections, Other.dirtySections);
+   std::swap(occludingSections, Other.occludingSections);
    std::swap(boundingBox, Other.boundingBox);
 
    for (unsigned i = 0; i < (MC_CHUNK_HEIGHT / MC_CHUNK_SEGMENT_HEIGHT); ++i) {
@@ -56,7 +101,10 @@ Chunk& Chunk::operator=(Chunk &&Other) noexcept
    std::swap(world, Other.world);
    std::swap(x, Other.x);
    std::swap(z, Other.z);
+   generationState.store(Other.generationState.exchange(generationState.load()));
    std::swap(chunkMesh, Other.chunkMesh);
+   std::swap(dirtySections, Other.dirtySections);
+   std::swap(occludingSections, Other.occludingSections);
    std::swap(boundingBox, Other.boundingBox);
 
    for (unsigned i = 0; i < (MC_CHUNK_HEIGHT / MC_CHUNK_SEGMENT_HEIGHT); ++i) {
@@ -66,6 +114,27 @@ Chunk& Chunk::operator=(Chunk &&Other) noexcept
    return *this;
 }
 
+void Chunk::unload()
+{
+   setGenerationState(GenerationState::NotGenerated);
+
+   // Replacing the section meshes frees their vertices and GPU buffers.
+   for (auto &sectionMesh : chunkMesh.sections) {
+      countSectionMesh(sectionMesh, -1);
+      sectionMesh = ChunkSectionMesh();
+   }
+
+   auto &pool = world->getApplication().getChunkSegmentPool();
+   for (auto *&seg : chunkSegments) {
+      pool.destroy(seg);
+      seg = nullptr;
+   }
+
+   biome = (Biome)0;
+   dirtySections = AllSections;
+   occludingSections = 0;
+}
+
 void Chunk::initialize(World *world, int x, int z)
 {
    this->world = world;
@@ -94,7 +163,25 @@ void Chunk::initialize(World *world, int x, int z)
 
 const Block *Chunk::getBlockAt(const WorldPosition &pos) const
 {
-   return const_cast<Chunk*>(this)->getBlockAt(pos);
+   if (pos.x >= (this->x + 1) * MC_CHUNK_WIDTH
+   || pos.x < this->x * MC_CHUNK_WIDTH
+   || pos.z >= (this->z + 1) * MC_CHUNK_DEPTH
+   || pos.z < this->z * MC_CHUNK_DEPTH) {
+      return nullptr;
+   }
+
+   if (pos.y >= (MC_CHUNK_HEIGHT / 2) || pos.y < -(MC_CHUNK_HEIGHT / 2)) {
+      return nullptr;
+   }
+
+   // Sections that were never allocated only contain air.
+   auto *seg = const_cast<Chunk*>(this)->getSegmentForYCoord(pos.y, false);
+   if (!seg) {
+      static const Block air(glm::vec3(0.0f));
+      return &air;
+   }
+
+   return &seg->getBlockAt(getPositionInChunk(pos));
 }
 
 Block *Chunk::getBlockAt(const WorldPosition &pos)
@@ -114,6 +201,23 @@ Block *Chunk::getBlockAt(const WorldPosition &pos)
    return &seg->getBlockAt(getPositionInChunk(pos));
 }
 
+uint8_t Chunk::getLightAt(const WorldPosition &pos) const
+{
+   if (pos.y >= (MC_CHUNK_HEIGHT / 2)) {
+      return ChunkSegment::FullSkyLight;
+   }
+   if (pos.y < -(MC_CHUNK_HEIGHT / 2)) {
+      return 0;
+   }
+
+   auto *seg = chunkSegments[(pos.y + (MC_CHUNK_HEIGHT / 2)) / MC_CHUNK_SEGMENT_HEIGHT];
+   if (!seg) {
+      return ChunkSegment::FullSkyLight;
+   }
+
+   return seg->getLight(ChunkSegment::getIndex(getPositionInChunk(pos)));
+}
+
 void Chunk::updateBlock(const mc::WorldPosition &pos,
                         mc::Block &&block,
                         bool recheckVisibility) {
@@ -131,46 +235,68 @@ void Chunk::updateBlock(const mc::WorldPosition &pos,
 
    seg->airOnly &= block.is(Block::Air);
 
-   Block &blockRef = seg->getBlockAt(getPositionInChunk(pos));
+   auto posInChunk = getPositionInChunk(pos);
+   seg->setCollides(ChunkSegment::getIndex(posInChunk), !block.isTransparent());
+
+   Block &blockRef = seg->getBlockAt(posInChunk);
    blockRef = std::move(block);
 
    if (recheckVisibility) {
-      modifiedBlock(getPositionInChunk(pos));
+      modifiedBlock(posInChunk);
    }
 }
 
-void Chunk::modifiedBlock(const mc::BlockPositionChunk &pos)
-{
-   visibilityCalculated = false;
+void Chunk::forEachAffectedSection(
+   const WorldPosition &pos,
+   llvm::function_ref<void(const ChunkPosition&, uint16_t)> fn) {
+   int y = pos.y + (MC_CHUNK_HEIGHT / 2);
+   if (y < 0 || y >= MC_CHUNK_HEIGHT) {
+      return;
+   }
 
-   // Check bordering chunks.
-   if (pos.x == 0) {
-      auto *other = world->getChunk(ChunkPosition(this->x - 1, this->z), false);
-      if (other) {
-         other->visibilityCalculated = false;
-      }
+   unsigned section = y / MC_CHUNK_SEGMENT_HEIGHT;
+   uint16_t mask = 1u << section;
+
+   // Check bordering sections.
+   int yInSection = y % MC_CHUNK_SEGMENT_HEIGHT;
+   if (yInSection == 0 && section > 0) {
+      mask |= 1u << (section - 1);
    }
-   if (pos.x == 15) {
-      auto *other = world->getChunk(ChunkPosition(this->x + 1, this->z), false);
-      if (other) {
-         other->visibilityCalculated = false;
-      }
+   if (yInSection == MC_CHUNK_SEGMENT_HEIGHT - 1
+   && section < ChunkMesh::NumSections - 1) {
+      mask |= 1u << (section + 1);
    }
 
-   if (pos.z == 0) {
-      auto *other = world->getChunk(ChunkPosition(this->x, this->z - 1), false);
-      if (other) {
-         other->visibilityCalculated = false;
-      }
-   }
-   if (pos.z == 15) {
-      auto *other = world->getChunk(ChunkPosition(this->x, this->z + 1), false);
-      if (other) {
-         other->visibilityCalculated = false;
+   // Check bordering chunks, including the diagonal ones.
+   auto chunkPos = mc::getChunkPosition(pos);
+   auto localPos = getPositionInChunk(pos);
+
+   int minX = localPos.x == 0 ? -1 : 0;
+   int maxX = localPos.x == MC_CHUNK_WIDTH - 1 ? 1 : 0;
+   int minZ = localPos.z == 0 ? -1 : 0;
+   int maxZ = localPos.z == MC_CHUNK_DEPTH - 1 ? 1 : 0;
+
+   for (int x = minX; x <= maxX; ++x) {
+      for (int z = minZ; z <= maxZ; ++z) {
+         fn(ChunkPosition(chunkPos.x + x, chunkPos.z + z), mask);
       }
    }
 }
 
+void Chunk::modifiedBlock(const mc::BlockPositionChunk &pos)
+{
+   auto chunkPos = getChunkPosition();
+   forEachAffectedSection(
+      getWorldPosition(pos), [&](const ChunkPosition &otherPos, uint16_t mask) {
+         Chunk *other = otherPos == chunkPos
+            ? this : world->getChunk(otherPos, false);
+
+         if (other) {
+            other->modifiedSections(mask);
+         }
+      });
+}
+
 ChunkSegment* Chunk::getSegmentForYCoord(int y, bool initialize)
 {
    if (y >= (MC_CHUNK_HEIGHT / 2) || y < -(MC_CHUNK_HEIGHT / 2)) {
@@ -187,7 +313,14 @@ ChunkSegment* Chunk::getSegmentForYCoord(int y, bool initialize)
       return seg;
    }
 
-   seg = new(world->getApplication()) ChunkSegment;
+   seg = world->getApplication().getChunkSegmentPool().create<ChunkSegment>();
+
+   // The light of ready chunks is only updated incrementally, so the new
+   // section has to be lit from its surroundings.
+   if (isReady()) {
+      world->getLightEngine()->sectionAllocated(*this, idx);
+   }
+
    return seg;
 }
 
@@ -221,125 +354,278 @@ void Chunk::fillLayerWith(Application &Ctx, int y, const Block &block, unsigned
          if (!holeFrequency || rand() > RAND_MAX / holeFrequency) {
             new(&seg->getBlockAt(pos))
                Block(block, getScenePosition(getWorldPosition(pos)));
+
+            seg->setCollides(ChunkSegment::getIndex(pos), !block.isTransparent());
          }
       }
    }
 }
 
-static void visitBlockNeighbours(World *world, Chunk *chunk,
-                                 Block *blockPtr, int segmentMax, int segmentMin,
-                                 int ox, int oy, int oz,
-                                 bool isWater, bool &foundTransparentBlock,
-                                 unsigned &faceMask) {
-   static constexpr int offsets[][3] = {
-      { 1, 0, 0 },  // Right
-      { -1, 0, 0 }, // Left
-      { 0, 1, 0 },  // Top
-      { 0, -1, 0 }, // Bottom
-      { 0, 0, 1 },  // Front
-      { 0, 0, -1 }, // Back
-   };
-
-   unsigned i = 0;
-   for (auto &offset : offsets) {
-      int x = ox + offset[0], y = oy + offset[1], z = oz + offset[2];
-
-      int indexY = y;
-      indexY += MC_CHUNK_HEIGHT / 2;
-      indexY %= MC_CHUNK_SEGMENT_HEIGHT;
-
-      const Block *neighbour;
-      if (x < 0 || x >= MC_CHUNK_WIDTH
-          || z < 0 || z >= MC_CHUNK_WIDTH
-          || y < segmentMin || y >= segmentMax) {
-         auto worldPos = chunk->getWorldPosition(BlockPositionChunk(x, y, z));
-         neighbour = world->getBlock(worldPos);
-      }
-      else {
-         neighbour = &blockPtr[x + MC_CHUNK_WIDTH * (indexY + MC_CHUNK_SEGMENT_HEIGHT * z)];
-      }
+static_assert(MC_CHUNK_WIDTH == MC_CHUNK_SEGMENT_HEIGHT
+              && MC_CHUNK_DEPTH == MC_CHUNK_SEGMENT_HEIGHT,
+              "sections are expected to be cubes");
 
-      if (neighbour && neighbour->isTransparent()) {
-         // Don't render water blocks next to other water blocks.
-         if (!isWater || !neighbour->is(Block::Water)) {
-            faceMask |= Block::face(i);
-         }
+/// The blocks and light of a chunk section, padded by one block on every side
+/// so that meshing never needs to look up neighbouring chunks per face.
+struct SectionNeighbourhood {
+   /// The number of blocks per side, including the padding.
+   static constexpr int Size = MC_CHUNK_SEGMENT_HEIGHT + 2;
+
+   /// The blocks, nullptr for blocks in chunks that are not loaded.
+   const Block *blocks[Size * Size * Size];
+
+   /// The packed light levels.
+   uint8_t light[Size * Size * Size];
+
+   /// \return The index of a position relative to the section, where every
+   /// coordinate is between -1 and MC_CHUNK_SEGMENT_HEIGHT.
+   static int getIndex(int x, int y, int z)
+   {
+      return (x + 1) + Size * ((y + 1) + Size * (z + 1));
+   }
 
-         foundTransparentBlock = true;
+   /// \return true iff the block at an index hides the blocks behind it.
+   bool isOpaque(int idx) const
+   {
+      return blocks[idx] && !blocks[idx]->isTransparent();
+   }
+
+   /// Gather the blocks and light of a section and its border.
+   void gather(World *world, Chunk *chunk, ChunkSegment *seg, int segmentMin);
+};
+
+void SectionNeighbourhood::gather(World *world, Chunk *chunk,
+                                  ChunkSegment *seg, int segmentMin) {
+   Block *blockPtr = seg->getBlocks().data();
+
+   for (int z = -1; z <= MC_CHUNK_SEGMENT_HEIGHT; ++z) {
+      for (int y = -1; y <= MC_CHUNK_SEGMENT_HEIGHT; ++y) {
+         for (int x = -1; x <= MC_CHUNK_SEGMENT_HEIGHT; ++x) {
+            int idx = getIndex(x, y, z);
+
+            if (x < 0 || x >= MC_CHUNK_WIDTH
+                || y < 0 || y >= MC_CHUNK_SEGMENT_HEIGHT
+                || z < 0 || z >= MC_CHUNK_DEPTH) {
+               auto worldPos = chunk->getWorldPosition(
+                  BlockPositionChunk(x, y + segmentMin, z));
+
+               blocks[idx] = world->getBlock(worldPos);
+               light[idx] = world->getLight(worldPos);
+            }
+            else {
+               unsigned segIdx = x + MC_CHUNK_WIDTH * (y + MC_CHUNK_SEGMENT_HEIGHT * z);
+               blocks[idx] = &blockPtr[segIdx];
+               light[idx] = seg->getLight(segIdx);
+            }
+         }
       }
-      else if (!neighbour) {
-         foundTransparentBlock = true;
+   }
+}
+
+static constexpr int faceOffsets[][3] = {
+   { 1, 0, 0 },  // Right
+   { -1, 0, 0 }, // Left
+   { 0, 1, 0 },  // Top
+   { 0, -1, 0 }, // Bottom
+   { 0, 0, 1 },  // Front
+   { 0, 0, -1 }, // Back
+};
+
+/// Compute the smooth light and ambient occlusion at a corner of a face.
+/// The light is averaged over the block in front of the face and the three
+/// blocks around the corner on the same side, skipping opaque ones.
+static glm::u8vec4 getCornerLight(const SectionNeighbourhood &blocks,
+                                  const int (&front)[3], unsigned face,
+                                  const int (&corner)[3]) {
+   // The two axes that span the face, and the direction towards the corner.
+   int axes[2];
+   int dirs[2];
+
+   unsigned numAxes = 0;
+   for (int axis = 0; axis < 3; ++axis) {
+      if (faceOffsets[face][axis] != 0) {
+         continue;
       }
 
-      ++i;
+      axes[numAxes] = axis;
+      dirs[numAxes] = corner[axis] ? 1 : -1;
+      ++numAxes;
+   }
+
+   int side1[3] = { front[0], front[1], front[2] };
+   side1[axes[0]] += dirs[0];
+
+   int side2[3] = { front[0], front[1], front[2] };
+   side2[axes[1]] += dirs[1];
+
+   int diagonal[3] = { side1[0], side1[1], side1[2] };
+   diagonal[axes[1]] += dirs[1];
+
+   int frontIdx = SectionNeighbourhood::getIndex(front[0], front[1], front[2]);
+   int side1Idx = SectionNeighbourhood::getIndex(side1[0], side1[1], side1[2]);
+   int side2Idx = SectionNeighbourhood::getIndex(side2[0], side2[1], side2[2]);
+   int diagonalIdx = SectionNeighbourhood::getIndex(diagonal[0], diagonal[1],
+                                                    diagonal[2]);
+
+   bool side1Opaque = blocks.isOpaque(side1Idx);
+   bool side2Opaque = blocks.isOpaque(side2Idx);
+
+   // If both sides are opaque, the diagonal block can't be seen from the
+   // corner.
+   bool diagonalOpaque = (side1Opaque && side2Opaque)
+      || blocks.isOpaque(diagonalIdx);
+
+   unsigned ao;
+   if (side1Opaque && side2Opaque) {
+      ao = 0;
+   }
+   else {
+      ao = 3 - (side1Opaque + side2Opaque + blocks.isOpaque(diagonalIdx));
+   }
+
+   unsigned sky = blocks.light[frontIdx] >> 4;
+   unsigned block = blocks.light[frontIdx] & 0xF;
+   unsigned samples = 1;
+
+   if (!side1Opaque) {
+      sky += blocks.light[side1Idx] >> 4;
+      block += blocks.light[side1Idx] & 0xF;
+      ++samples;
+   }
+   if (!side2Opaque) {
+      sky += blocks.light[side2Idx] >> 4;
+      block += blocks.light[side2Idx] & 0xF;
+      ++samples;
+   }
+   if (!diagonalOpaque) {
+      sky += blocks.light[diagonalIdx] >> 4;
+      block += blocks.light[diagonalIdx] & 0xF;
+      ++samples;
    }
+
+   return glm::u8vec4((sky * 255) / (samples * MC_MAX_LIGHT_LEVEL),
+                      (block * 255) / (samples * MC_MAX_LIGHT_LEVEL),
+                      (ao * 255) / 3, 255);
 }
 
-void Chunk::updateVisibility()
+bool Chunk::buildSection(unsigned section, ChunkSectionMesh &mesh)
 {
-   if (visibilityCalculated) {
-      return;
+   auto *seg = chunkSegments[section];
+   if (!seg || seg->airOnly) {
+      return false;
    }
 
    auto &app = world->getApplication();
 
-   visibilityCalculated = true;
-   chunkMesh = ChunkMesh();
+   int segmentMin = (int)(section * MC_CHUNK_SEGMENT_HEIGHT) - (MC_CHUNK_HEIGHT / 2);
 
-//   Timer timer("Creating chunk mesh");
+   // Too big for the stack, and only ever used by the main thread.
+   static SectionNeighbourhood blocks;
+   blocks.gather(world, this, seg, segmentMin);
 
-   int y = (MC_CHUNK_HEIGHT / 2) - 1;
-   bool done = false;
+   for (int y = MC_CHUNK_SEGMENT_HEIGHT - 1; y >= 0; --y) {
+      bool foundTransparentBlock = false;
 
-   for (int segNo = (MC_CHUNK_HEIGHT / MC_CHUNK_SEGMENT_HEIGHT) - 1; segNo >= 0; --segNo) {
-      auto *seg = chunkSegments[segNo];
-      if (!seg || seg->airOnly) {
-         y -= MC_CHUNK_SEGMENT_HEIGHT;
-         continue;
-      }
+      for (int x = 0; x < MC_CHUNK_WIDTH; ++x) {
+         for (int z = 0; z < MC_CHUNK_DEPTH; ++z) {
+            auto &block = *blocks.blocks[SectionNeighbourhood::getIndex(x, y, z)];
+            if (block.is(Block::Air)) {
+               foundTransparentBlock = true;
+               continue;
+            }
+
+            foundTransparentBlock |= block.isTransparent();
 
-      Block *blockPtr = seg->getBlocks().data();
+            bool isWater = block.is(Block::Water);
+            unsigned faceMask = Block::F_None;
+            glm::u8vec4 vertexLight[6][4];
 
-      int segmentMax = y;
-      int endY = y - MC_CHUNK_SEGMENT_HEIGHT;
-      while (y > endY) {
-         bool foundTransparentBlock = false;
+            for (unsigned i = 0; i < 6; ++i) {
+               int front[3] = { x + faceOffsets[i][0], y + faceOffsets[i][1],
+                                z + faceOffsets[i][2] };
 
-         int indexY = y;
-         indexY += MC_CHUNK_HEIGHT / 2;
-         indexY %= MC_CHUNK_SEGMENT_HEIGHT;
+               const Block *neighbour = blocks.blocks[
+                  SectionNeighbourhood::getIndex(front[0], front[1], front[2])];
 
-         for (int x = 0; x < MC_CHUNK_WIDTH; ++x) {
-            for (int z = 0; z < MC_CHUNK_DEPTH; ++z) {
-               auto &block = blockPtr[x + MC_CHUNK_WIDTH * (indexY + MC_CHUNK_SEGMENT_HEIGHT * z)];
-               if (block.is(Block::Air)) {
+               if (!neighbour) {
                   foundTransparentBlock = true;
                   continue;
                }
+               if (!neighbour->isTransparent()) {
+                  continue;
+               }
 
-               foundTransparentBlock |= block.isTransparent();
+               foundTransparentBlock = true;
 
-               unsigned faceMask = Block::F_None;
-               visitBlockNeighbours(world, this, blockPtr, segmentMax, endY, x,
-                                    y, z, block.is(Block::Water),
-                                    foundTransparentBlock, faceMask);
+               // Don't render water blocks next to other water blocks.
+               if (isWater && neighbour->is(Block::Water)) {
+                  continue;
+               }
+
+               faceMask |= Block::face(i);
 
-               if (faceMask != Block::F_None) {
-                  chunkMesh.addFace(app, block, faceMask);
+               for (unsigned j = 0; j < 4; ++j) {
+                  vertexLight[i][j] = getCornerLight(
+                     blocks, front, i, ChunkSectionMesh::FaceCorners[i][j]);
                }
             }
-         }
 
-         if (!foundTransparentBlock) {
-            done = true;
-            break;
+            if (faceMask != Block::F_None) {
+               mesh.addFace(app, block, faceMask, vertexLight);
+            }
          }
+      }
 
-         --y;
+      if (!foundTransparentBlock) {
+         return true;
       }
+   }
+
+   return false;
+}
 
-      if (done) {
-         break;
+void Chunk::updateVisibility()
+{
+   // Chunks that are not loaded yet have nothing to show.
+   if (!dirtySections || !isReady()) {
+      return;
+   }
+
+   MC_PROFILE_SCOPE("meshChunk");
+   uint64_t start = Profiler::now();
+
+   // Go from top to bottom, since sections below an opaque layer are hidden.
+   bool hidden = false;
+   for (int section = ChunkMesh::NumSections - 1; section >= 0; --section) {
+      uint16_t bit = 1u << section;
+      if ((dirtySections & bit) == 0) {
+         hidden |= (occludingSections & bit) != 0;
+         continue;
       }
+
+      auto &sectionMesh = chunkMesh.sections[section];
+      countSectionMesh(sectionMesh, -1);
+      sectionMesh.clear();
+
+      bool occluding = false;
+      if (!hidden) {
+         occluding = buildSection(section, sectionMesh);
+      }
+
+      countSectionMesh(sectionMesh, 1);
+
+      // If this section started or stopped hiding the sections below it,
+      // these need to be updated as well.
+      if (occluding != ((occludingSections & bit) != 0)) {
+         occludingSections ^= bit;
+         dirtySections |= bit - 1;
+      }
+
+      hidden |= occluding;
    }
-}
\ No newline at end of file
+
+   dirtySections = 0;
+
+   numMeshedChunks.add();
+   meshTime.record((Profiler::now() - start) / 1000);
+}
@@ -0,0 +1,169 @@
+#include "mineshaft/World/CollisionSolver.h"
+
+#include "mineshaft/World/World.h"
+
+using namespace mc;
+
+/// Boxes that are closer than this to a block only touch it.
+static constexpr float CollisionEpsilon = 0.0001f;
+
+/// \return The index of the block containing a scene coordinate.
+static int getBlockCoordinate(float coord)
+{
+   return (int)std::floor(coord / MC_BLOCK_SCALE);
+}
+
+/// \return \p a / \p b, rounded towards negative infinity.
+static int floorDiv(int a, int b)
+{
+   int q = a / b;
+   if ((a % b != 0) && ((a < 0) != (b < 0))) {
+      --q;
+   }
+
+   return q;
+}
+
+CollisionSolver::CollisionSolver(World &world)
+   : world(world)
+{
+
+}
+
+uint16_t CollisionSolver::getCollisionRow(int chunkX, int y, int z)
+{
+   if (y >= (MC_CHUNK_HEIGHT / 2) || y < -(MC_CHUNK_HEIGHT / 2)) {
+      return 0;
+   }
+
+   ChunkPosition chunkPos(chunkX, floorDiv(z, MC_CHUNK_DEPTH));
+   if (!hasCachedChunk || chunkPos != cachedChunkPos) {
+      cachedChunkPos = chunkPos;
+      cachedChunk = world.getChunk(chunkPos, false);
+      hasCachedChunk = true;
+
+      // Chunks that are still generating don't collide yet.
+      if (cachedChunk && !cachedChunk->isReady()) {
+         cachedChunk = nullptr;
+      }
+
+      cachedSection = -1;
+   }
+
+   if (!cachedChunk) {
+      return 0;
+   }
+
+   int yInChunk = y + (MC_CHUNK_HEIGHT / 2);
+   int section = yInChunk / MC_CHUNK_SEGMENT_HEIGHT;
+
+   if (section != cachedSection) {
+      cachedSection = section;
+      cachedSegment = cachedChunk->getSegmentForYCoord(y, false);
+   }
+
+   // Segments that were never allocated only contain air.
+   if (!cachedSegment) {
+      return 0;
+   }
+
+   return cachedSegment->getCollisionRow(yInChunk % MC_CHUNK_SEGMENT_HEIGHT,
+                                         z - chunkPos.z * MC_CHUNK_DEPTH);
+}
+
+bool CollisionSolver::anyCollision(const int (&min)[3], const int (&max)[3])
+{
+   int minChunkX = floorDiv(min[0], MC_CHUNK_WIDTH);
+   int maxChunkX = floorDiv(max[0], MC_CHUNK_WIDTH);
+
+   for (int z = min[2]; z <= max[2]; ++z) {
+      for (int y = min[1]; y <= max[1]; ++y) {
+         for (int chunkX = minChunkX; chunkX <= maxChunkX; ++chunkX) {
+            uint16_t row = getCollisionRow(chunkX, y, z);
+            if (!row) {
+               continue;
+            }
+
+            int chunkMinX = chunkX * MC_CHUNK_WIDTH;
+            int fromX = std::max(min[0] - chunkMinX, 0);
+            int toX = std::min(max[0] - chunkMinX, MC_CHUNK_WIDTH - 1);
+
+            uint32_t rangeMask = ((1u << (toX - fromX + 1)) - 1) << fromX;
+            if (row & rangeMask) {
+               return true;
+            }
+         }
+      }
+   }
+
+   return false;
+}
+
+float CollisionSolver::sweep(const BoundingBox &box, int axis, float distance)
+{
+   float boxMin[3] = { box.minX, box.minY, box.minZ };
+   float boxMax[3] = { box.maxX, box.maxY, box.maxZ };
+
+   // The blocks overlapped by the box. Blocks that are only touched are not
+   // included, so that a box resting on the ground can still slide.
+   int min[3];
+   int max[3];
+
+   for (int i = 0; i < 3; ++i) {
+      min[i] = getBlockCoordinate(boxMin[i] + CollisionEpsilon);
+      max[i] = getBlockCoordinate(boxMax[i] - CollisionEpsilon);
+   }
+
+   // Check the layers of blocks in front of the box one by one, so that fast
+   // boxes can't tunnel through thin walls.
+   if (distance > 0.0f) {
+      int first = max[axis] + 1;
+      int last = getBlockCoordinate(boxMax[axis] + distance - CollisionEpsilon);
+
+      for (int layer = first; layer <= last; ++layer) {
+         min[axis] = max[axis] = layer;
+         if (anyCollision(min, max)) {
+            return std::max(layer * MC_BLOCK_SCALE - boxMax[axis], 0.0f);
+         }
+      }
+   }
+   else {
+      int first = min[axis] - 1;
+      int last = getBlockCoordinate(boxMin[axis] + distance + CollisionEpsilon);
+
+      for (int layer = first; layer >= last; --layer) {
+         min[axis] = max[axis] = layer;
+         if (anyCollision(min, max)) {
+            return std::min((layer + 1) * MC_BLOCK_SCALE - boxMin[axis], 0.0f);
+         }
+      }
+   }
+
+   return distance;
+}
+
+unsigned CollisionSolver::moveBox(BoundingBox &box, glm::vec3 &delta)
+{
+   // Resolve the vertical movement first, so that falling entities land
+   // before sliding along the ground.
+   static constexpr int axisOrder[] = { 1, 0, 2 };
+
+   unsigned blockedAxes = 0;
+   for (int axis : axisOrder) {
+      if (delta[axis] == 0.0f) {
+         continue;
+      }
+
+      float moved = sweep(box, axis, delta[axis]);
+      if (moved != delta[axis]) {
+         blockedAxes |= (1u << axis);
+         delta[axis] = moved;
+      }
+
+      glm::vec3 offset(0.0f);
+      offset[axis] = moved;
+      box.applyOffset(offset);
+   }
+
+   return blockedAxes;
+}
@@ -0,0 +1,360 @@
+#include "mineshaft/World/FarTerrain.h"
+
+#include "mineshaft/Application.h"
+#include "mineshaft/Shader/RenderState.h"
+#include "mineshaft/Support/Profiler.h"
+#include "mineshaft/World/World.h"
+#include "mineshaft/World/WorldGenerator.h"
+
+#include <algorithm>
+
+using namespace mc;
+
+FarTerrainRegion::FarTerrainRegion(FarTerrain &terrain, int x, int z)
+   : terrain(terrain), x(x), z(z), state(State::Pending)
+{
+
+}
+
+FarTerrainRegion::~FarTerrainRegion()
+{
+   RenderState::forgetVertexArray(VAO);
+   glDeleteVertexArrays(1, &VAO);
+   glDeleteBuffers(1, &EBO);
+   glDeleteBuffers(1, &VBO);
+}
+
+ChunkPosition FarTerrainRegion::getChunkPosition(unsigned i) const
+{
+   return ChunkPosition(x * MC_FAR_TERRAIN_REGION_SIZE + (int)(i / MC_FAR_TERRAIN_REGION_SIZE),
+                        z * MC_FAR_TERRAIN_REGION_SIZE + (int)(i % MC_FAR_TERRAIN_REGION_SIZE));
+}
+
+static glm::vec3 getColumnColor(const TerrainColumn &column, int seaY)
+{
+   if (column.height < seaY) {
+      return glm::vec3(0.22f, 0.36f, 0.78f);
+   }
+
+   switch (column.biome) {
+   case Biome::Plains:
+      return glm::vec3(0.45f, 0.68f, 0.28f);
+   case Biome::Forest:
+      return glm::vec3(0.2f, 0.45f, 0.16f);
+   case Biome::Mountains:
+      // Cover high mountains in snow.
+      if (column.height > MC_CHUNK_HEIGHT / 4) {
+         return glm::vec3(0.92f, 0.94f, 0.96f);
+      }
+
+      return glm::vec3(0.5f, 0.5f, 0.5f);
+   default:
+      return glm::vec3(0.45f, 0.68f, 0.28f);
+   }
+}
+
+void FarTerrainRegion::generate()
+{
+   static constexpr int step = MC_FAR_TERRAIN_SAMPLE_STEP;
+   static constexpr int paddedSize = SamplesPerSide + 2;
+   static constexpr int regionWidth = MC_FAR_TERRAIN_REGION_SIZE * MC_CHUNK_WIDTH;
+   static constexpr int regionDepth = MC_FAR_TERRAIN_REGION_SIZE * MC_CHUNK_DEPTH;
+
+   auto *generator = terrain.world.getWorldGenerator();
+   FastNoise noise = terrain.noiseGenerator;
+   int seaY = generator->getOptions().seaY;
+
+   int baseX = x * regionWidth;
+   int baseZ = z * regionDepth;
+
+   // Sample the columns with a border of one sample for the normals.
+   std::vector<TerrainColumn> columns(paddedSize * paddedSize);
+   std::vector<int> surface(paddedSize * paddedSize);
+
+   for (int i = 0; i < paddedSize; ++i) {
+      for (int j = 0; j < paddedSize; ++j) {
+         int idx = i * paddedSize + j;
+         TerrainColumn &column = columns[idx];
+
+         if (!generator->sampleColumn(noise,
+                                      baseX + (i - 1) * step,
+                                      baseZ + (j - 1) * step,
+                                      column)) {
+            state.store(State::Generated);
+            return;
+         }
+
+         // Water is filled up to sea level.
+         surface[idx] = std::max(column.height, seaY) + 1;
+      }
+   }
+
+   Vertices.reserve(SamplesPerSide * SamplesPerSide);
+
+   float minY = 0.0f;
+   float maxY = 0.0f;
+
+   for (int i = 1; i <= SamplesPerSide; ++i) {
+      for (int j = 1; j <= SamplesPerSide; ++j) {
+         int idx = i * paddedSize + j;
+
+         float left = (float)surface[idx - paddedSize];
+         float right = (float)surface[idx + paddedSize];
+         float back = (float)surface[idx - 1];
+         float front = (float)surface[idx + 1];
+
+         FarTerrainVertex &vert = Vertices.emplace_back();
+         vert.Position = getScenePosition(WorldPosition(baseX + (i - 1) * step,
+                                                        surface[idx],
+                                                        baseZ + (j - 1) * step));
+
+         vert.Normal = glm::normalize(glm::vec3(left - right, 2.0f * step,
+                                                back - front));
+         vert.Color = getColumnColor(columns[idx], seaY);
+
+         if (Vertices.size() == 1) {
+            minY = maxY = vert.Position.y;
+         }
+         else {
+            minY = std::min(minY, vert.Position.y);
+            maxY = std::max(maxY, vert.Position.y);
+         }
+      }
+   }
+
+   // Group the indices by chunk, so that single chunks can be skipped.
+   static constexpr int quadsPerChunkX = MC_CHUNK_WIDTH / step;
+   static constexpr int quadsPerChunkZ = MC_CHUNK_DEPTH / step;
+
+   Indices.reserve(MC_FAR_TERRAIN_REGION_SIZE * MC_FAR_TERRAIN_REGION_SIZE
+                   * IndicesPerChunk);
+
+   for (int cx = 0; cx < MC_FAR_TERRAIN_REGION_SIZE; ++cx) {
+      for (int cz = 0; cz < MC_FAR_TERRAIN_REGION_SIZE; ++cz) {
+         for (int qx = 0; qx < quadsPerChunkX; ++qx) {
+            for (int qz = 0; qz < quadsPerChunkZ; ++qz) {
+               unsigned i = cx * quadsPerChunkX + qx;
+               unsigned j = cz * quadsPerChunkZ + qz;
+
+               unsigned idx00 = i * SamplesPerSide + j;
+               unsigned idx01 = idx00 + 1;
+               unsigned idx10 = idx00 + SamplesPerSide;
+               unsigned idx11 = idx10 + 1;
+
+               Indices.push_back(idx00);
+               Indices.push_back(idx01);
+               Indices.push_back(idx10);
+
+               Indices.push_back(idx10);
+               Indices.push_back(idx01);
+               Indices.push_back(idx11);
+            }
+         }
+      }
+   }
+
+   boundingBox.minX = (float)baseX * MC_BLOCK_SCALE;
+   boundingBox.maxX = (float)(baseX + regionWidth) * MC_BLOCK_SCALE;
+   boundingBox.minY = minY;
+   boundingBox.maxY = maxY;
+   boundingBox.minZ = (float)baseZ * MC_BLOCK_SCALE;
+   boundingBox.maxZ = (float)(baseZ + regionDepth) * MC_BLOCK_SCALE;
+
+   state.store(State::Generated);
+}
+
+void FarTerrainRegion::upload()
+{
+   assert(state.load() == State::Generated && "region not generated!");
+
+   if (!Indices.empty()) {
+      glGenVertexArrays(1, &VAO);
+
+      glGenBuffers(1, &VBO);
+      glGenBuffers(1, &EBO);
+
+      RenderState::bindVertexArray(VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+      glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(FarTerrainVertex),
+                   Vertices.data(), GL_STATIC_DRAW);
+
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(unsigned),
+                   Indices.data(), GL_STATIC_DRAW);
+
+      // vertex positions
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(FarTerrainVertex),
+                            nullptr);
+
+      // vertex normals
+      glEnableVertexAttribArray(1);
+      glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(FarTerrainVertex),
+                            (void*)offsetof(FarTerrainVertex, Normal));
+
+      // vertex colors
+      glEnableVertexAttribArray(2);
+      glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(FarTerrainVertex),
+                            (void*)offsetof(FarTerrainVertex, Color));
+
+      RenderState::bindVertexArray(0);
+   }
+
+   // The vertex data is no longer needed on the CPU side.
+   Vertices = std::vector<FarTerrainVertex>();
+   state.store(State::Ready);
+}
+
+FarTerrain::FarTerrain(World &world)
+   : world(world),
+     noiseGenerator(world.getWorldGenerator()->getOptions().seed)
+{
+
+}
+
+FarTerrain::~FarTerrain()
+{
+   auto &jobs = world.getApplication().getJobSystem();
+   for (auto &region : regions) {
+      region.second->cancelled.store(true);
+   }
+
+   for (auto &region : regions) {
+      jobs.wait(region.second->job);
+      delete region.second;
+   }
+
+   for (auto *region : retiredRegions) {
+      jobs.wait(region->job);
+      delete region;
+   }
+}
+
+ChunkPosition FarTerrain::getRegionPosition(const ChunkPosition &chunkPos)
+{
+   int x = chunkPos.x;
+   int z = chunkPos.z;
+
+   if (x < 0) {
+      x = (int)std::floor((float)x / MC_FAR_TERRAIN_REGION_SIZE);
+   }
+   else {
+      x /= MC_FAR_TERRAIN_REGION_SIZE;
+   }
+
+   if (z < 0) {
+      z = (int)std::floor((float)z / MC_FAR_TERRAIN_REGION_SIZE);
+   }
+   else {
+      z /= MC_FAR_TERRAIN_REGION_SIZE;
+   }
+
+   return ChunkPosition(x, z);
+}
+
+static void generateRegionTask(FarTerrainRegion *region)
+{
+   MC_PROFILE_SCOPE("generateFarTerrain");
+   region->generate();
+}
+
+void FarTerrain::updateCenter(const ChunkPosition &chunkPos)
+{
+   auto &app = world.getApplication();
+   centerRegion = getRegionPosition(chunkPos);
+
+   int radius = (int)std::ceil((float)app.gameOptions.farRenderDistance
+                               / MC_FAR_TERRAIN_REGION_SIZE);
+
+   // Delete the dropped regions whose jobs finished.
+   retiredRegions.erase(
+      std::remove_if(retiredRegions.begin(), retiredRegions.end(),
+                     [](FarTerrainRegion *region) {
+                        if (!region->job.isDone()) {
+                           return false;
+                        }
+
+                        delete region;
+                        return true;
+                     }),
+      retiredRegions.end());
+
+   // Drop regions that left the far render distance. Pending regions are
+   // cancelled and kept alive until their job finished.
+   for (auto it = regions.begin(); it != regions.end();) {
+      FarTerrainRegion *region = it->second;
+      int dx = std::abs(region->x - centerRegion.x);
+      int dz = std::abs(region->z - centerRegion.z);
+
+      if (dx <= radius + 1 && dz <= radius + 1) {
+         ++it;
+         continue;
+      }
+
+      if (region->job.isDone()) {
+         delete region;
+      }
+      else {
+         region->cancelled.store(true);
+         retiredRegions.push_back(region);
+      }
+
+      it = regions.erase(it);
+   }
+
+   // Request missing regions in rings around the center. The nearest rings
+   // are generated first, the outer ones only when the workers are idle.
+   for (int i = 0; i <= radius; ++i) {
+      for (int x = -i; x <= i; ++x) {
+         for (int z = -i; z <= i; ++z) {
+            if (std::abs(x) != i && std::abs(z) != i) {
+               continue;
+            }
+
+            ChunkPosition regionPos(centerRegion.x + x, centerRegion.z + z);
+            FarTerrainRegion *&region = regions[regionPos];
+
+            if (region) {
+               continue;
+            }
+
+            auto priority = i <= 1 ? JobPriority::Normal : JobPriority::Low;
+
+            region = new FarTerrainRegion(*this, regionPos.x, regionPos.z);
+            app.getJobSystem().submit<&generateRegionTask>(
+               region, JobOptions(priority, &region->job, nullptr,
+                                  &region->cancelled));
+         }
+      }
+   }
+}
+
+void FarTerrain::finalizeRegions()
+{
+   for (auto &region : regions) {
+      if (region.second->state.load() == FarTerrainRegion::State::Generated) {
+         region.second->upload();
+      }
+   }
+}
+
+bool FarTerrain::isChunkLoaded(const ChunkPosition &chunkPos) const
+{
+   Chunk *centerChunk = world.getCenterChunk();
+   if (!centerChunk) {
+      return false;
+   }
+
+   int renderDistance = (int)world.getApplication().gameOptions.renderDistance;
+   auto centerPos = centerChunk->getChunkPosition();
+
+   if (std::abs(chunkPos.x - centerPos.x) > renderDistance
+   || std::abs(chunkPos.z - centerPos.z) > renderDistance) {
+      return false;
+   }
+
+   // Keep covering chunks whose terrain is still queued.
+   auto *chunk = world.getChunk(chunkPos, false);
+   return chunk && chunk->isReady();
+}
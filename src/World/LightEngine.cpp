@@ -0,0 +1,550 @@
+#include "mineshaft/World/LightEngine.h"
+
+#include "mineshaft/Application.h"
+#include "mineshaft/Support/Profiler.h"
+#include "mineshaft/World/Chunk.h"
+#include "mineshaft/World/Simulation.h"
+#include "mineshaft/World/World.h"
+
+using namespace mc;
+
+/// Neighbour offsets, in the same order as the block faces.
+static constexpr int offsets[][3] = {
+   { 1, 0, 0 },  // Right
+   { -1, 0, 0 }, // Left
+   { 0, 1, 0 },  // Top
+   { 0, -1, 0 }, // Bottom
+   { 0, 0, 1 },  // Front
+   { 0, 0, -1 }, // Back
+};
+
+/// Index of the downward offset.
+static constexpr unsigned downIdx = 3;
+
+static WorldPosition getNeighbour(const WorldPosition &pos, unsigned i)
+{
+   return WorldPosition(pos.x + offsets[i][0],
+                        pos.y + offsets[i][1],
+                        pos.z + offsets[i][2]);
+}
+
+LightEngine::LightEngine(World &world)
+   : world(world), taskScheduled(false)
+{
+
+}
+
+Chunk *LightEngine::lookupChunk(const WorldPosition &pos)
+{
+   auto chunkPos = getChunkPosition(pos);
+   if (lastChunk && lastChunk->getChunkPosition() == chunkPos) {
+      return lastChunk;
+   }
+
+   auto it = chunks.find(chunkPos);
+   if (it == chunks.end()) {
+      return nullptr;
+   }
+
+   lastChunk = it->second;
+   return lastChunk;
+}
+
+ChunkSegment *LightEngine::lookupSegment(Chunk *chunk, const WorldPosition &pos,
+                                         unsigned &idx) {
+   if (pos.y >= (MC_CHUNK_HEIGHT / 2) || pos.y < -(MC_CHUNK_HEIGHT / 2)) {
+      return nullptr;
+   }
+
+   auto *seg = chunk->chunkSegments[(pos.y + (MC_CHUNK_HEIGHT / 2)) / MC_CHUNK_SEGMENT_HEIGHT];
+   if (!seg) {
+      return nullptr;
+   }
+
+   idx = ChunkSegment::getIndex(getPositionInChunk(pos));
+   return seg;
+}
+
+uint8_t LightEngine::getLevel(const WorldPosition &pos, Channel channel)
+{
+   Chunk *chunk = lookupChunk(pos);
+   if (!chunk) {
+      return 0;
+   }
+
+   uint8_t light = chunk->getLightAt(pos);
+   if (channel == SkyLight) {
+      return light >> 4;
+   }
+
+   return light & 0xF;
+}
+
+void LightEngine::setLevel(const WorldPosition &pos, Channel channel,
+                           uint8_t level) {
+   Chunk *chunk = lookupChunk(pos);
+   if (!chunk) {
+      return;
+   }
+
+   // Light is not stored in segments that were never allocated, these are
+   // always fully exposed to the sky.
+   unsigned idx;
+   auto *seg = lookupSegment(chunk, pos, idx);
+   if (!seg) {
+      return;
+   }
+
+   uint8_t light = seg->getLight(idx);
+   if (channel == SkyLight) {
+      light = (light & 0xF) | (level << 4);
+   }
+   else {
+      light = (light & 0xF0) | level;
+   }
+
+   seg->setLight(idx, light);
+   markModified(chunk, pos);
+}
+
+const Block *LightEngine::getBlock(const WorldPosition &pos)
+{
+   Chunk *chunk = lookupChunk(pos);
+   if (!chunk) {
+      return nullptr;
+   }
+
+   unsigned idx;
+   auto *seg = lookupSegment(chunk, pos, idx);
+   if (!seg) {
+      return nullptr;
+   }
+
+   return &seg->getBlocks()[idx];
+}
+
+bool LightEngine::isTransparent(const WorldPosition &pos)
+{
+   if (pos.y < -(MC_CHUNK_HEIGHT / 2) || !lookupChunk(pos)) {
+      return false;
+   }
+
+   auto *block = getBlock(pos);
+   return !block || block->isTransparent();
+}
+
+void LightEngine::markModified(Chunk *chunk, const WorldPosition &pos)
+{
+   auto chunkPos = chunk->getChunkPosition();
+   Chunk::forEachAffectedSection(
+      pos, [&](const ChunkPosition &otherPos, uint16_t mask) {
+         Chunk *other = chunk;
+         if (otherPos != chunkPos) {
+            auto it = chunks.find(otherPos);
+            if (it == chunks.end()) {
+               return;
+            }
+
+            other = it->second;
+         }
+
+         localModifiedSections[other] |= mask;
+      });
+}
+
+void LightEngine::propagateRemoval(Channel channel)
+{
+   auto &queue = removeQueues[channel];
+   auto &addQueue = addQueues[channel];
+
+   while (!queue.empty()) {
+      LightNode node = queue.front();
+      queue.pop_front();
+
+      for (unsigned i = 0; i < 6; ++i) {
+         WorldPosition neighbour = getNeighbour(node.pos, i);
+         if (!lookupChunk(neighbour)) {
+            continue;
+         }
+
+         uint8_t level = getLevel(neighbour, channel);
+         if (level == 0) {
+            continue;
+         }
+
+         // Full sky light travels down without decreasing, so it has to be
+         // removed as well.
+         bool skyColumn = channel == SkyLight && i == downIdx
+            && node.level == MC_MAX_LIGHT_LEVEL;
+
+         if (level < node.level || skyColumn) {
+            setLevel(neighbour, channel, 0);
+            queue.emplace_back(neighbour, level);
+         }
+         else {
+            // This block is lit from somewhere else, spread its light back
+            // into the removed area.
+            addQueue.emplace_back(neighbour);
+         }
+      }
+   }
+}
+
+void LightEngine::propagateAddition(Channel channel)
+{
+   auto &queue = addQueues[channel];
+   while (!queue.empty()) {
+      LightNode node = queue.front();
+      queue.pop_front();
+
+      uint8_t level = getLevel(node.pos, channel);
+      if (level <= 1) {
+         continue;
+      }
+
+      for (unsigned i = 0; i < 6; ++i) {
+         WorldPosition neighbour = getNeighbour(node.pos, i);
+         if (!isTransparent(neighbour)) {
+            continue;
+         }
+
+         uint8_t newLevel = level - 1;
+         if (channel == SkyLight && i == downIdx && level == MC_MAX_LIGHT_LEVEL) {
+            newLevel = MC_MAX_LIGHT_LEVEL;
+         }
+
+         if (getLevel(neighbour, channel) < newLevel) {
+            setLevel(neighbour, channel, newLevel);
+            queue.emplace_back(neighbour);
+         }
+      }
+   }
+}
+
+void LightEngine::processUpdates()
+{
+   std::vector<PendingUpdate> updates;
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      std::swap(updates, pendingUpdates);
+   }
+
+   {
+      // The main thread changes blocks and allocates segments while holding
+      // the world mutex.
+      std::lock_guard<std::mutex> worldLock(
+         world.getSimulation()->getWorldMutex());
+      std::lock_guard<std::mutex> lock(chunkMutex);
+      lastChunk = nullptr;
+
+      std::vector<WorldPosition> changedBlocks;
+      for (auto &update : updates) {
+         if (!lookupChunk(update.pos)) {
+            continue;
+         }
+
+         if (update.kind == PendingUpdate::Spread) {
+            addQueues[SkyLight].emplace_back(update.pos);
+            addQueues[BlockLight].emplace_back(update.pos);
+
+            continue;
+         }
+
+         // Remove the light at the changed block.
+         for (unsigned c = 0; c < NumChannels; ++c) {
+            uint8_t level = getLevel(update.pos, (Channel)c);
+            if (level) {
+               setLevel(update.pos, (Channel)c, 0);
+               removeQueues[c].emplace_back(update.pos, level);
+            }
+         }
+
+         // Let the neighbours light the block again.
+         if (isTransparent(update.pos)) {
+            for (unsigned i = 0; i < 6; ++i) {
+               WorldPosition neighbour = getNeighbour(update.pos, i);
+               addQueues[SkyLight].emplace_back(neighbour);
+               addQueues[BlockLight].emplace_back(neighbour);
+            }
+         }
+
+         changedBlocks.push_back(update.pos);
+      }
+
+      for (unsigned c = 0; c < NumChannels; ++c) {
+         propagateRemoval((Channel)c);
+      }
+
+      // Add light sources after the old light is removed.
+      for (auto &pos : changedBlocks) {
+         auto *block = getBlock(pos);
+         if (!block) {
+            continue;
+         }
+
+         uint8_t level = block->getLightLevel();
+         if (level > getLevel(pos, BlockLight)) {
+            setLevel(pos, BlockLight, level);
+            addQueues[BlockLight].emplace_back(pos);
+         }
+      }
+
+      for (unsigned c = 0; c < NumChannels; ++c) {
+         propagateAddition((Channel)c);
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      for (auto &modified : localModifiedSections) {
+         modifiedSections[modified.first] |= modified.second;
+      }
+   }
+
+   localModifiedSections.clear();
+   taskScheduled.store(false);
+}
+
+void LightEngine::processUpdatesTask(LightEngine *engine)
+{
+   MC_PROFILE_SCOPE("propagateLight");
+   engine->processUpdates();
+}
+
+void LightEngine::waitForUpdates()
+{
+   world.getApplication().getJobSystem().wait(pendingTask);
+}
+
+size_t LightEngine::getNumPendingUpdates()
+{
+   std::lock_guard<std::mutex> lock(queueMutex);
+   return pendingUpdates.size();
+}
+
+void LightEngine::initializeChunk(Chunk &chunk)
+{
+   static constexpr int minY = -(MC_CHUNK_HEIGHT / 2);
+   static constexpr int maxY = MC_CHUNK_HEIGHT / 2;
+
+   // The lowest y coordinate that is exposed to the sky, for every column.
+   int heights[MC_CHUNK_WIDTH][MC_CHUNK_DEPTH];
+
+   for (int x = 0; x < MC_CHUNK_WIDTH; ++x) {
+      for (int z = 0; z < MC_CHUNK_DEPTH; ++z) {
+         int &height = heights[x][z];
+         height = minY;
+
+         bool exposed = true;
+         for (int y = maxY - 1; y >= minY; --y) {
+            auto *seg = chunk.chunkSegments[(y - minY) / MC_CHUNK_SEGMENT_HEIGHT];
+            if (!seg) {
+               continue;
+            }
+
+            unsigned idx = ChunkSegment::getIndex(BlockPositionChunk(x, y, z));
+            if (exposed && !seg->getBlocks()[idx].isTransparent()) {
+               exposed = false;
+               height = y + 1;
+            }
+
+            seg->setLight(idx, exposed ? ChunkSegment::FullSkyLight : 0);
+         }
+      }
+   }
+
+   std::vector<PendingUpdate> updates;
+
+   // Spread sky light sideways below overhangs within the chunk.
+   for (int x = 0; x < MC_CHUNK_WIDTH; ++x) {
+      for (int z = 0; z < MC_CHUNK_DEPTH; ++z) {
+         int maxNeighbourHeight = heights[x][z];
+         for (unsigned i = 0; i < 6; ++i) {
+            int nx = x + offsets[i][0];
+            int nz = z + offsets[i][2];
+
+            if (offsets[i][1] != 0
+            || nx < 0 || nx >= MC_CHUNK_WIDTH || nz < 0 || nz >= MC_CHUNK_DEPTH) {
+               continue;
+            }
+
+            maxNeighbourHeight = std::max(maxNeighbourHeight, heights[nx][nz]);
+         }
+
+         for (int y = heights[x][z]; y < maxNeighbourHeight; ++y) {
+            updates.emplace_back(chunk.getWorldPosition(BlockPositionChunk(x, y, z)),
+                                 PendingUpdate::Spread);
+         }
+      }
+   }
+
+   // Exchange light with the neighbouring chunks.
+   auto chunkPos = chunk.getChunkPosition();
+   for (unsigned i = 0; i < 6; ++i) {
+      if (offsets[i][1] != 0) {
+         continue;
+      }
+
+      auto it = chunks.find(ChunkPosition(chunkPos.x + offsets[i][0],
+                                          chunkPos.z + offsets[i][2]));
+      if (it == chunks.end()) {
+         continue;
+      }
+
+      Chunk *other = it->second;
+      for (int j = 0; j < MC_CHUNK_WIDTH; ++j) {
+         int x = offsets[i][0] == 0 ? j : (offsets[i][0] > 0 ? MC_CHUNK_WIDTH - 1 : 0);
+         int z = offsets[i][2] == 0 ? j : (offsets[i][2] > 0 ? MC_CHUNK_DEPTH - 1 : 0);
+
+         for (int y = minY; y < maxY; ++y) {
+            auto pos = chunk.getWorldPosition(BlockPositionChunk(x, y, z));
+            auto neighbourPos = getNeighbour(pos, i);
+
+            uint8_t light = chunk.getLightAt(pos);
+            uint8_t neighbourLight = other->getLightAt(neighbourPos);
+
+            if (light == neighbourLight) {
+               continue;
+            }
+
+            // Let both sides spread their light, the propagation ignores
+            // blocks that don't need to change.
+            updates.emplace_back(pos, PendingUpdate::Spread);
+            updates.emplace_back(neighbourPos, PendingUpdate::Spread);
+         }
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(chunkMutex);
+      chunks[chunkPos] = &chunk;
+   }
+
+   std::lock_guard<std::mutex> lock(queueMutex);
+   pendingUpdates.insert(pendingUpdates.end(), updates.begin(), updates.end());
+}
+
+void LightEngine::sectionAllocated(Chunk &chunk, unsigned section)
+{
+   // The light of chunks that are not initialized yet is calculated when
+   // they are.
+   auto chunkPos = chunk.getChunkPosition();
+   if (chunks.find(chunkPos) == chunks.end()) {
+      return;
+   }
+
+   auto *seg = chunk.chunkSegments[section];
+   int minY = (int)section * MC_CHUNK_SEGMENT_HEIGHT - (MC_CHUNK_HEIGHT / 2);
+   int maxY = minY + MC_CHUNK_SEGMENT_HEIGHT;
+
+   // The section only contains air, so full sky light passes through it.
+   for (int x = 0; x < MC_CHUNK_WIDTH; ++x) {
+      for (int z = 0; z < MC_CHUNK_DEPTH; ++z) {
+         uint8_t above = chunk.getLightAt(
+            chunk.getWorldPosition(BlockPositionChunk(x, maxY, z)));
+
+         uint8_t light = (above >> 4) == MC_MAX_LIGHT_LEVEL
+            ? ChunkSegment::FullSkyLight : 0;
+
+         for (int y = minY; y < maxY; ++y) {
+            seg->setLight(ChunkSegment::getIndex(BlockPositionChunk(x, y, z)),
+                          light);
+         }
+      }
+   }
+
+   // Spread the light within the section and from the blocks around it.
+   std::vector<PendingUpdate> updates;
+   for (int x = -1; x <= MC_CHUNK_WIDTH; ++x) {
+      for (int y = minY - 1; y <= maxY; ++y) {
+         for (int z = -1; z <= MC_CHUNK_DEPTH; ++z) {
+            int numOutside = (x < 0 || x >= MC_CHUNK_WIDTH)
+               + (y < minY || y >= maxY)
+               + (z < 0 || z >= MC_CHUNK_DEPTH);
+
+            // Edges and corners don't touch the section.
+            if (numOutside > 1) {
+               continue;
+            }
+
+            updates.emplace_back(
+               chunk.getWorldPosition(BlockPositionChunk(x, y, z)),
+               PendingUpdate::Spread);
+         }
+      }
+   }
+
+   // The meshes around the section sampled full sky light so far.
+   uint16_t mask = 1u << section;
+   if (section > 0) {
+      mask |= 1u << (section - 1);
+   }
+   if (section < ChunkMesh::NumSections - 1) {
+      mask |= 1u << (section + 1);
+   }
+
+   for (int x = -1; x <= 1; ++x) {
+      for (int z = -1; z <= 1; ++z) {
+         auto it = chunks.find(ChunkPosition(chunkPos.x + x, chunkPos.z + z));
+         if (it != chunks.end()) {
+            it->second->modifiedSections(mask);
+         }
+      }
+   }
+
+   std::lock_guard<std::mutex> lock(queueMutex);
+   pendingUpdates.insert(pendingUpdates.end(), updates.begin(), updates.end());
+}
+
+void LightEngine::removeChunk(Chunk &chunk)
+{
+   // The job may still reach the chunk through the map or its modified
+   // sections.
+   waitForUpdates();
+
+   {
+      std::lock_guard<std::mutex> lock(chunkMutex);
+      chunks.erase(chunk.getChunkPosition());
+      lastChunk = nullptr;
+   }
+
+   // Pending updates in the chunk are skipped by the next job, since it is no
+   // longer in the map.
+   std::lock_guard<std::mutex> lock(queueMutex);
+   modifiedSections.erase(&chunk);
+}
+
+void LightEngine::blockChanged(const WorldPosition &pos)
+{
+   // The light of chunks that are not initialized yet is calculated when
+   // they are.
+   if (chunks.find(getChunkPosition(pos)) == chunks.end()) {
+      return;
+   }
+
+   std::lock_guard<std::mutex> lock(queueMutex);
+   pendingUpdates.emplace_back(pos, PendingUpdate::BlockChanged);
+}
+
+void LightEngine::update()
+{
+   std::unordered_map<Chunk*, uint16_t> sections;
+   bool hasPendingUpdates;
+
+   {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      std::swap(sections, modifiedSections);
+      hasPendingUpdates = !pendingUpdates.empty();
+   }
+
+   for (auto &modified : sections) {
+      modified.first->modifiedSections(modified.second);
+   }
+
+   if (hasPendingUpdates && !taskScheduled.exchange(true)) {
+      // Light updates are visible right away, so they take precedence over
+      // world generation.
+      world.getApplication().getJobSystem().submit<&processUpdatesTask>(
+         this, JobOptions(JobPriority::High, &pendingTask));
+   }
+}
@@ -0,0 +1,249 @@
+#include "mineshaft/World/Simulation.h"
+
+#include "mineshaft/Entity/Entity.h"
+#include "mineshaft/Support/Profiler.h"
+#include "mineshaft/World/CollisionSolver.h"
+#include "mineshaft/World/World.h"
+
+#include <algorithm>
+
+using namespace mc;
+
+Simulation::Simulation(World &world)
+   : world(world), currentSnapshotTime(Clock::now()), tickCount(0),
+     running(false)
+{
+
+}
+
+void Simulation::start()
+{
+   if (running.exchange(true)) {
+      return;
+   }
+
+   thread = std::thread([this] { run(); });
+}
+
+void Simulation::stop()
+{
+   if (!running.exchange(false)) {
+      return;
+   }
+
+   thread.join();
+}
+
+void Simulation::run()
+{
+   auto tickDuration = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<float>(TickDuration));
+
+   Profiler::setThreadName("Simulation");
+
+   auto nextTick = Clock::now();
+   while (running.load()) {
+      tick();
+
+      // Don't try to catch up on missed ticks, e.g. after the main thread
+      // held the world for a long time.
+      nextTick += tickDuration;
+      nextTick = std::max(nextTick, Clock::now());
+
+      std::this_thread::sleep_until(nextTick);
+   }
+}
+
+/// Amount of vertical velocity lost in a second.
+static constexpr float gravity = 9.81f;
+static constexpr float maxVelocity = gravity * 10;
+static constexpr float velocityDecrease = 95.0f;
+
+/// Apply the vertical velocity of an entity to its movement.
+/// \return true iff the entity is falling or jumping.
+static bool applyVelocity(glm::vec3 &velocity, uint8_t flags,
+                          glm::vec3 &movement, float deltaTime) {
+   if (velocity.y == 0) {
+      if (flags & EntityStore::HasGravity) {
+         velocity.y = -gravity;
+      }
+
+      return false;
+   }
+
+   movement.y += velocity.y * deltaTime;
+   velocity.y -= velocityDecrease * deltaTime;
+
+   if (velocity.y > maxVelocity) {
+      velocity.y = maxVelocity;
+   }
+   else if (velocity.y < -maxVelocity) {
+      velocity.y = -maxVelocity;
+   }
+
+   return true;
+}
+
+/// \return true iff two boxes overlap. Boxes that only touch don't.
+static bool boxesOverlap(const BoundingBox &a, const BoundingBox &b)
+{
+   return a.minX < b.maxX && a.maxX > b.minX
+      && a.minY < b.maxY && a.maxY > b.minY
+      && a.minZ < b.maxZ && a.maxZ > b.minZ;
+}
+
+/// \return true iff \p box overlaps a colliding entity other than \p id
+/// that \p previousBox didn't already overlap.
+static bool collidesWithEntity(const EntityStore &store, EntityID id,
+                               const BoundingBox &previousBox,
+                               const BoundingBox &box,
+                               llvm::SmallVectorImpl<EntityID> &candidates) {
+   candidates.clear();
+   store.getGrid().queryBox(box, candidates);
+
+   for (EntityID other : candidates) {
+      if (other == id || !(store.getFlags(other) & EntityStore::Collides)) {
+         continue;
+      }
+
+      // Let entities that are stuck inside of each other separate.
+      auto &otherBox = store.getGrid().getBoundingBox(other);
+      if (boxesOverlap(box, otherBox) && !boxesOverlap(previousBox, otherBox)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void Simulation::tick()
+{
+   MC_PROFILE_SCOPE("tick");
+   nextSnapshot.clear();
+   movedEntities.clear();
+
+   {
+      std::lock_guard<std::mutex> guard(worldMutex);
+      auto &store = world.getEntityStore();
+
+      auto owners = store.getActiveOwners();
+      auto ids = store.getActiveIDs();
+      auto positions = store.getActivePositions();
+      auto velocities = store.getActiveVelocities();
+      auto boundingBoxes = store.getActiveBoundingBoxes();
+      auto flags = store.getActiveFlags();
+
+      // Share the solver, so that entities close to each other reuse its
+      // cached chunk.
+      CollisionSolver solver(world);
+      llvm::SmallVector<EntityID, 8> candidates;
+
+      for (unsigned i = 0, e = store.getNumActive(); i < e; ++i) {
+         glm::vec3 movement(0.0f);
+         if (MovableEntity::classof(owners[i])) {
+            static_cast<MovableEntity*>(owners[i])->applyInput(
+               positions[i], velocities[i], flags[i], movement);
+         }
+
+         bool falling = applyVelocity(velocities[i], flags[i], movement,
+                                      TickDuration);
+
+         unsigned blockedAxes = 0;
+         if (flags[i] & EntityStore::Collides) {
+            BoundingBox previousBox = boundingBoxes[i].offsetBy(positions[i]);
+            BoundingBox box = previousBox;
+            blockedAxes = solver.moveBox(box, movement);
+
+            // Entities don't push each other, they only stop horizontally
+            // when running into one another.
+            if ((movement.x != 0.0f || movement.z != 0.0f)
+            && collidesWithEntity(store, ids[i], previousBox, box, candidates)) {
+               movement.x = 0.0f;
+               movement.z = 0.0f;
+            }
+         }
+
+         positions[i] += movement;
+
+         // This only touches the grid cells if the entity entered new ones.
+         store.updateGrid(ids[i]);
+
+         if (falling && (blockedAxes & CollisionSolver::BlockedY) != 0) {
+            // Restore default negative velocity.
+            if (flags[i] & EntityStore::HasGravity) {
+               velocities[i].y = -gravity;
+            }
+            else {
+               velocities[i].y = 0.0f;
+            }
+         }
+
+         if (getChunkPosition(positions[i]) != store.getChunk(ids[i])) {
+            movedEntities.push_back(ids[i]);
+         }
+
+         nextSnapshot.emplace_back(owners[i], ids[i], positions[i]);
+      }
+
+      // Rebucket the entities after iterating, since this reorders the slots.
+      for (EntityID id : movedEntities) {
+         store.updateChunk(id);
+      }
+   }
+
+   {
+      std::lock_guard<std::mutex> guard(snapshotMutex);
+      std::swap(previousSnapshot, currentSnapshot);
+      std::swap(currentSnapshot, nextSnapshot);
+      currentSnapshotTime = Clock::now();
+   }
+
+   ++tickCount;
+}
+
+void Simulation::interpolate()
+{
+   std::lock_guard<std::mutex> guard(snapshotMutex);
+
+   // Render one tick in the past, so that there are always two snapshots to
+   // interpolate between.
+   float timeSinceTick = std::chrono::duration<float>(
+      Clock::now() - currentSnapshotTime).count();
+
+   float alpha = std::min(timeSinceTick / TickDuration, 1.0f);
+   interpolatedEntities.clear();
+
+   // The store reorders its slots when entities change chunks or become
+   // active, so the snapshots are matched by ID, once per tick.
+   if (indexedSnapshotTime != currentSnapshotTime) {
+      indexedSnapshotTime = currentSnapshotTime;
+      std::fill(previousIndices.begin(), previousIndices.end(), NoIndex);
+
+      for (unsigned i = 0; i < previousSnapshot.size(); ++i) {
+         EntityID id = previousSnapshot[i].id;
+         if (id >= previousIndices.size()) {
+            previousIndices.resize(id + 1, NoIndex);
+         }
+
+         previousIndices[id] = i;
+      }
+   }
+
+   for (auto &current : currentSnapshot) {
+      interpolatedEntities.push_back(current.entity);
+
+      unsigned previous = NoIndex;
+      if (current.id < previousIndices.size()) {
+         previous = previousIndices[current.id];
+      }
+
+      // Entities that just became active are not interpolated.
+      if (previous != NoIndex) {
+         current.entity->position = glm::mix(
+            previousSnapshot[previous].position, current.position, alpha);
+      }
+      else {
+         current.entity->position = current.position;
+      }
+   }
+}
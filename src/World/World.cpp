@@ -1,12 +1,40 @@
 #include "mineshaft/Application.h"
 #include "mineshaft/Entity/Entity.h"
 #include "mineshaft/Entity/Player.h"
+#include "mineshaft/Support/Metrics.h"
+#include "mineshaft/Support/Profiler.h"
 #include "mineshaft/utils.h"
+#include "mineshaft/World/FarTerrain.h"
+#include "mineshaft/World/LightEngine.h"
+#include "mineshaft/World/Simulation.h"
 #include "mineshaft/World/World.h"
 #include "mineshaft/World/WorldGenerator.h"
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
+
 using namespace mc;
 
+#if MC_ENABLE_HOT_METRICS
+/// The number of block lookups.
+static MetricCounter &numBlockLookups = Metrics::getCounter("world.getBlock");
+#endif
+
+/// The number of chunks whose terrain was generated.
+static MetricCounter &numGeneratedChunks = Metrics::getCounter("chunks.generated");
+
+/// The number of chunks that were integrated into the world.
+static MetricCounter &numLoadedChunks = Metrics::getCounter("chunks.loaded");
+
+/// The number of chunks that were unloaded.
+static MetricCounter &numUnloadedChunks = Metrics::getCounter("chunks.unloaded");
+
+/// The time it takes to generate a chunk in microseconds.
+static MetricHistogram &generateTime =
+   Metrics::getHistogram("chunks.generateTime.us");
+
 WorldSegment::WorldSegment(World *world, int x, int z)
 {
    x *= MC_WORLD_SEGMENT_WIDTH;
@@ -25,50 +53,52 @@ World::World(Application &app)
 {
    chunksToRender = app.Allocate<Chunk*>(numChunksToRender);
    chunkUpdateDistanceThreshold = app.gameOptions.renderDistance * 15.0f;
-}
-
-World::World(World &&w) noexcept
-   : app(w.app), loadedSegments(w.loadedSegments),
-     chunksToRender(w.chunksToRender), numChunksToRender(w.numChunksToRender),
-     chunkUpdateDistanceThreshold(w.chunkUpdateDistanceThreshold),
-     centerChunk(w.centerChunk), focusedBlock(w.focusedBlock),
-     entities(std::move(w.entities)), activeEntities(std::move(w.activeEntities)),
-     minX(w.minX), maxX(w.maxX), minZ(w.minZ), maxZ(w.maxZ)
-{
-   w.loadedSegments = nullptr;
-   w.chunksToRender = nullptr;
-   w.minX = 0;
-   w.maxX = 0;
-   w.minZ = 0;
-   w.maxZ = 0;
+   lightEngine = new(app) LightEngine(*this);
+   simulation = new(app) Simulation(*this);
 }
 
 World::~World()
 {
-   int xSize = maxX - minX;
-   for (int i = 0; i < xSize; ++i) {
-      free(loadedSegments[i]);
+   // The simulation thread reads the world.
+   if (simulation) {
+      simulation->stop();
    }
 
-   free(loadedSegments);
-}
+   // Skip the generation jobs that did not start yet, and wait for the rest.
+   for (Chunk *chunk : scheduledChunks) {
+      chunk->updateGenerationState(Chunk::GenerationState::Scheduled,
+                                   Chunk::GenerationState::NotGenerated);
+   }
 
-World& World::operator=(mc::World &&w) noexcept
-{
-   std::swap(w.loadedSegments, loadedSegments);
-   std::swap(w.chunksToRender, chunksToRender);
-   std::swap(w.numChunksToRender, numChunksToRender);
-   std::swap(w.chunkUpdateDistanceThreshold, chunkUpdateDistanceThreshold);
-   std::swap(w.centerChunk, centerChunk);
-   std::swap(w.focusedBlock, focusedBlock);
-   std::swap(w.entities, entities);
-   std::swap(w.activeEntities, activeEntities);
-   std::swap(w.minX, minX);
-   std::swap(w.maxX, maxX);
-   std::swap(w.minZ, minZ);
-   std::swap(w.maxZ, maxZ);
-
-   return *this;
+   app.getJobSystem().wait(generationJobs);
+
+   // Return the chunks to the pools once no job reads them anymore.
+   if (lightEngine) {
+      lightEngine->waitForUpdates();
+   }
+
+   // These are allocated from the application's allocator, which never runs
+   // destructors. The far terrain waits for its own jobs.
+   if (farTerrain) {
+      farTerrain->~FarTerrain();
+   }
+
+   if (auto *table = segmentTable.load()) {
+      auto &pool = app.getWorldSegmentPool();
+      for (int x = table->minX; x < table->maxX; ++x) {
+         for (int z = table->minZ; z < table->maxZ; ++z) {
+            pool.destroy(table->getSlot(x, z)->load());
+         }
+      }
+   }
+
+   if (lightEngine) {
+      lightEngine->~LightEngine();
+   }
+
+   if (simulation) {
+      simulation->~Simulation();
+   }
 }
 
 World::ChunkIndex World::getLocalChunkCoordinate(const ChunkPosition &chunkPos)
@@ -104,64 +134,50 @@ World::ChunkIndex World::getLocalChunkCoordinate(const ChunkPosition &chunkPos)
    return result;
 }
 
-std::pair<int, int>
-World::getLocalSegmentCoordinate(int segmentX, int segmentZ)
+World::SegmentTable::SegmentTable(int minX, int maxX, int minZ, int maxZ)
+   : minX(minX), maxX(maxX), minZ(minZ), maxZ(maxZ),
+     segments(new std::atomic<WorldSegment*>[(maxX - minX) * (maxZ - minZ)])
 {
-   return { segmentX - minX, segmentZ - minZ };
+   for (int i = 0, e = (maxX - minX) * (maxZ - minZ); i < e; ++i) {
+      segments[i].store(nullptr, std::memory_order_relaxed);
+   }
 }
 
-WorldSegment* World::getSegment(int x, int z, bool initialize)
+std::atomic<WorldSegment*> *World::SegmentTable::getSlot(int x, int z) const
 {
-   int neededMinX = 0;
-   int neededMaxX = 0;
-   int neededMinZ = 0;
-   int neededMaxZ = 0;
-
-   if (x < minX) {
-      if (!initialize) {
-         return nullptr;
-      }
-
-      neededMinX = x;
+   if (x < minX || x >= maxX || z < minZ || z >= maxZ) {
+      return nullptr;
    }
-   else if (x >= maxX) {
-      if (!initialize) {
-         return nullptr;
-      }
 
-      neededMaxX = x;
-   }
+   return &segments[(x - minX) * (maxZ - minZ) + (z - minZ)];
+}
 
-   if (z < minZ) {
-      if (!initialize) {
-         return nullptr;
+WorldSegment* World::getSegment(int x, int z, bool initialize)
+{
+   if (auto *table = segmentTable.load(std::memory_order_acquire)) {
+      if (auto *slot = table->getSlot(x, z)) {
+         auto *seg = slot->load(std::memory_order_acquire);
+         if (seg || !initialize) {
+            return seg;
+         }
       }
-
-      neededMinZ = z;
    }
-   else if (z >= maxX) {
-      if (!initialize) {
-         return nullptr;
-      }
 
-      neededMaxZ = z;
+   if (!initialize) {
+      return nullptr;
    }
 
-   growWorld(neededMinX, neededMaxX + 1, neededMinZ, neededMaxZ + 1);
-
-   auto coords = getLocalSegmentCoordinate(x, z);
+   std::lock_guard<std::mutex> guard(segmentMutex);
 
-   WorldSegment *&seg = loadedSegments[coords.first][coords.second];
-   if (seg || !initialize) {
+   auto *slot = growWorld(x, z)->getSlot(x, z);
+   auto *seg = slot->load(std::memory_order_relaxed);
+   if (seg) {
       return seg;
    }
 
-   {
-      seg = new(app) WorldSegment(this, x, z);
-   }
-   {
-      genWorld(*seg);
-   }
+   // The terrain is generated per chunk, once it is requested.
+   seg = app.getWorldSegmentPool().create<WorldSegment>(this, x, z);
+   slot->store(seg, std::memory_order_release);
 
    return seg;
 }
@@ -181,23 +197,141 @@ Chunk* World::getChunk(const ChunkPosition &chunkPos, bool initialize)
 
 const Block *World::getBlock(const WorldPosition &pos) const
 {
+#if MC_ENABLE_HOT_METRICS
+   numBlockLookups.add();
+#endif
+
    auto chunkPos = getChunkPosition(pos);
    const Chunk *chunk = const_cast<World*>(this)->getChunk(chunkPos, false);
 
-   if (!chunk) {
+   if (!chunk || !chunk->isReady()) {
       return nullptr;
    }
 
    return chunk->getBlockAt(pos);
 }
 
+llvm::Optional<RaycastResult> World::raycast(const ScenePosition &origin,
+                                             const glm::vec3 &direction,
+                                             float maxDistance) const {
+   if (direction == glm::vec3(0.0f)) {
+      return llvm::None;
+   }
+
+   // Amanatides & Woo, "A Fast Voxel Traversal Algorithm for Ray Tracing".
+   // Distances are measured in blocks until the very end.
+   glm::vec3 rd = glm::normalize(direction);
+   glm::vec3 ro = origin / MC_BLOCK_SCALE;
+   float maxT = maxDistance / MC_BLOCK_SCALE;
+
+   WorldPosition pos = getWorldPosition(origin);
+   int *posCoords[3] = { &pos.x, &pos.y, &pos.z };
+
+   // The faces that are entered when stepping in the positive or negative
+   // direction along each axis.
+   static constexpr Block::FaceMask enteredFaces[3][2] = {
+      { Block::F_Left, Block::F_Right },
+      { Block::F_Bottom, Block::F_Top },
+      { Block::F_Back, Block::F_Front },
+   };
+
+   int step[3];
+   float tMax[3];
+   float tDelta[3];
+
+   for (int axis = 0; axis < 3; ++axis) {
+      if (rd[axis] > 0.0f) {
+         step[axis] = 1;
+         tDelta[axis] = 1.0f / rd[axis];
+         tMax[axis] = ((float)*posCoords[axis] + 1.0f - ro[axis]) * tDelta[axis];
+      }
+      else if (rd[axis] < 0.0f) {
+         step[axis] = -1;
+         tDelta[axis] = -1.0f / rd[axis];
+         tMax[axis] = (ro[axis] - (float)*posCoords[axis]) * tDelta[axis];
+      }
+      else {
+         step[axis] = 0;
+         tDelta[axis] = std::numeric_limits<float>::infinity();
+         tMax[axis] = std::numeric_limits<float>::infinity();
+      }
+   }
+
+   // Consecutive blocks are almost always in the same chunk and section, so
+   // only look those up when the ray leaves them.
+   ChunkPosition chunkPos = getChunkPosition(pos);
+   Chunk *chunk = const_cast<World*>(this)->getChunk(chunkPos, false);
+   if (chunk && !chunk->isReady()) {
+      chunk = nullptr;
+   }
+
+   int sectionY = -1;
+   ChunkSegment *seg = nullptr;
+
+   Block::FaceMask face = Block::F_None;
+   float t = 0.0f;
+
+   while (true) {
+      ChunkPosition newChunkPos = getChunkPosition(pos);
+      if (newChunkPos != chunkPos) {
+         chunkPos = newChunkPos;
+         chunk = const_cast<World*>(this)->getChunk(chunkPos, false);
+         sectionY = -1;
+
+         if (chunk && !chunk->isReady()) {
+            chunk = nullptr;
+         }
+      }
+
+      if (chunk && pos.y >= -(MC_CHUNK_HEIGHT / 2) && pos.y < (MC_CHUNK_HEIGHT / 2)) {
+         int newSectionY = (pos.y + (MC_CHUNK_HEIGHT / 2)) / MC_CHUNK_SEGMENT_HEIGHT;
+         if (newSectionY != sectionY) {
+            sectionY = newSectionY;
+            seg = chunk->getSegmentForYCoord(pos.y, false);
+         }
+
+         // Segments that were never allocated only contain air.
+         if (seg) {
+            const Block &block = seg->getBlockAt(getPositionInChunk(pos));
+            if (block.isSolid()) {
+               RaycastResult result;
+               result.block = &block;
+               result.pos = pos;
+               result.face = face;
+               result.distance = t * MC_BLOCK_SCALE;
+
+               return result;
+            }
+         }
+      }
+
+      // Step to the next block along the axis whose boundary is closest.
+      int axis = 0;
+      if (tMax[1] < tMax[axis]) {
+         axis = 1;
+      }
+      if (tMax[2] < tMax[axis]) {
+         axis = 2;
+      }
+
+      if (tMax[axis] > maxT) {
+         return llvm::None;
+      }
+
+      t = tMax[axis];
+      tMax[axis] += tDelta[axis];
+      *posCoords[axis] += step[axis];
+      face = enteredFaces[axis][step[axis] < 0];
+   }
+}
+
 void World::updateBlock(const mc::WorldPosition &pos,
                         mc::Block &&block,
                         bool delayIfNecessary) {
    auto chunkPos = getChunkPosition(pos);
    auto *chunk = const_cast<World*>(this)->getChunk(chunkPos, false);
 
-   if (!chunk) {
+   if (!chunk || !chunk->isReady()) {
       if (delayIfNecessary) {
          blockUpdates[chunkPos].emplace_back(pos, std::move(block));
       }
@@ -205,7 +339,33 @@ void World::updateBlock(const mc::WorldPosition &pos,
       return;
    }
 
-   chunk->updateBlock(pos, std::move(block));
+   // Only update the light if the block's opacity or emitted light changed.
+   auto *oldBlock = getBlock(pos);
+   bool lightChanged = !oldBlock
+      || oldBlock->isTransparent() != block.isTransparent()
+      || oldBlock->getLightLevel() != block.getLightLevel();
+
+   {
+      // The simulation thread reads the collision data of loaded chunks.
+      std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+      chunk->updateBlock(pos, std::move(block));
+   }
+
+   if (lightChanged) {
+      lightEngine->blockChanged(pos);
+   }
+}
+
+uint8_t World::getLight(const WorldPosition &pos) const
+{
+   auto chunkPos = getChunkPosition(pos);
+   const Chunk *chunk = const_cast<World*>(this)->getChunk(chunkPos, false);
+
+   if (!chunk || !chunk->isReady()) {
+      return ChunkSegment::FullSkyLight;
+   }
+
+   return chunk->getLightAt(pos);
 }
 
 const Block* World::getBlockNeighbour(const Block &block,
@@ -245,117 +405,170 @@ void World::getBlockNeighbours(const Block &block,
    neighbours[5] = getBlockNeighbour(block, BackNeighbour);
 }
 
-void World::growWorld(int neededMinX, int neededMaxX,
-                      int neededMinZ, int neededMaxZ) {
-   assert(neededMinX <= neededMaxX);
-   assert(neededMinZ <= neededMaxZ);
+World::SegmentTable *World::growWorld(int x, int z)
+{
+   auto *table = segmentTable.load(std::memory_order_relaxed);
+   if (table && table->getSlot(x, z)) {
+      return table;
+   }
 
-   int totalMinX = std::min(minX, neededMinX);
-   int totalMinZ = std::min(minZ, neededMinZ);
+   int minX = x;
+   int maxX = x + 1;
+   int minZ = z;
+   int maxZ = z + 1;
+
+   if (table) {
+      // Leave some room in the direction the world grows in.
+      minX = x < table->minX ? x - SegmentTableMargin : table->minX;
+      maxX = x >= table->maxX ? x + 1 + SegmentTableMargin : table->maxX;
+      minZ = z < table->minZ ? z - SegmentTableMargin : table->minZ;
+      maxZ = z >= table->maxZ ? z + 1 + SegmentTableMargin : table->maxZ;
+   }
 
-   int totalMaxX = std::max(maxX, neededMaxX);
-   int totalMaxZ = std::max(maxZ, neededMaxZ);
+   auto newTable = std::make_unique<SegmentTable>(minX, maxX, minZ, maxZ);
+   if (table) {
+      for (int i = table->minX; i < table->maxX; ++i) {
+         for (int j = table->minZ; j < table->maxZ; ++j) {
+            newTable->getSlot(i, j)->store(
+               table->getSlot(i, j)->load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
+         }
+      }
+   }
 
-   bool growX = neededMinX < minX || neededMaxX > maxX;
-   int xSize = totalMaxX - totalMinX;
-   if (growX) {
-      int negoffset = -totalMinX;
+   // Readers may still use the old table, so it is kept alive.
+   table = newTable.get();
+   segmentTables.push_back(std::move(newTable));
+   segmentTable.store(table, std::memory_order_release);
 
-      // Allocate enough space for the new x values.
-      loadedSegments =
-         (WorldSegment***)realloc(loadedSegments,
-                                  xSize * sizeof(WorldSegment**));
+   return table;
+}
 
-      // Shift values to the right if necessary.
-      int negXdiff = minX - neededMinX;
-      if (negXdiff > 0) {
-         std::memmove(loadedSegments + negXdiff, loadedSegments,
-                      (maxX - minX) * sizeof(WorldSegment**));
+void World::updatePlayerPosition()
+{
+   MC_PROFILE_SCOPE("updatePlayerPosition");
+   glm::vec3 pos = app.getPlayer()->getPosition();
 
-         // Fill new values with nullptr.
-         std::memset(loadedSegments, 0, negXdiff * sizeof(WorldSegment**));
-      }
+   // Get the position of the player in world coordinates.
+   auto playerPosW = getWorldPosition(pos);
 
-      int posXdiff = neededMaxX - maxX;
-      if (posXdiff > 0) {
-         // Fill new values with nullptr.
-         std::memset(loadedSegments + negoffset + maxX, 0,
-                     posXdiff * sizeof(WorldSegment**));
-      }
+   // Get the chunk that the player is located in.
+   auto *playerChunk = getChunk(getChunkPosition(playerPosW));
+
+   // If this chunk is already loaded, we're done.
+   if (!centerChunk) {
+      loadChunk(playerChunk);
    }
+   else if (playerChunk != centerChunk) {
+      // Check if the player crossed the threshold for loading new chunks.
+      float distance = glm::distance(
+         pos, getScenePosition(centerChunk->getCenterWorldPosition()));
 
-   bool growZ = neededMinZ < minZ || neededMaxZ > maxZ;
-   if (growX || growZ) {
-      int negoffset = -totalMinZ;
-      int zSize = totalMaxZ - totalMinZ;
-      int posZdiff = neededMaxZ - maxZ;
-      int negZdiff = minZ - neededMinZ;
+      if (distance > chunkUpdateDistanceThreshold) {
+         loadChunk(playerChunk);
+      }
+   }
 
-      for (int i = 0; i < xSize; ++i) {
-         WorldSegment **&ptr = loadedSegments[i];
-         bool loaded = ptr != nullptr;
+   processLoadQueue();
+}
 
-         if (!growZ && loaded) {
-            continue;
-         }
+float World::getLoadPriority(const Chunk &chunk, const glm::vec3 &pos,
+                             const glm::vec3 &dir) {
+   static constexpr float chunkWidth = MC_CHUNK_WIDTH * MC_BLOCK_SCALE;
 
-         ptr = (WorldSegment**)realloc(ptr, zSize * sizeof(WorldSegment*));
+   ScenePosition center = getScenePosition(chunk.getCenterWorldPosition());
+   glm::vec2 offset(center.x - pos.x, center.z - pos.z);
 
-         // We need to set all values to null.
-         if (!loaded) {
-            std::memset(ptr, 0, zSize * sizeof(WorldSegment*));
-         }
-         else {
-            if (negZdiff > 0) {
-               // Shift old values to the right.
-               std::memmove((void *) (ptr + negZdiff),
-                            (void *) ptr,
-                            (maxZ - minZ) * sizeof(WorldSegment*));
-
-               // Set new negative values to nullptr.
-               std::memset(ptr, 0, negZdiff * sizeof(WorldSegment*));
-            }
+   // The chunks right around the player are needed regardless of where they
+   // are looking.
+   float distance = glm::length(offset) / chunkWidth;
+   if (distance < 1.5f) {
+      return distance;
+   }
 
-            if (posZdiff > 0) {
-               // Set new negative values to nullptr.
-               std::memset(ptr + negoffset + maxZ, 0,
-                           posZdiff * sizeof(WorldSegment*));
-            }
-         }
-      }
+   glm::vec2 viewDir(dir.x, dir.z);
+   if (viewDir == glm::vec2(0.0f)) {
+      return distance;
    }
 
-   minX = totalMinX;
-   maxX = totalMaxX;
-   minZ = totalMinZ;
-   maxZ = totalMaxZ;
+   float facing = glm::dot(offset / glm::length(offset),
+                           glm::normalize(viewDir));
+
+   return distance * (1.5f - 0.5f * facing);
 }
 
-void World::updatePlayerPosition()
+void World::processLoadQueue()
 {
-   glm::vec3 pos = app.getPlayer()->getPosition();
+   MC_PROFILE_SCOPE("processLoadQueue");
+   using Clock = std::chrono::steady_clock;
+   auto start = Clock::now();
 
-   // Get the position of the player in world coordinates.
-   auto playerPosW = getWorldPosition(pos);
+   // Integrate the chunks that finished generating.
+   std::vector<GeneratedChunk> finished;
+   {
+      std::lock_guard<std::mutex> guard(generatedMutex);
+      std::swap(finished, generatedChunks);
+   }
 
-   // Get the chunk that the player is located in.
-   auto *playerChunk = getChunk(getChunkPosition(playerPosW));
+   size_t numFinished = 0;
+   for (; numFinished < finished.size(); ++numFinished) {
+      float elapsed = std::chrono::duration<float, std::milli>(
+         Clock::now() - start).count();
 
-   // If this chunk is already loaded, we're done.
-   if (playerChunk == centerChunk) {
+      if (numFinished == MaxChunksPerFrame
+      || (numFinished > 0 && elapsed >= ChunkLoadBudget)) {
+         break;
+      }
+
+      finishChunk(finished[numFinished]);
+   }
+
+   // Leave the rest for the next frame.
+   if (numFinished < finished.size()) {
+      std::lock_guard<std::mutex> guard(generatedMutex);
+      generatedChunks.insert(
+         generatedChunks.begin(),
+         std::make_move_iterator(finished.begin() + numFinished),
+         std::make_move_iterator(finished.end()));
+   }
+
+   auto &jobs = app.getJobSystem();
+   size_t maxScheduled = MaxScheduledChunksPerThread * jobs.getNumThreads();
+
+   if (loadQueue.empty() || scheduledChunks.size() >= maxScheduled) {
       return;
    }
 
-   if (!centerChunk) {
-      return loadChunk(playerChunk);
+   // Re-prioritize the requests, since the player moves and turns between
+   // frames. The most urgent request goes to the back.
+   auto *player = app.getPlayer();
+   for (auto &request : loadQueue) {
+      request.priority = getLoadPriority(*request.chunk, player->getPosition(),
+                                         player->getDirection());
    }
 
-   // Check if the player crossed the threshold for loading new chunks.
-   float distance = glm::distance(
-      pos, getScenePosition(centerChunk->getCenterWorldPosition()));
+   std::sort(loadQueue.begin(), loadQueue.end(),
+             [](const ChunkLoadRequest &lhs, const ChunkLoadRequest &rhs) {
+                return lhs.priority > rhs.priority;
+             });
 
-   if (distance > chunkUpdateDistanceThreshold) {
-      loadChunk(playerChunk);
+   while (!loadQueue.empty() && scheduledChunks.size() < maxScheduled) {
+      ChunkLoadRequest request = loadQueue.back();
+      loadQueue.pop_back();
+
+      // The main thread may have generated the chunk in the meantime.
+      if (!request.chunk->updateGenerationState(
+         Chunk::GenerationState::Queued, Chunk::GenerationState::Scheduled)) {
+         continue;
+      }
+
+      // The chunks right around the player go before everything else.
+      auto priority = request.priority < 1.5f ? JobPriority::High
+                                              : JobPriority::Normal;
+
+      scheduledChunks.push_back(request.chunk);
+      jobs.submit<&World::generateChunkTask>(
+         request.chunk, JobOptions(priority, &generationJobs));
    }
 }
 
@@ -380,6 +593,11 @@ void World::loadChunk(Chunk *chunk)
 //      }
 //   }
 
+   // The player stands in this chunk, so it can't wait.
+   if (!chunk->isReady()) {
+      generateChunk(*chunk);
+   }
+
    chunksToRender[k++] = chunk;
    centerChunk = chunk;
 
@@ -397,16 +615,71 @@ void World::loadChunk(Chunk *chunk)
    }
 
    assert(k == numChunksToRender);
+   unloadDistantChunks(chunkPos);
+
+   // Cancel the requests that left the render distance. Jobs that already
+   // started are left to finish.
+   int maxDistance = (int)renderDistance;
+   auto isOutOfRange = [&](Chunk *other) {
+      auto pos = other->getChunkPosition();
+      return std::abs(pos.x - chunkX) > maxDistance
+         || std::abs(pos.z - chunkZ) > maxDistance;
+   };
+
+   loadQueue.erase(
+      std::remove_if(loadQueue.begin(), loadQueue.end(),
+                     [&](const ChunkLoadRequest &request) {
+                        if (!isOutOfRange(request.chunk)) {
+                           return false;
+                        }
+
+                        request.chunk->updateGenerationState(
+                           Chunk::GenerationState::Queued,
+                           Chunk::GenerationState::NotGenerated);
+
+                        return true;
+                     }),
+      loadQueue.end());
+
+   scheduledChunks.erase(
+      std::remove_if(scheduledChunks.begin(), scheduledChunks.end(),
+                     [&](Chunk *other) {
+                        return isOutOfRange(other)
+                           && other->updateGenerationState(
+                              Chunk::GenerationState::Scheduled,
+                              Chunk::GenerationState::NotGenerated);
+                     }),
+      scheduledChunks.end());
+
+   // Request the missing chunks. They are prioritized once per frame.
+   for (unsigned i = 1; i < numChunksToRender; ++i) {
+      Chunk *other = chunksToRender[i];
+      if (other->getGenerationState() != Chunk::GenerationState::NotGenerated) {
+         continue;
+      }
 
-   // Update active entities.
-   activeEntities.clear();
+      other->setGenerationState(Chunk::GenerationState::Queued);
+      loadQueue.push_back(ChunkLoadRequest{ other, 0.0f });
+   }
 
-   for (auto *e : entities) {
-      auto chunkPos = getChunkPosition(e->getPosition());
-      if (isChunkVisible(chunkPos)) {
-         activeEntities.insert(e);
+   // Update the low detail terrain beyond the render distance.
+   if (app.gameOptions.farRenderDistance > renderDistance) {
+      if (!farTerrain) {
+         farTerrain = new(app) FarTerrain(*this);
       }
+
+      farTerrain->updateCenter(chunkPos);
    }
+
+   // Update active entities, using the same area as isChunkVisible().
+   ChunkArea activeArea;
+   activeArea.minX = chunkX - (int)renderDistance;
+   activeArea.maxX = chunkX + (int)renderDistance;
+   activeArea.minZ = chunkZ - (int)renderDistance;
+   activeArea.maxZ = chunkZ + (int)renderDistance;
+
+   std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+   entityStore.setActiveArea(activeArea);
 }
 
 llvm::ArrayRef<Chunk*> World::getChunksToRender() const
@@ -416,11 +689,48 @@ llvm::ArrayRef<Chunk*> World::getChunksToRender() const
 
 void World::registerEntity(Entity *e)
 {
-   entities.push_back(e);
+   uint8_t flags = 0;
+   if (MovableEntity::classof(e)) {
+      flags = EntityStore::Collides | EntityStore::HasGravity;
+   }
+
+   std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+   e->id = entityStore.addEntity(e, e->getPosition(), e->getBoundingBox(),
+                                 flags);
+}
+
+Entity *World::raycastEntities(const ScenePosition &origin,
+                               const glm::vec3 &direction, float maxDistance,
+                               const Entity *ignore, float *distance) {
+   std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+
+   llvm::Optional<EntityID> ignoreID;
+   if (ignore) {
+      ignoreID = ignore->getID();
+   }
 
-   auto chunkPos = getChunkPosition(e->getPosition());
-   if (isChunkVisible(chunkPos)) {
-      activeEntities.insert(e);
+   auto hit = entityStore.getGrid().raycast(origin, direction, maxDistance,
+                                            ignoreID);
+   if (!hit) {
+      return nullptr;
+   }
+
+   if (distance) {
+      *distance = hit->distance;
+   }
+
+   return entityStore.getOwner(hit->id);
+}
+
+void World::getEntitiesInRange(const ScenePosition &center, float radius,
+                               llvm::SmallVectorImpl<Entity*> &result) {
+   llvm::SmallVector<EntityID, 16> ids;
+
+   std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+   entityStore.getGrid().queryRange(center, radius, ids);
+
+   for (EntityID id : ids) {
+      result.push_back(entityStore.getOwner(id));
    }
 }
 
@@ -439,26 +749,174 @@ bool World::isChunkVisible(const ChunkPosition &pos) const
       && pos.z < centerPos.z + renderDistance;
 }
 
-void World::genWorld(WorldSegment &seg)
+void World::generateChunkTask(Chunk *chunk)
 {
-   for (auto &chunk : seg.getChunks()) {
-      // Perform delayed block updates.
-      auto it = blockUpdates.find(chunk.getChunkPosition());
-      if (it != blockUpdates.end()) {
-         for (DelayedBlockUpdate &update : it->second) {
-            updateBlock(update.pos, std::move(update.block));
+   // The request may have been cancelled, or taken over by the main thread.
+   if (!chunk->updateGenerationState(Chunk::GenerationState::Scheduled,
+                                     Chunk::GenerationState::Generating)) {
+      return;
+   }
+
+   MC_PROFILE_SCOPE("generateChunk");
+   World &world = chunk->getWorld();
+   uint64_t start = Profiler::now();
+
+   GeneratedChunk generated{ chunk, {} };
+   world.worldGenerator->generateTerrain(*chunk, generated.outsideBlocks);
+   chunk->setGenerationState(Chunk::GenerationState::Generated);
+
+   numGeneratedChunks.add();
+   generateTime.record((Profiler::now() - start) / 1000);
+
+   std::lock_guard<std::mutex> guard(world.generatedMutex);
+   world.generatedChunks.push_back(std::move(generated));
+}
+
+void World::generateChunk(Chunk &chunk)
+{
+   switch (chunk.getGenerationState()) {
+   case Chunk::GenerationState::NotGenerated:
+   case Chunk::GenerationState::Queued:
+      // Jobs never touch chunks in these states.
+      chunk.setGenerationState(Chunk::GenerationState::Generating);
+      break;
+   case Chunk::GenerationState::Scheduled:
+      // Take the chunk over if its job did not start yet.
+      if (!chunk.updateGenerationState(Chunk::GenerationState::Scheduled,
+                                       Chunk::GenerationState::Generating)) {
+         return;
+      }
+
+      break;
+   default:
+      // A job is generating the chunk, or it is done already.
+      return;
+   }
+
+   uint64_t start = Profiler::now();
+
+   GeneratedChunk generated{ &chunk, {} };
+   worldGenerator->generateTerrain(chunk, generated.outsideBlocks);
+
+   numGeneratedChunks.add();
+   generateTime.record((Profiler::now() - start) / 1000);
+
+   finishChunk(generated);
+}
+
+Chunk *World::generateChunkNow(const ChunkPosition &chunkPos)
+{
+   Chunk *chunk = getChunk(chunkPos);
+   generateChunk(*chunk);
+
+   return chunk;
+}
+
+void World::finishChunk(GeneratedChunk &generated)
+{
+   Chunk &chunk = *generated.chunk;
+
+   auto it = std::find(scheduledChunks.begin(), scheduledChunks.end(), &chunk);
+   if (it != scheduledChunks.end()) {
+      scheduledChunks.erase(it);
+   }
+
+   // Publish the chunk first, so that block updates to it are no longer
+   // delayed.
+   chunk.setGenerationState(Chunk::GenerationState::Ready);
+
+   // Perform delayed block updates. The generated terrain takes precedence.
+   auto chunkPos = chunk.getChunkPosition();
+   auto updatesIt = blockUpdates.find(chunkPos);
+   if (updatesIt != blockUpdates.end()) {
+      for (DelayedBlockUpdate &update : updatesIt->second) {
+         const Block *block =
+            static_cast<const Chunk&>(chunk).getBlockAt(update.pos);
+         if (block && !block->is(Block::Air)) {
+            continue;
          }
 
-         it->second.clear();
+         updateBlock(update.pos, std::move(update.block));
       }
 
-      worldGenerator->generateTerrain(chunk);
-      chunk.setModified();
+      blockUpdates.erase(updatesIt);
+   }
+
+   // Place the blocks the generator put into other chunks, which are delayed
+   // if those chunks are not ready yet.
+   for (DelayedBlockUpdate &update : generated.outsideBlocks) {
+      updateBlock(update.pos, std::move(update.block));
+   }
+
+   lightEngine->initializeChunk(chunk);
+   chunk.setModified();
+   loadedChunks.push_back(&chunk);
+   numLoadedChunks.add();
+
+   // The faces on the border of the neighbouring chunks may now be hidden.
+   static constexpr int offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+   for (auto &offset : offsets) {
+      auto *other = getChunk(ChunkPosition(chunkPos.x + offset[0],
+                                           chunkPos.z + offset[1]), false);
+
+      if (other && other->isReady()) {
+         other->setModified();
+      }
    }
 }
 
+void World::unloadDistantChunks(const ChunkPosition &center)
+{
+   int maxDistance = (int)app.gameOptions.renderDistance + UnloadMargin;
+   auto unloadBegin = std::partition(
+      loadedChunks.begin(), loadedChunks.end(), [&](Chunk *chunk) {
+         auto pos = chunk->getChunkPosition();
+         return std::abs(pos.x - center.x) <= maxDistance
+            && std::abs(pos.z - center.z) <= maxDistance;
+      });
+
+   if (unloadBegin == loadedChunks.end()) {
+      return;
+   }
+
+   // Waits for the light propagation, which takes the world mutex.
+   for (auto it = unloadBegin; it != loadedChunks.end(); ++it) {
+      lightEngine->removeChunk(**it);
+   }
+
+   {
+      // The simulation thread reads the blocks of loaded chunks.
+      std::lock_guard<std::mutex> guard(simulation->getWorldMutex());
+      for (auto it = unloadBegin; it != loadedChunks.end(); ++it) {
+         (*it)->unload();
+      }
+   }
+
+   numUnloadedChunks.add(
+      (uint64_t)std::distance(unloadBegin, loadedChunks.end()));
+   loadedChunks.erase(unloadBegin, loadedChunks.end());
+}
+
+void World::updateMetrics()
+{
+   static MetricGauge &loadQueueSize = Metrics::getGauge("queue.chunkLoad");
+   static MetricGauge &numScheduled = Metrics::getGauge("queue.chunkScheduled");
+   static MetricGauge &numGenerated = Metrics::getGauge("queue.chunkIntegrate");
+   static MetricGauge &numLightUpdates = Metrics::getGauge("queue.light");
+
+   loadQueueSize.set((int64_t)loadQueue.size());
+   numScheduled.set((int64_t)scheduledChunks.size());
+   numLightUpdates.set((int64_t)lightEngine->getNumPendingUpdates());
+
+   std::lock_guard<std::mutex> guard(generatedMutex);
+   numGenerated.set((int64_t)generatedChunks.size());
+}
+
 void World::updateVisibility()
 {
+   MC_PROFILE_SCOPE("updateVisibility");
+   lightEngine->update();
+
    for (auto *chunk : getChunksToRender()) {
       chunk->updateVisibility();
    }
@@ -471,24 +929,30 @@ void World::dump()
 
 void World::print(llvm::raw_ostream &OS) const
 {
+   auto *table = segmentTable.load(std::memory_order_acquire);
+   if (!table) {
+      return;
+   }
+
    int i = 0;
-   for (int x = minX; x < maxX; ++x) {
+   for (int x = table->minX; x < table->maxX; ++x) {
       if (i++ > 0) {
          OS << "\n";
       }
 
       int j = 0;
-      for (int z = minZ; z < maxZ; ++z) {
+      for (int z = table->minZ; z < table->maxZ; ++z) {
          if (j++ > 0) {
             OS << " ";
          }
 
-         auto *chunk = const_cast<World*>(this)->getChunk(ChunkPosition(x, z),
-                                                          false);
-         assert(chunk && "unloaded chunk");
+         auto *segment = table->getSlot(x, z)->load(std::memory_order_acquire);
+         if (!segment) {
+            OS << "(-)";
+            continue;
+         }
 
-         OS << "(" << chunk->getChunkPosition().x << ", "
-            << chunk->getChunkPosition().z << ")";
+         OS << "(" << x << ", " << z << ")";
       }
    }
 }
\ No newline at end of file
@@ -12,44 +12,44 @@ WorldGenerator::WorldGenerator(World *world, WorldGenOptions options)
 
 DefaultTerrainGenerator::DefaultTerrainGenerator(World *world,
                                                  WorldGenOptions &options)
-   : WorldGenerator(world, options), noiseGenerator(options.seed),
-     rng((unsigned)options.seed)
+   : WorldGenerator(world, options), noiseGenerator(options.seed)
 {
    visualizeNoise([&](int x, int z) {
-      return getBiomeNoise(ChunkPosition(x, z));
+      return getBiomeNoise(noiseGenerator, ChunkPosition(x, z));
    }, "biome_noise", 512, 512);
 //
 //   visualizeNoise([&](int x, int z) {
-//      return getTreeNoise(Biome::Forest, x, z);
+//      return getTreeNoise(noiseGenerator, Biome::Forest, x, z);
 //   }, "forest_tree_noise", 512, 512);
 //
 //   visualizeNoise([&](int x, int z) {
-//      return getTreeNoise(Biome::Plains, x, z);
+//      return getTreeNoise(noiseGenerator, Biome::Plains, x, z);
 //   }, "plains_tree_noise", 512, 512);
 }
 
-float DefaultTerrainGenerator::getNoise(int x, int z, float frequency,
+float DefaultTerrainGenerator::getNoise(FastNoise &noise, int x, int z,
+                                        float frequency,
                                         float lacunarity,
                                         float gain,
                                         FastNoise::FractalType type) {
-   noiseGenerator.SetFrequency(frequency);
-   noiseGenerator.SetFractalLacunarity(lacunarity);
-   noiseGenerator.SetFractalGain(gain);
-   noiseGenerator.SetFractalType(type);
+   noise.SetFrequency(frequency);
+   noise.SetFractalLacunarity(lacunarity);
+   noise.SetFractalGain(gain);
+   noise.SetFractalType(type);
 
-   return noiseGenerator.GetSimplexFractal(x, z);
+   return noise.GetSimplexFractal(x, z);
 }
 
-float DefaultTerrainGenerator::getNoise(Biome b, int x, int z)
+float DefaultTerrainGenerator::getNoise(FastNoise &noise, Biome b, int x, int z)
 {
    switch (b) {
    case Biome::Plains:
    case Biome::Forest: {
       // Generate high hills with a low frequency.
-      float mountainNoise = getNoise(x, z, 0.01f, 1.0f);
+      float mountainNoise = getNoise(noise, x, z, 0.01f, 1.0f);
 
       // Generate lower hills with a low frequency.
-      float terrainNoise = getNoise(x, z, 0.03f, 2.0f);
+      float terrainNoise = getNoise(noise, x, z, 0.03f, 2.0f);
 
       // Combine the two noise levels.
       float rawNoise = 0.2f * mountainNoise + 0.8f * terrainNoise;
@@ -58,15 +58,15 @@ float DefaultTerrainGenerator::getNoise(Biome b, int x, int z)
       return pow(rawNoise, 5.0f);
    }
    case Biome::Mountains: {
-      return getNoise(x, z);
+      return getNoise(noise, x, z);
    }
    default:
       return 0.0f;
    }
 }
 
-float DefaultTerrainGenerator::getTreeNoise(Biome b, int x, int z)
-{
+float DefaultTerrainGenerator::getTreeNoise(FastNoise &noise, Biome b,
+                                            int x, int z) {
    int R;
    switch (b) {
    case Biome::Plains:
@@ -83,7 +83,7 @@ float DefaultTerrainGenerator::getTreeNoise(Biome b, int x, int z)
    }
 
    // Generate peaks with a medium frequency.
-   float peakNoise = getNoise(x, z, 0.03f, 3.0f);
+   float peakNoise = getNoise(noise, x, z, 0.03f, 3.0f);
 
    bool shouldGenerate = true;
    for (int xn = x - R; xn <= x + R; ++xn) {
@@ -92,7 +92,7 @@ float DefaultTerrainGenerator::getTreeNoise(Biome b, int x, int z)
             continue;
          }
 
-         float neighborNoise = getNoise(xn, zn, 0.03f, 3.0f);
+         float neighborNoise = getNoise(noise, xn, zn, 0.03f, 3.0f);
          if (neighborNoise >= peakNoise) {
             shouldGenerate = false;
             break;
@@ -104,34 +104,47 @@ float DefaultTerrainGenerator::getTreeNoise(Biome b, int x, int z)
    return shouldGenerate ? -1.0f : 1.0f;
 }
 
-float DefaultTerrainGenerator::getBiomeNoise(ChunkPosition chunkPos)
-{
-   noiseGenerator.SetCellularDistanceFunction(FastNoise::Natural);
-   noiseGenerator.SetFrequency(0.05f);
-   noiseGenerator.SetCellularReturnType(FastNoise::CellValue);
-   noiseGenerator.SetCellularJitter(0.8f);
+float DefaultTerrainGenerator::getBiomeNoise(FastNoise &noise,
+                                             ChunkPosition chunkPos) {
+   noise.SetCellularDistanceFunction(FastNoise::Natural);
+   noise.SetFrequency(0.05f);
+   noise.SetCellularReturnType(FastNoise::CellValue);
+   noise.SetCellularJitter(0.8f);
 
-   return noiseGenerator.GetCellular(chunkPos.x, chunkPos.z);
+   return noise.GetCellular(chunkPos.x, chunkPos.z);
 }
 
-Biome DefaultTerrainGenerator::getBiome(const Chunk &chunk)
-{
-   float noise = getBiomeNoise(chunk.getChunkPosition());
-   noise += 1.0f;
+Biome DefaultTerrainGenerator::getBiome(FastNoise &noise,
+                                        ChunkPosition chunkPos) {
+   float biomeNoise = getBiomeNoise(noise, chunkPos);
+   biomeNoise += 1.0f;
 
-   if (noise >= 1.2f) {
+   if (biomeNoise >= 1.2f) {
       return Biome::Plains;
    }
 
-   if (noise >= 0.5f) {
+   if (biomeNoise >= 0.5f) {
       return Biome::Forest;
    }
 
    return Biome::Mountains;
 }
 
-void DefaultTerrainGenerator::generateTerrain(Chunk &chunk)
+int DefaultTerrainGenerator::getHeight(FastNoise &noise, Biome b, int x, int z)
 {
+   return (int)((getNoise(noise, b, x, z) * MC_CHUNK_HEIGHT / 2.0f));
+}
+
+bool DefaultTerrainGenerator::sampleColumn(FastNoise &noise, int x, int z,
+                                           TerrainColumn &column) {
+   column.biome = getBiome(noise, getChunkPosition(WorldPosition(x, 0, z)));
+   column.height = getHeight(noise, column.biome, x, z);
+
+   return true;
+}
+
+void DefaultTerrainGenerator::generateTerrain(
+   Chunk &chunk, std::vector<World::DelayedBlockUpdate> &outsideBlocks) {
    auto &app = world->getApplication();
 
    static auto grass = Block::createGrass(app, glm::vec3(0.0f));
@@ -139,7 +152,17 @@ void DefaultTerrainGenerator::generateTerrain(Chunk &chunk)
    static auto stone = Block::createStone(app, glm::vec3(0.0f));
    static auto water = Block::createWater(app, glm::vec3(0.0f));
 
-   Biome biome = getBiome(chunk);
+   // Chunks are generated in parallel, so use a local noise generator, and a
+   // random number generator seeded by the chunk position so that the trees
+   // don't depend on the order of generation.
+   FastNoise noise = noiseGenerator;
+
+   auto chunkPos = chunk.getChunkPosition();
+   std::mt19937 rng((unsigned)options.seed
+                    ^ ((unsigned)chunkPos.x * 73856093u)
+                    ^ ((unsigned)chunkPos.z * 19349663u));
+
+   Biome biome = getBiome(noise, chunkPos);
    chunk.setBiome(biome);
 
    for (unsigned x = 0; x < MC_CHUNK_WIDTH; ++x) {
@@ -147,8 +170,7 @@ void DefaultTerrainGenerator::generateTerrain(Chunk &chunk)
          BlockPositionChunk pos(x, 0, z);
          WorldPosition worldPos = chunk.getWorldPosition(pos);
 
-         float noise = getNoise(biome, worldPos.x, worldPos.z);
-         int height = (int)((noise * MC_CHUNK_HEIGHT / 2.0f));
+         int height = getHeight(noise, biome, worldPos.x, worldPos.z);
 
          // Fill with water
          if (height < options.seaY) {
@@ -167,8 +189,8 @@ void DefaultTerrainGenerator::generateTerrain(Chunk &chunk)
                               false);
 
             // Generate trees.
-            if (getTreeNoise(biome, worldPos.x, worldPos.z) == -1.0f) {
-               generateTree(chunk, worldPos);
+            if (getTreeNoise(noise, biome, worldPos.x, worldPos.z) == -1.0f) {
+               generateTree(chunk, rng, worldPos, outsideBlocks);
             }
          }
 
@@ -190,8 +212,20 @@ void DefaultTerrainGenerator::generateTerrain(Chunk &chunk)
    }
 }
 
-void DefaultTerrainGenerator::generateTree(Chunk &chunk, const WorldPosition &pos)
-{
+/// Place a block in \p chunk, or remember it if it belongs to another chunk.
+static void placeBlock(Chunk &chunk, const WorldPosition &pos, Block &&block,
+                       std::vector<World::DelayedBlockUpdate> &outsideBlocks) {
+   if (getChunkPosition(pos) == chunk.getChunkPosition()) {
+      chunk.updateBlock(pos, std::move(block), false);
+   }
+   else {
+      outsideBlocks.emplace_back(pos, std::move(block));
+   }
+}
+
+void DefaultTerrainGenerator::generateTree(
+   Chunk &chunk, std::mt19937 &rng, const WorldPosition &pos,
+   std::vector<World::DelayedBlockUpdate> &outsideBlocks) {
    unsigned rd = rng();
    int height = 3 + (rd % 3);
 
@@ -218,8 +252,8 @@ void DefaultTerrainGenerator::generateTree(Chunk &chunk, const WorldPosition &po
             }
 
             worldPos.y = y;
-            world->updateBlock(worldPos,
-                               Block(leaf, getScenePosition(worldPos)));
+            placeBlock(chunk, worldPos, Block(leaf, getScenePosition(worldPos)),
+                       outsideBlocks);
          }
       }
    }
@@ -233,13 +267,13 @@ void DefaultTerrainGenerator::generateTree(Chunk &chunk, const WorldPosition &po
          }
 
          WorldPosition leafPos(x, pos.y + height - 1, z);
-         world->updateBlock(leafPos,
-                            Block(leaf, getScenePosition(leafPos)));
+         placeBlock(chunk, leafPos, Block(leaf, getScenePosition(leafPos)),
+                    outsideBlocks);
 
          if (rng() < (UINT_MAX / 3)) {
             ++leafPos.y;
-            world->updateBlock(leafPos,
-                               Block(leaf, getScenePosition(leafPos)));
+            placeBlock(chunk, leafPos, Block(leaf, getScenePosition(leafPos)),
+                       outsideBlocks);
          }
       }
    }